@@ -1,30 +1,51 @@
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <chrono>
 #include <stdexcept>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "../common/instrumentation.h"
 
 using namespace std;
 
 // Enums
 enum class Color { WHITE, BLACK };
 enum class PieceType { PAWN, ROOK, KNIGHT, BISHOP, QUEEN, KING };
-enum class GameState { ACTIVE, CHECK, CHECKMATE, STALEMATE, DRAW };
+enum class GameStatus { ACTIVE, CHECK, CHECKMATE, STALEMATE, DRAW };
 
 // Forward declarations
-class Piece;
 class Board;
 class GameState;
 
+inline Color opposite(Color color) {
+    return color == Color::WHITE ? Color::BLACK : Color::WHITE;
+}
+
 // Position class implementation
+// Row 0 is rank 8 and column 0 is file a, so square index row * 8 + col
+// runs from a8 (0) to h1 (63).
 class Position {
 private:
     int row;
     int col;
 
 public:
+    Position() : row(-1), col(-1) {}
+    
     Position(int row, int col) : row(row), col(col) {}
     
     Position(const string& notation) {
@@ -35,368 +56,1593 @@ public:
         row = 8 - (notation[1] - '0');
     }
     
+    static Position fromSquare(int square) { return Position(square / 8, square % 8); }
+    
     int getRow() const { return row; }
     int getCol() const { return col; }
+    int getSquare() const { return row * 8 + col; }
+    
+    string getNotation() const {
+        if (!isValid()) return "-";
+        string notation;
+        notation += 'a' + col;
+        notation += '0' + (8 - row);
+        return notation;
+    }
+    
+    bool isValid() const {
+        return row >= 0 && row < 8 && col >= 0 && col < 8;
+    }
+    
+    bool operator==(const Position& other) const {
+        return row == other.row && col == other.col;
+    }
+};
+
+// Bitboard helpers
+typedef uint64_t Bitboard;
+
+inline Bitboard squareBit(int square) { return 1ULL << square; }
+
+inline int lowestSquare(Bitboard bits) { return __builtin_ctzll(bits); }
+
+inline int popLowest(Bitboard& bits) {
+    int square = __builtin_ctzll(bits);
+    bits &= bits - 1;
+    return square;
+}
+
+inline int countBits(Bitboard bits) { return __builtin_popcountll(bits); }
+
+// AttackTables class implementation
+// Precomputed attack sets for every square. Knight, king and pawn attacks
+// are plain lookups. Rook and bishop attacks use magic bitboards, or PEXT
+// when the target supports BMI2, so a sliding attack is one multiply/shift
+// and one table load.
+class AttackTables {
+private:
+    struct Magic {
+        Bitboard mask;
+        Bitboard magic;
+        int shift;
+        size_t offset;
+    };
+    
+    Bitboard knightAttacks[64];
+    Bitboard kingAttacks[64];
+    Bitboard pawnAttacks[2][64];
+    Magic rookMagics[64];
+    Magic bishopMagics[64];
+    vector<Bitboard> rookTable;
+    vector<Bitboard> bishopTable;
+    // Squares strictly between, and the full line through, two aligned squares
+    vector<Bitboard> betweenTable;
+    vector<Bitboard> lineTable;
+    
+    AttackTables() {
+        const int knightSteps[8][2] = {{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}};
+        const int kingSteps[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+        
+        for (int square = 0; square < 64; square++) {
+            knightAttacks[square] = stepAttacks(square, knightSteps, 8);
+            kingAttacks[square] = stepAttacks(square, kingSteps, 8);
+            
+            // White pawns move towards row 0, black pawns towards row 7
+            const int whiteSteps[2][2] = {{-1, -1}, {-1, 1}};
+            const int blackSteps[2][2] = {{1, -1}, {1, 1}};
+            pawnAttacks[static_cast<int>(Color::WHITE)][square] = stepAttacks(square, whiteSteps, 2);
+            pawnAttacks[static_cast<int>(Color::BLACK)][square] = stepAttacks(square, blackSteps, 2);
+        }
+        
+        const int rookDirections[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+        const int bishopDirections[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+        initSliders(rookMagics, rookTable, rookDirections);
+        initSliders(bishopMagics, bishopTable, bishopDirections);
+        
+        betweenTable.assign(64 * 64, 0);
+        lineTable.assign(64 * 64, 0);
+        for (int a = 0; a < 64; a++) {
+            for (int b = 0; b < 64; b++) {
+                if (a == b) continue;
+                for (const auto* directions : {rookDirections, bishopDirections}) {
+                    if (!(rayAttacks(a, 0, directions) & squareBit(b))) continue;
+                    betweenTable[a * 64 + b] = rayAttacks(a, squareBit(b), directions) &
+                                               rayAttacks(b, squareBit(a), directions);
+                    lineTable[a * 64 + b] = (rayAttacks(a, 0, directions) & rayAttacks(b, 0, directions)) |
+                                            squareBit(a) | squareBit(b);
+                }
+            }
+        }
+    }
+    
+    static Bitboard stepAttacks(int square, const int steps[][2], int count) {
+        Bitboard attacks = 0;
+        for (int i = 0; i < count; i++) {
+            Position target(square / 8 + steps[i][0], square % 8 + steps[i][1]);
+            if (target.isValid()) attacks |= squareBit(target.getSquare());
+        }
+        return attacks;
+    }
+    
+    static Bitboard rayAttacks(int square, Bitboard occupied, const int directions[4][2]) {
+        Bitboard attacks = 0;
+        for (int i = 0; i < 4; i++) {
+            Position target(square / 8 + directions[i][0], square % 8 + directions[i][1]);
+            while (target.isValid()) {
+                attacks |= squareBit(target.getSquare());
+                if (occupied & squareBit(target.getSquare())) break;
+                target = Position(target.getRow() + directions[i][0], target.getCol() + directions[i][1]);
+            }
+        }
+        return attacks;
+    }
+    
+    static size_t index(const Magic& magic, Bitboard occupied) {
+#ifdef __BMI2__
+        return _pext_u64(occupied, magic.mask);
+#else
+        return static_cast<size_t>(((occupied & magic.mask) * magic.magic) >> magic.shift);
+#endif
+    }
+    
+    static uint64_t nextRandom(uint64_t& seed) {
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return seed * 2685821657736338717ULL;
+    }
+    
+    static void initSliders(Magic magics[64], vector<Bitboard>& table, const int directions[4][2]) {
+        const Bitboard rowEdges = 0xFFULL | (0xFFULL << 56);
+        const Bitboard colEdges = 0x0101010101010101ULL | (0x0101010101010101ULL << 7);
+        
+        size_t total = 0;
+        for (int square = 0; square < 64; square++) {
+            Bitboard row = 0xFFULL << (8 * (square / 8));
+            Bitboard col = 0x0101010101010101ULL << (square % 8);
+            Bitboard edges = (rowEdges & ~row) | (colEdges & ~col);
+            
+            magics[square].mask = rayAttacks(square, 0, directions) & ~edges;
+            magics[square].shift = 64 - countBits(magics[square].mask);
+            magics[square].offset = total;
+            total += 1ULL << countBits(magics[square].mask);
+        }
+        table.assign(total, 0);
+        
+        vector<Bitboard> occupancy(4096);
+        vector<Bitboard> reference(4096);
+        vector<int> epoch(4096, 0);
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        int attempt = 0;
+        
+        for (int square = 0; square < 64; square++) {
+            Magic& magic = magics[square];
+            Bitboard* attacks = &table[magic.offset];
+            
+            // Enumerate every subset of the mask (Carry-Rippler)
+            int size = 0;
+            Bitboard subset = 0;
+            do {
+                occupancy[size] = subset;
+                reference[size] = rayAttacks(square, subset, directions);
+                size++;
+                subset = (subset - magic.mask) & magic.mask;
+            } while (subset);
+
+#ifdef __BMI2__
+            for (int i = 0; i < size; i++) {
+                attacks[index(magic, occupancy[i])] = reference[i];
+            }
+#else
+            // Try sparse random magics until one maps every subset without
+            // a destructive collision
+            for (int i = 0; i < size; ) {
+                do {
+                    magic.magic = nextRandom(seed) & nextRandom(seed) & nextRandom(seed);
+                } while (countBits((magic.mask * magic.magic) >> 56) < 6);
+                
+                attempt++;
+                for (i = 0; i < size; i++) {
+                    size_t slot = index(magic, occupancy[i]);
+                    if (epoch[slot] < attempt) {
+                        epoch[slot] = attempt;
+                        attacks[slot] = reference[i];
+                    } else if (attacks[slot] != reference[i]) {
+                        break;
+                    }
+                }
+            }
+#endif
+        }
+    }
+
+public:
+    static const AttackTables& instance() {
+        static const AttackTables tables;
+        return tables;
+    }
+    
+    Bitboard knight(int square) const { return knightAttacks[square]; }
+    Bitboard king(int square) const { return kingAttacks[square]; }
+    Bitboard pawn(Color color, int square) const { return pawnAttacks[static_cast<int>(color)][square]; }
+    
+    Bitboard rook(int square, Bitboard occupied) const {
+        const Magic& magic = rookMagics[square];
+        return rookTable[magic.offset + index(magic, occupied)];
+    }
+    
+    Bitboard bishop(int square, Bitboard occupied) const {
+        const Magic& magic = bishopMagics[square];
+        return bishopTable[magic.offset + index(magic, occupied)];
+    }
+    
+    Bitboard queen(int square, Bitboard occupied) const {
+        return rook(square, occupied) | bishop(square, occupied);
+    }
+    
+    Bitboard between(int a, int b) const { return betweenTable[a * 64 + b]; }
+    Bitboard line(int a, int b) const { return lineTable[a * 64 + b]; }
+};
+
+// ZobristKeys class implementation
+// Random 64-bit keys for every (color, piece, square), the side to move,
+// each castling-rights combination and each en passant file. A position's
+// key is the XOR of the keys of its features, so a move updates it with a
+// handful of XORs.
+class ZobristKeys {
+private:
+    uint64_t pieceKeys[2][6][64];
+    uint64_t castlingKeys[16];
+    uint64_t enPassantKeys[8];
+    uint64_t sideKey;
+    
+    ZobristKeys() {
+        // Fixed seed so keys are identical across runs
+        uint64_t seed = 0x2545F4914F6CDD1DULL;
+        for (auto& color : pieceKeys) {
+            for (auto& type : color) {
+                for (auto& key : type) {
+                    key = next(seed);
+                }
+            }
+        }
+        for (auto& key : castlingKeys) key = next(seed);
+        for (auto& key : enPassantKeys) key = next(seed);
+        sideKey = next(seed);
+    }
+    
+    static uint64_t next(uint64_t& seed) {
+        // splitmix64
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    static const ZobristKeys& instance() {
+        static const ZobristKeys keys;
+        return keys;
+    }
+    
+    uint64_t piece(Color color, PieceType type, int square) const {
+        return pieceKeys[static_cast<int>(color)][static_cast<int>(type)][square];
+    }
+    uint64_t castling(uint8_t rights) const { return castlingKeys[rights & 0xF]; }
+    uint64_t enPassant(int col) const { return enPassantKeys[col]; }
+    uint64_t side() const { return sideKey; }
+};
+
+// Piece struct implementation
+struct Piece {
+    Color color;
+    PieceType type;
+};
+
+// Move class implementation
+// Packed into a few bytes so move lists live on the stack.
+class Move {
+private:
+    uint8_t from;
+    uint8_t to;
+    uint8_t promotionType;
+    uint8_t flags;
+
+public:
+    enum Flag : uint8_t {
+        QUIET = 0,
+        CAPTURE = 1,
+        DOUBLE_PUSH = 2,
+        EN_PASSANT = 4,
+        CASTLING = 8,
+        PROMOTION = 16
+    };
+    
+    Move() : from(0), to(0), promotionType(0), flags(QUIET) {}
+    
+    Move(int from, int to, uint8_t flags = QUIET, PieceType promotion = PieceType::QUEEN)
+        : from(static_cast<uint8_t>(from)), to(static_cast<uint8_t>(to)),
+          promotionType(static_cast<uint8_t>(promotion)), flags(flags) {}
+    
+    int getFromSquare() const { return from; }
+    int getToSquare() const { return to; }
+    Position getFrom() const { return Position::fromSquare(from); }
+    Position getTo() const { return Position::fromSquare(to); }
+    bool getIsCapture() const { return flags & CAPTURE; }
+    bool getIsDoublePush() const { return flags & DOUBLE_PUSH; }
+    bool getIsCastling() const { return flags & CASTLING; }
+    bool getIsEnPassant() const { return flags & EN_PASSANT; }
+    bool getIsPromotion() const { return flags & PROMOTION; }
+    PieceType getPromotionType() const { return static_cast<PieceType>(promotionType); }
+    
+    // Coordinate notation, e.g. "e2e4" or "e7e8q"
+    string getNotation() const {
+        string notation = getFrom().getNotation() + getTo().getNotation();
+        if (getIsPromotion()) notation += "prnbqk"[promotionType];
+        return notation;
+    }
+    
+    // From, to and promotion packed into 16 bits for the transposition table
+    uint16_t getCode() const {
+        return static_cast<uint16_t>(from | (to << 6) | (getIsPromotion() ? promotionType << 12 : 0));
+    }
+    
+    bool operator==(const Move& other) const {
+        return from == other.from && to == other.to && flags == other.flags &&
+               (!getIsPromotion() || promotionType == other.promotionType);
+    }
+};
+
+// MoveList class implementation
+// Fixed-capacity move buffer; no legal chess position has more than 218 moves.
+class MoveList {
+private:
+    Move moves[256];
+    int count;
+
+public:
+    MoveList() : count(0) {}
+    
+    void add(const Move& move) { moves[count++] = move; }
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Move& operator[](int index) const { return moves[index]; }
+    Move& operator[](int index) { return moves[index]; }
+    const Move* begin() const { return moves; }
+    const Move* end() const { return moves + count; }
+};
+
+// Board class implementation
+// One bitboard per color and piece type plus a square-indexed mailbox, so
+// both set queries and "what is on this square" are O(1). The board is a
+// plain value and copies without allocating.
+class Board {
+private:
+    static const int8_t EMPTY = -1;
+    
+    Bitboard pieces[2][6];
+    Bitboard occupancy[2];
+    int8_t squares[64];
+
+public:
+    Board() {
+        clear();
+    }
+    
+    bool hasPiece(int square) const { return squares[square] != EMPTY; }
+    
+    Piece getPieceAt(int square) const {
+        return Piece{static_cast<Color>(squares[square] / 6), static_cast<PieceType>(squares[square] % 6)};
+    }
+    
+    bool getPiece(const Position& pos, Piece& piece) const {
+        if (!pos.isValid() || !hasPiece(pos.getSquare())) return false;
+        piece = getPieceAt(pos.getSquare());
+        return true;
+    }
+    
+    void setPiece(int square, Color color, PieceType type) {
+        if (hasPiece(square)) removePiece(square);
+        pieces[static_cast<int>(color)][static_cast<int>(type)] |= squareBit(square);
+        occupancy[static_cast<int>(color)] |= squareBit(square);
+        squares[square] = static_cast<int8_t>(static_cast<int>(color) * 6 + static_cast<int>(type));
+    }
+    
+    void setPiece(const Position& pos, Color color, PieceType type) {
+        if (!pos.isValid()) return;
+        setPiece(pos.getSquare(), color, type);
+    }
+    
+    void removePiece(int square) {
+        if (!hasPiece(square)) return;
+        Piece piece = getPieceAt(square);
+        pieces[static_cast<int>(piece.color)][static_cast<int>(piece.type)] &= ~squareBit(square);
+        occupancy[static_cast<int>(piece.color)] &= ~squareBit(square);
+        squares[square] = EMPTY;
+    }
+    
+    void movePiece(int from, int to) {
+        if (!hasPiece(from)) return;
+        Piece piece = getPieceAt(from);
+        removePiece(from);
+        setPiece(to, piece.color, piece.type);
+    }
+    
+    void movePiece(const Position& from, const Position& to) {
+        if (!from.isValid() || !to.isValid()) return;
+        movePiece(from.getSquare(), to.getSquare());
+    }
+    
+    bool isPositionValid(const Position& pos) const {
+        return pos.isValid();
+    }
+    
+    Bitboard getPieces(Color color, PieceType type) const {
+        return pieces[static_cast<int>(color)][static_cast<int>(type)];
+    }
+    
+    Bitboard getOccupancy(Color color) const { return occupancy[static_cast<int>(color)]; }
+    Bitboard getOccupancy() const { return occupancy[0] | occupancy[1]; }
+    
+    int findKing(Color color) const {
+        Bitboard king = getPieces(color, PieceType::KING);
+        return king ? lowestSquare(king) : -1;
+    }
+    
+    // Pieces of the given color attacking the square, for the given occupancy
+    Bitboard attackersOf(int square, Color by, Bitboard occupied) const {
+        const AttackTables& tables = AttackTables::instance();
+        Bitboard queens = getPieces(by, PieceType::QUEEN);
+        return (tables.pawn(opposite(by), square) & getPieces(by, PieceType::PAWN)) |
+               (tables.knight(square) & getPieces(by, PieceType::KNIGHT)) |
+               (tables.king(square) & getPieces(by, PieceType::KING)) |
+               (tables.bishop(square, occupied) & (getPieces(by, PieceType::BISHOP) | queens)) |
+               (tables.rook(square, occupied) & (getPieces(by, PieceType::ROOK) | queens));
+    }
+    
+    bool isSquareAttacked(int square, Color by) const {
+        return attackersOf(square, by, getOccupancy()) != 0;
+    }
+    
+    // Every square the given color attacks, for the given occupancy
+    Bitboard attackMap(Color by, Bitboard occupied) const {
+        const AttackTables& tables = AttackTables::instance();
+        Bitboard attacked = 0;
+        
+        Bitboard pawns = getPieces(by, PieceType::PAWN);
+        while (pawns) attacked |= tables.pawn(by, popLowest(pawns));
+        Bitboard knights = getPieces(by, PieceType::KNIGHT);
+        while (knights) attacked |= tables.knight(popLowest(knights));
+        Bitboard diagonal = getPieces(by, PieceType::BISHOP) | getPieces(by, PieceType::QUEEN);
+        while (diagonal) attacked |= tables.bishop(popLowest(diagonal), occupied);
+        Bitboard straight = getPieces(by, PieceType::ROOK) | getPieces(by, PieceType::QUEEN);
+        while (straight) attacked |= tables.rook(popLowest(straight), occupied);
+        Bitboard king = getPieces(by, PieceType::KING);
+        if (king) attacked |= tables.king(lowestSquare(king));
+        
+        return attacked;
+    }
+    
+    void clear() {
+        for (auto& side : pieces) {
+            for (auto& bits : side) {
+                bits = 0;
+            }
+        }
+        occupancy[0] = occupancy[1] = 0;
+        for (auto& square : squares) {
+            square = EMPTY;
+        }
+    }
+};
+
+// TranspositionTable class implementation
+// Lock-free table shared by all search threads. Each slot stores its key
+// XORed with its data, so a slot torn by two threads writing at once fails
+// the key check on probe instead of returning another position's entry.
+class TranspositionTable {
+public:
+    enum Bound : uint8_t { NONE, EXACT, LOWER, UPPER };
+    
+    struct Entry {
+        uint16_t move;
+        int16_t score;
+        int8_t depth;
+        Bound bound;
+    };
+
+private:
+    struct Slot {
+        atomic<uint64_t> check;
+        atomic<uint64_t> data;
+    };
+    
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+    
+    static uint64_t pack(const Entry& entry) {
+        return static_cast<uint64_t>(entry.move) |
+               (static_cast<uint64_t>(static_cast<uint16_t>(entry.score)) << 16) |
+               (static_cast<uint64_t>(static_cast<uint8_t>(entry.depth)) << 32) |
+               (static_cast<uint64_t>(entry.bound) << 40);
+    }
+    
+    static Entry unpack(uint64_t data) {
+        return Entry{static_cast<uint16_t>(data), static_cast<int16_t>(data >> 16),
+                     static_cast<int8_t>(data >> 32), static_cast<Bound>((data >> 40) & 3)};
+    }
+
+public:
+    // 2^sizeBits slots of 16 bytes each
+    explicit TranspositionTable(int sizeBits = 20)
+        : slots(new Slot[size_t(1) << sizeBits]), mask((size_t(1) << sizeBits) - 1) {
+        clear();
+    }
+    
+    void clear() {
+        for (size_t i = 0; i <= mask; i++) {
+            slots[i].check.store(0, memory_order_relaxed);
+            slots[i].data.store(0, memory_order_relaxed);
+        }
+    }
+    
+    bool probe(uint64_t key, Entry& entry) const {
+        const Slot& slot = slots[key & mask];
+        uint64_t data = slot.data.load(memory_order_relaxed);
+        uint64_t check = slot.check.load(memory_order_relaxed);
+        if (data == 0 || (check ^ data) != key) return false;
+        entry = unpack(data);
+        return true;
+    }
+    
+    // A deeper exact entry for the same position is not overwritten by a
+    // shallower bound; everything else is always replaced
+    void store(uint64_t key, const Entry& entry) {
+        Slot& slot = slots[key & mask];
+        Entry existing;
+        if (probe(key, existing) && existing.depth > entry.depth &&
+            existing.bound == EXACT && entry.bound != EXACT) {
+            return;
+        }
+        uint64_t data = pack(entry);
+        slot.data.store(data, memory_order_relaxed);
+        slot.check.store(key ^ data, memory_order_relaxed);
+    }
+};
+
+// Budget for findBestMove; a zero time or node limit means unlimited
+struct SearchLimits {
+    int maxDepth = 64;
+    int64_t timeMs = 0;
+    uint64_t maxNodes = 0;
+    int threads = 1;
+};
+
+struct SearchResult {
+    string bestMove;   // coordinate notation, empty when there is no legal move
+    int score;         // centipawns from the side to move's point of view
+    int depth;         // deepest fully completed iteration
+    uint64_t nodes;
+};
+
+// GameState class implementation
+class GameState {
+private:
+    // Castling right bits, as in the FEN "KQkq" field
+    enum CastlingRight : uint8_t {
+        WHITE_KINGSIDE = 1,
+        WHITE_QUEENSIDE = 2,
+        BLACK_KINGSIDE = 4,
+        BLACK_QUEENSIDE = 8
+    };
+    
+    // State a move destroys and cannot be recomputed from the move itself,
+    // saved once per ply so the move can be unmade in place
+    struct UndoInfo {
+        Move move;
+        int8_t capturedType;
+        uint8_t castlingRights;
+        int8_t enPassantSquare;
+        int halfMoveClock;
+        uint64_t zobristKey;
+    };
+    
+    static const int MAX_PLY = 128;
+    static const int MATE_SCORE = 30000;
+    static const int INFINITE_SCORE = 32000;
+    
+    // Shared by every thread of one search
+    struct SearchShared {
+        TranspositionTable& table;
+        atomic<bool> stop;
+        atomic<uint64_t> nodes;
+        uint64_t maxNodes;
+        bool timed;
+        chrono::steady_clock::time_point deadline;
+        
+        SearchShared(TranspositionTable& table, const SearchLimits& limits)
+            : table(table), stop(false), nodes(0), maxNodes(limits.maxNodes), timed(limits.timeMs > 0),
+              deadline(chrono::steady_clock::now() + chrono::milliseconds(limits.timeMs)) {}
+    };
+    
+    // Per-thread search state
+    struct SearchContext {
+        SearchShared& shared;
+        uint64_t unreportedNodes;
+        Move killers[MAX_PLY][2];
+    };
+    
+    Board board;
+    Color currentPlayer;
+    vector<UndoInfo> moveHistory;
+    uint8_t castlingRights;
+    Position enPassantTarget;
+    int halfMoveClock;
+    int fullMoveNumber;
+    uint64_t zobristKey;
+    mutable InstrumentedMutex stateMutex{"chess.state_lock"};
+
+public:
+    GameState() : currentPlayer(Color::WHITE), castlingRights(0xF),
+                 halfMoveClock(0), fullMoveNumber(1) {
+        moveHistory.reserve(256);
+        initializeBoard();
+        zobristKey = computeZobristKey();
+    }
+    
+    // Starts from a FEN position; throws invalid_argument if it does not parse
+    explicit GameState(const string& fen) : GameState() {
+        loadFEN(fen);
+    }
+    
+    // Puts the state back to the starting position, keeping the move
+    // history's capacity so pooled states do not reallocate
+    void reset() {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        initializeBoard();
+        currentPlayer = Color::WHITE;
+        castlingRights = 0xF;
+        enPassantTarget = Position();
+        halfMoveClock = 0;
+        fullMoveNumber = 1;
+        moveHistory.clear();
+        zobristKey = computeZobristKey();
+    }
+    
+    // Same as reset() but from a FEN position; the state is unspecified if
+    // the FEN does not parse
+    void reset(const string& fen) {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        loadFEN(fen);
+    }
+    
+    bool makeMove(const Position& from, const Position& to) {
+        return makeMove(from, to, PieceType::QUEEN);
+    }
+    
+    // Coordinate notation as produced by Move::getNotation, e.g. "e7e8q"
+    bool makeMove(const string& notation) {
+        if (notation.length() != 4 && notation.length() != 5) return false;
+        
+        PieceType promotion = PieceType::QUEEN;
+        if (notation.length() == 5 && !getPieceType(notation[4], promotion)) {
+            return false;
+        }
+        return playMove(Position(notation.substr(0, 2)), Position(notation.substr(2, 2)), promotion,
+                        notation.length() == 5);
+    }
+    
+    bool makeMove(const Position& from, const Position& to, PieceType promotion) {
+        return playMove(from, to, promotion, false);
+    }
+    
+    bool isCheck(Color color) const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return inCheck(color);
+    }
+    
+    bool isCheckmate(Color color) const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        if (!inCheck(color)) return false;
+        
+        MoveList moves;
+        generateLegalMoves(color, moves);
+        return moves.empty();
+    }
+    
+    bool isStalemate(Color color) const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        if (inCheck(color)) return false;
+        
+        MoveList moves;
+        generateLegalMoves(color, moves);
+        return moves.empty();
+    }
+    
+    bool isDraw() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        // Check for insufficient material
+        if (isInsufficientMaterial()) return true;
+        
+        // Check for threefold repetition
+        if (isThreefoldRepetition()) return true;
+        
+        // Check for fifty-move rule
+        if (halfMoveClock >= 100) return true;
+        
+        return false;
+    }
+    
+    bool isRepetition() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return isThreefoldRepetition();
+    }
+    
+    vector<Position> getValidMoves(const Position& pos) const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        Piece piece;
+        if (!board.getPiece(pos, piece)) return {};
+        
+        MoveList moves;
+        generateLegalMoves(piece.color, moves);
+        
+        vector<Position> validMoves;
+        for (const Move& move : moves) {
+            // Promotions list each target square once
+            if (move.getFromSquare() == pos.getSquare() &&
+                (!move.getIsPromotion() || move.getPromotionType() == PieceType::QUEEN)) {
+                validMoves.push_back(move.getTo());
+            }
+        }
+        
+        return validMoves;
+    }
+    
+    void undoMove() {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        if (moveHistory.empty()) return;
+        
+        unmakeMove();
+    }
+    
+    GameStatus getStatus() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        bool check = inCheck(currentPlayer);
+        if (moves.empty()) return check ? GameStatus::CHECKMATE : GameStatus::STALEMATE;
+        if (isInsufficientMaterial() || isThreefoldRepetition() || halfMoveClock >= 100) {
+            return GameStatus::DRAW;
+        }
+        return check ? GameStatus::CHECK : GameStatus::ACTIVE;
+    }
+    
+    Color getCurrentPlayer() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return currentPlayer;
+    }
+    
+    uint64_t getZobristKey() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return zobristKey;
+    }
+    
+    // For export only; repetition detection uses Zobrist keys
+    string getFEN() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return getFENLocked();
+    }
+    
+    // Counts the leaf nodes of the legal move tree to the given depth
+    uint64_t perft(int depth) {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return perftLocked(depth);
+    }
+    
+    // Static evaluation in centipawns from the side to move's point of view
+    int evaluate() const {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        return evaluateLocked();
+    }
+    
+    // Iterative-deepening alpha-beta. Each thread searches its own copy of
+    // the position and they share work only through the transposition table
+    // (Lazy SMP), so the game itself is locked just long enough to copy it.
+    SearchResult findBestMove(const SearchLimits& limits) const {
+        static TranspositionTable sharedTable;
+        return findBestMove(limits, sharedTable);
+    }
+    
+    SearchResult findBestMove(const SearchLimits& limits, TranspositionTable& table) const {
+        static const int searchTime = Metrics::histogram("chess.search_ns");
+        static const int searchNodes = Metrics::counter("chess.search_nodes");
+        ScopedTimer timer(searchTime);
+        int threadCount = max(limits.threads, 1);
+        int maxDepth = min(max(limits.maxDepth, 1), MAX_PLY / 2);
+        
+        vector<unique_ptr<GameState>> workers;
+        {
+            lock_guard<InstrumentedMutex> lock(stateMutex);
+            for (int i = 0; i < threadCount; i++) {
+                workers.push_back(make_unique<GameState>());
+                workers.back()->copyPositionFrom(*this);
+            }
+        }
+        
+        SearchShared shared(table, limits);
+        SearchResult result = {"", 0, 0, 0};
+        vector<thread> helpers;
+        for (int i = 1; i < threadCount; i++) {
+            helpers.emplace_back([&workers, &shared, maxDepth, i] {
+                workers[i]->iterativeDeepening(shared, maxDepth, i, nullptr);
+            });
+        }
+        workers[0]->iterativeDeepening(shared, maxDepth, 0, &result);
+        
+        shared.stop.store(true);
+        for (auto& helper : helpers) {
+            helper.join();
+        }
+        result.nodes = shared.nodes.load();
+        Metrics::add(searchNodes, result.nodes);
+        return result;
+    }
+    
+    // Perft split by root move, for diffing against a reference engine
+    vector<pair<string, uint64_t>> perftDivide(int depth) {
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        vector<pair<string, uint64_t>> result;
+        if (depth < 1) return result;
+        
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        for (const Move& move : moves) {
+            doMove(move);
+            result.emplace_back(move.getNotation(), perftLocked(depth - 1));
+            unmakeMove();
+        }
+        return result;
+    }
+
+private:
+    void initializeBoard() {
+        const PieceType backRank[8] = {
+            PieceType::ROOK, PieceType::KNIGHT, PieceType::BISHOP, PieceType::QUEEN,
+            PieceType::KING, PieceType::BISHOP, PieceType::KNIGHT, PieceType::ROOK
+        };
+        
+        board.clear();
+        for (int col = 0; col < 8; col++) {
+            board.setPiece(Position(0, col), Color::BLACK, backRank[col]);
+            board.setPiece(Position(1, col), Color::BLACK, PieceType::PAWN);
+            board.setPiece(Position(6, col), Color::WHITE, PieceType::PAWN);
+            board.setPiece(Position(7, col), Color::WHITE, backRank[col]);
+        }
+    }
+    
+    void loadFEN(const string& fen) {
+        istringstream fields(fen);
+        string placement, side, castling, enPassant;
+        if (!(fields >> placement >> side >> castling >> enPassant)) {
+            throw invalid_argument("Invalid FEN: " + fen);
+        }
+        if (!(fields >> halfMoveClock)) halfMoveClock = 0;
+        if (!(fields >> fullMoveNumber)) fullMoveNumber = 1;
+        
+        // Piece placement, from rank 8 down
+        board.clear();
+        int row = 0, col = 0;
+        for (char c : placement) {
+            PieceType type;
+            if (c == '/') {
+                if (col != 8) throw invalid_argument("Invalid FEN rank: " + fen);
+                row++;
+                col = 0;
+            } else if (c >= '1' && c <= '8') {
+                col += c - '0';
+            } else if (getPieceType(c, type) && row < 8 && col < 8) {
+                board.setPiece(Position(row, col), isupper(c) ? Color::WHITE : Color::BLACK, type);
+                col++;
+            } else {
+                throw invalid_argument("Invalid FEN piece placement: " + fen);
+            }
+            if (col > 8) throw invalid_argument("Invalid FEN rank: " + fen);
+        }
+        if (row != 7 || col != 8) throw invalid_argument("Invalid FEN piece placement: " + fen);
+        if (countBits(board.getPieces(Color::WHITE, PieceType::KING)) != 1 ||
+            countBits(board.getPieces(Color::BLACK, PieceType::KING)) != 1) {
+            throw invalid_argument("FEN needs exactly one king per side: " + fen);
+        }
+        
+        // Squares 0-7 are rank 8 and 56-63 rank 1
+        const Bitboard backRanks = 0xFF000000000000FFull;
+        if ((board.getPieces(Color::WHITE, PieceType::PAWN) | board.getPieces(Color::BLACK, PieceType::PAWN)) & backRanks) {
+            throw invalid_argument("FEN has a pawn on a back rank: " + fen);
+        }
+        
+        if (side != "w" && side != "b") throw invalid_argument("Invalid FEN side to move: " + fen);
+        currentPlayer = (side == "w") ? Color::WHITE : Color::BLACK;
+        
+        castlingRights = 0;
+        if (castling != "-") {
+            for (char c : castling) {
+                switch (c) {
+                    case 'K': castlingRights |= WHITE_KINGSIDE; break;
+                    case 'Q': castlingRights |= WHITE_QUEENSIDE; break;
+                    case 'k': castlingRights |= BLACK_KINGSIDE; break;
+                    case 'q': castlingRights |= BLACK_QUEENSIDE; break;
+                    default: throw invalid_argument("Invalid FEN castling rights: " + fen);
+                }
+            }
+        }
+        
+        // Every right needs its king and rook still on their home squares
+        struct HomeSquares { uint8_t right; Color color; int kingSquare; int rookSquare; };
+        static const HomeSquares homes[] = {
+            {WHITE_KINGSIDE, Color::WHITE, 60, 63}, {WHITE_QUEENSIDE, Color::WHITE, 60, 56},
+            {BLACK_KINGSIDE, Color::BLACK, 4, 7}, {BLACK_QUEENSIDE, Color::BLACK, 4, 0}
+        };
+        for (const HomeSquares& home : homes) {
+            if (!(castlingRights & home.right)) continue;
+            if (!(board.getPieces(home.color, PieceType::KING) & squareBit(home.kingSquare)) ||
+                !(board.getPieces(home.color, PieceType::ROOK) & squareBit(home.rookSquare))) {
+                throw invalid_argument("FEN castling right without its king and rook: " + fen);
+            }
+        }
+        
+        enPassantTarget = Position();
+        if (enPassant != "-") {
+            enPassantTarget = Position(enPassant);
+            // The opponent just double-pushed past an empty square: rank 6
+            // (row 2) with White to move, rank 3 (row 5) with Black to move,
+            // and their pawn stands on the square beyond it
+            Color mover = (currentPlayer == Color::WHITE) ? Color::BLACK : Color::WHITE;
+            int targetRow = (currentPlayer == Color::WHITE) ? 2 : 5;
+            int pawnRow = (currentPlayer == Color::WHITE) ? 3 : 4;
+            if (!enPassantTarget.isValid() || enPassantTarget.getRow() != targetRow ||
+                board.hasPiece(enPassantTarget.getSquare()) ||
+                !(board.getPieces(mover, PieceType::PAWN) & squareBit(pawnRow * 8 + enPassantTarget.getCol()))) {
+                throw invalid_argument("Invalid FEN en passant square: " + fen);
+            }
+        }
+        
+        moveHistory.clear();
+        zobristKey = computeZobristKey();
+    }
+    
+    // Leaf counts at depth 1 come straight from the move list
+    uint64_t perftLocked(int depth) {
+        if (depth == 0) return 1;
+        
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        if (depth == 1) return moves.size();
+        
+        uint64_t nodes = 0;
+        for (const Move& move : moves) {
+            doMove(move);
+            nodes += perftLocked(depth - 1);
+            unmakeMove();
+        }
+        return nodes;
+    }
+    
+    void copyPositionFrom(const GameState& other) {
+        board = other.board;
+        currentPlayer = other.currentPlayer;
+        moveHistory = other.moveHistory;
+        castlingRights = other.castlingRights;
+        enPassantTarget = other.enPassantTarget;
+        halfMoveClock = other.halfMoveClock;
+        fullMoveNumber = other.fullMoveNumber;
+        zobristKey = other.zobristKey;
+    }
+    
+    // Only the main thread (threadId 0) reports a result
+    void iterativeDeepening(SearchShared& shared, int maxDepth, int threadId, SearchResult* result) {
+        SearchContext context = {shared, 0, {}};
+        
+        MoveList rootMoves;
+        generateLegalMoves(currentPlayer, rootMoves);
+        if (rootMoves.empty()) {
+            if (result) result->score = inCheck(currentPlayer) ? -MATE_SCORE : 0;
+            return;
+        }
+        if (result) result->bestMove = rootMoves[0].getNotation();
+        
+        // Odd helpers start a ply deeper so the threads spread over depths
+        for (int depth = 1 + (threadId & 1); depth <= maxDepth; depth++) {
+            Move bestMove;
+            int score = searchRoot(context, depth, rootMoves, bestMove);
+            if (shared.stop.load(memory_order_relaxed)) break;
+            
+            if (result) {
+                result->bestMove = bestMove.getNotation();
+                result->score = score;
+                result->depth = depth;
+            }
+            if (abs(score) >= MATE_SCORE - MAX_PLY) break;
+        }
+        flushNodes(context);
+    }
+    
+    int searchRoot(SearchContext& context, int depth, MoveList& moves, Move& bestMove) {
+        TranspositionTable::Entry entry;
+        uint16_t hashMove = context.shared.table.probe(zobristKey, entry) ? entry.move : 0;
+        orderMoves(context, moves, hashMove, 0);
+        
+        int alpha = -INFINITE_SCORE;
+        bestMove = moves[0];
+        for (const Move& move : moves) {
+            doMove(move);
+            int score = -alphaBeta(context, depth - 1, -INFINITE_SCORE, -alpha, 1);
+            unmakeMove();
+            if (context.shared.stop.load(memory_order_relaxed)) return alpha;
+            
+            if (score > alpha) {
+                alpha = score;
+                bestMove = move;
+            }
+        }
+        storeEntry(context, depth, alpha, TranspositionTable::EXACT, bestMove, 0);
+        return alpha;
+    }
+    
+    int alphaBeta(SearchContext& context, int depth, int alpha, int beta, int ply) {
+        if (isSearchDraw()) return 0;
+        
+        bool check = inCheck(currentPlayer);
+        if (check) depth++;
+        if (depth <= 0 || ply >= MAX_PLY - 1) return quiescence(context, alpha, beta, ply);
+        if (!countNode(context)) return 0;
+        
+        TranspositionTable::Entry entry;
+        uint16_t hashMove = 0;
+        if (context.shared.table.probe(zobristKey, entry)) {
+            hashMove = entry.move;
+            int score = fromTableScore(entry.score, ply);
+            if (entry.depth >= depth &&
+                (entry.bound == TranspositionTable::EXACT ||
+                 (entry.bound == TranspositionTable::LOWER && score >= beta) ||
+                 (entry.bound == TranspositionTable::UPPER && score <= alpha))) {
+                return score;
+            }
+        }
+        
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        if (moves.empty()) return check ? -MATE_SCORE + ply : 0;
+        orderMoves(context, moves, hashMove, ply);
+        
+        int originalAlpha = alpha;
+        int best = -INFINITE_SCORE;
+        Move bestMove = moves[0];
+        for (const Move& move : moves) {
+            doMove(move);
+            int score = -alphaBeta(context, depth - 1, -beta, -alpha, ply + 1);
+            unmakeMove();
+            if (context.shared.stop.load(memory_order_relaxed)) return 0;
+            
+            if (score > best) {
+                best = score;
+                bestMove = move;
+            }
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) {
+                if (!move.getIsCapture() && !move.getIsPromotion()) rememberKiller(context, move, ply);
+                break;
+            }
+        }
+        
+        TranspositionTable::Bound bound = best <= originalAlpha ? TranspositionTable::UPPER
+                                        : best >= beta ? TranspositionTable::LOWER
+                                        : TranspositionTable::EXACT;
+        storeEntry(context, depth, best, bound, bestMove, ply);
+        return best;
+    }
+    
+    // Captures and promotions only, so the static evaluation is never taken
+    // in the middle of an exchange; in check every evasion is searched
+    int quiescence(SearchContext& context, int alpha, int beta, int ply) {
+        if (!countNode(context)) return 0;
+        
+        bool check = inCheck(currentPlayer);
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        if (moves.empty()) return check ? -MATE_SCORE + ply : 0;
+        if (ply >= MAX_PLY - 1) return evaluateLocked();
+        
+        int best = -MATE_SCORE + ply;
+        if (!check) {
+            best = evaluateLocked();
+            if (best >= beta) return best;
+            if (best > alpha) alpha = best;
+        }
+        
+        orderMoves(context, moves, 0, ply);
+        for (const Move& move : moves) {
+            if (!check && !move.getIsCapture() && !move.getIsPromotion()) continue;
+            
+            doMove(move);
+            int score = -quiescence(context, -beta, -alpha, ply + 1);
+            unmakeMove();
+            if (context.shared.stop.load(memory_order_relaxed)) return 0;
+            
+            if (score > best) best = score;
+            if (score > alpha) alpha = score;
+            if (alpha >= beta) break;
+        }
+        return best;
+    }
+    
+    // Hash move first, then captures by most valuable victim and least
+    // valuable attacker, promotions, killer moves and finally quiet moves
+    void orderMoves(const SearchContext& context, MoveList& moves, uint16_t hashMove, int ply) const {
+        int scores[256];
+        for (int i = 0; i < moves.size(); i++) {
+            const Move& move = moves[i];
+            if (move.getCode() == hashMove) {
+                scores[i] = 1000000;
+            } else if (move.getIsCapture()) {
+                PieceType victim = move.getIsEnPassant() ? PieceType::PAWN : board.getPieceAt(move.getToSquare()).type;
+                PieceType attacker = board.getPieceAt(move.getFromSquare()).type;
+                scores[i] = 100000 + 10 * pieceValue(victim) - pieceValue(attacker) / 10;
+            } else if (move.getIsPromotion()) {
+                scores[i] = 90000 + pieceValue(move.getPromotionType());
+            } else if (move == context.killers[ply][0]) {
+                scores[i] = 80000;
+            } else if (move == context.killers[ply][1]) {
+                scores[i] = 70000;
+            } else {
+                scores[i] = 0;
+            }
+        }
+        
+        // Insertion sort; move lists are short and mostly need few swaps
+        for (int i = 1; i < moves.size(); i++) {
+            Move move = moves[i];
+            int score = scores[i];
+            int j = i - 1;
+            for (; j >= 0 && scores[j] < score; j--) {
+                moves[j + 1] = moves[j];
+                scores[j + 1] = scores[j];
+            }
+            moves[j + 1] = move;
+            scores[j + 1] = score;
+        }
+    }
     
-    string getNotation() const {
-        string notation;
-        notation += 'a' + col;
-        notation += '0' + (8 - row);
-        return notation;
+    static void rememberKiller(SearchContext& context, const Move& move, int ply) {
+        if (move == context.killers[ply][0]) return;
+        context.killers[ply][1] = context.killers[ply][0];
+        context.killers[ply][0] = move;
     }
     
-    bool isValid() const {
-        return row >= 0 && row < 8 && col >= 0 && col < 8;
+    // Mate scores are stored relative to the node so they stay valid when
+    // the same position is reached at another ply
+    void storeEntry(SearchContext& context, int depth, int score, TranspositionTable::Bound bound,
+                    const Move& move, int ply) const {
+        if (score > MATE_SCORE - MAX_PLY) score += ply;
+        else if (score < -MATE_SCORE + MAX_PLY) score -= ply;
+        context.shared.table.store(zobristKey, TranspositionTable::Entry{
+            move.getCode(), static_cast<int16_t>(score), static_cast<int8_t>(depth), bound});
     }
     
-    bool operator==(const Position& other) const {
-        return row == other.row && col == other.col;
+    static int fromTableScore(int score, int ply) {
+        if (score > MATE_SCORE - MAX_PLY) return score - ply;
+        if (score < -MATE_SCORE + MAX_PLY) return score + ply;
+        return score;
     }
-};
-
-// Move class implementation
-class Move {
-private:
-    Position from;
-    Position to;
-    Piece* piece;
-    Piece* capturedPiece;
-    bool isCastling;
-    bool isEnPassant;
-    bool isPromotion;
-    PieceType promotionType;
-
-public:
-    Move(const Position& from, const Position& to, Piece* piece)
-        : from(from), to(to), piece(piece), capturedPiece(nullptr),
-          isCastling(false), isEnPassant(false), isPromotion(false) {}
-    
-    void setCapturedPiece(Piece* piece) { capturedPiece = piece; }
-    void setCastling(bool value) { isCastling = value; }
-    void setEnPassant(bool value) { isEnPassant = value; }
-    void setPromotion(bool value, PieceType type) {
-        isPromotion = value;
-        promotionType = type;
-    }
-    
-    Position getFrom() const { return from; }
-    Position getTo() const { return to; }
-    Piece* getPiece() const { return piece; }
-    Piece* getCapturedPiece() const { return capturedPiece; }
-    bool getIsCastling() const { return isCastling; }
-    bool getIsEnPassant() const { return isEnPassant; }
-    bool getIsPromotion() const { return isPromotion; }
-    PieceType getPromotionType() const { return promotionType; }
-};
-
-// Board class implementation
-class Board {
-private:
-    vector<vector<unique_ptr<Piece>>> squares;
-    mutex boardMutex;
-
-public:
-    Board() {
-        squares.resize(8, vector<unique_ptr<Piece>>(8));
+    
+    // A promotion piece given for a move that does not promote is refused
+    bool playMove(const Position& from, const Position& to, PieceType promotion, bool promotionGiven) {
+        static const int moveTime = Metrics::histogram("chess.make_move_ns");
+        static const int movesScanned = Metrics::counter("chess.legal_moves_scanned");
+        ScopedTimer timer(moveTime);
+        lock_guard<InstrumentedMutex> lock(stateMutex);
+        
+        if (!from.isValid() || !to.isValid()) return false;
+        
+        Piece piece;
+        if (!board.getPiece(from, piece) || piece.color != currentPlayer) {
+            return false;
+        }
+        
+        // Find the matching legal move
+        MoveList moves;
+        generateLegalMoves(currentPlayer, moves);
+        Metrics::add(movesScanned, moves.size());
+        for (const Move& move : moves) {
+            if (move.getFromSquare() == from.getSquare() && move.getToSquare() == to.getSquare() &&
+                (move.getIsPromotion() ? move.getPromotionType() == promotion : !promotionGiven)) {
+                doMove(move);
+                return true;
+            }
+        }
+        
+        return false;
     }
     
-    Piece* getPiece(const Position& pos) const {
-        if (!pos.isValid()) return nullptr;
-        return squares[pos.getRow()][pos.getCol()].get();
+    // Counts a node and polls the budget every 1024 nodes; returns false
+    // once the search has to stop
+    bool countNode(SearchContext& context) {
+        if (++context.unreportedNodes >= 1024) flushNodes(context);
+        return !context.shared.stop.load(memory_order_relaxed);
     }
     
-    void setPiece(const Position& pos, unique_ptr<Piece> piece) {
-        if (!pos.isValid()) return;
-        squares[pos.getRow()][pos.getCol()] = move(piece);
+    static void flushNodes(SearchContext& context) {
+        SearchShared& shared = context.shared;
+        uint64_t total = shared.nodes.fetch_add(context.unreportedNodes) + context.unreportedNodes;
+        context.unreportedNodes = 0;
+        if ((shared.maxNodes && total >= shared.maxNodes) ||
+            (shared.timed && chrono::steady_clock::now() >= shared.deadline)) {
+            shared.stop.store(true);
+        }
     }
     
-    void movePiece(const Position& from, const Position& to) {
-        if (!from.isValid() || !to.isValid()) return;
-        squares[to.getRow()][to.getCol()] = move(squares[from.getRow()][from.getCol()]);
+    // Inside the search a single repetition is already a draw
+    bool isSearchDraw() const {
+        return halfMoveClock >= 100 || isInsufficientMaterial() || hasRepeated(1);
     }
     
-    bool isPositionValid(const Position& pos) const {
-        return pos.isValid();
+    static int pieceValue(PieceType type) {
+        static const int values[6] = {100, 500, 320, 330, 900, 0};
+        return values[static_cast<int>(type)];
     }
     
-    void clear() {
-        for (auto& row : squares) {
-            for (auto& piece : row) {
-                piece.reset();
+    // Material plus small bonuses for advanced pawns and central minor pieces
+    int evaluateLocked() const {
+        int score = 0;
+        for (Color color : {Color::WHITE, Color::BLACK}) {
+            int sign = (color == currentPlayer) ? 1 : -1;
+            for (PieceType type : {PieceType::PAWN, PieceType::ROOK, PieceType::KNIGHT,
+                                   PieceType::BISHOP, PieceType::QUEEN}) {
+                Bitboard bits = board.getPieces(color, type);
+                while (bits) {
+                    int square = popLowest(bits);
+                    int row = square / 8, col = square % 8;
+                    int value = pieceValue(type);
+                    if (type == PieceType::PAWN) {
+                        value += 5 * (color == Color::WHITE ? 6 - row : row - 1);
+                    } else if (type == PieceType::KNIGHT || type == PieceType::BISHOP) {
+                        value += 10 * (3 - max(abs(2 * row - 7), abs(2 * col - 7)) / 2);
+                    }
+                    score += sign * value;
+                }
             }
         }
+        return score;
     }
-};
-
-// Piece class implementation
-class Piece {
-protected:
-    Color color;
-    Position position;
-    bool hasMoved;
-
-public:
-    Piece(Color color, const Position& position)
-        : color(color), position(position), hasMoved(false) {}
     
-    virtual ~Piece() = default;
+    bool inCheck(Color color) const {
+        int king = board.findKing(color);
+        return king >= 0 && board.isSquareAttacked(king, opposite(color));
+    }
     
-    Color getColor() const { return color; }
-    Position getPosition() const { return position; }
-    void setPosition(const Position& pos) { position = pos; }
-    bool getHasMoved() const { return hasMoved; }
-    void setHasMoved(bool moved) { hasMoved = moved; }
+    void addPawnMoves(int from, int to, uint8_t flags, MoveList& moves) const {
+        // Reaching the last row promotes
+        if (to / 8 == 0 || to / 8 == 7) {
+            for (PieceType type : {PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT}) {
+                moves.add(Move(from, to, flags | Move::PROMOTION, type));
+            }
+        } else {
+            moves.add(Move(from, to, flags));
+        }
+    }
     
-    virtual vector<Position> getValidMoves(const Board& board) const = 0;
-    virtual bool canMoveTo(const Position& pos, const Board& board) const = 0;
-    virtual PieceType getType() const = 0;
-};
-
-// Pawn class implementation
-class Pawn : public Piece {
-public:
-    Pawn(Color color, const Position& position) : Piece(color, position) {}
+    void addTargets(int from, Bitboard targets, Bitboard enemies, MoveList& moves) const {
+        while (targets) {
+            int to = popLowest(targets);
+            moves.add(Move(from, to, (enemies & squareBit(to)) ? Move::CAPTURE : Move::QUIET));
+        }
+    }
     
-    vector<Position> getValidMoves(const Board& board) const override {
-        vector<Position> moves;
-        int direction = (color == Color::WHITE) ? -1 : 1;
+    // Legal moves in a single pass. Checkers and pinned pieces are found
+    // once from the king's square; every other piece is then limited to
+    // squares that block or capture a single checker and, if pinned, to the
+    // line through the king. The king avoids the enemy attack map computed
+    // with the king itself removed, so sliders see through it.
+    void generateLegalMoves(Color color, MoveList& moves) const {
+        const AttackTables& tables = AttackTables::instance();
+        Color enemy = opposite(color);
+        Bitboard own = board.getOccupancy(color);
+        Bitboard enemies = board.getOccupancy(enemy);
+        Bitboard occupied = own | enemies;
         
-        // Forward move
-        Position forward(position.getRow() + direction, position.getCol());
-        if (forward.isValid() && !board.getPiece(forward)) {
-            moves.push_back(forward);
+        int king = board.findKing(color);
+        Bitboard checkers = 0;
+        Bitboard checkMask = ~0ULL;
+        Bitboard pinned = 0;
+        if (king >= 0) {
+            checkers = board.attackersOf(king, enemy, occupied);
+            if (checkers) {
+                int checker = lowestSquare(checkers);
+                checkMask = tables.between(king, checker) | checkers;
+            }
             
-            // Double move from starting position
-            if (!hasMoved) {
-                Position doubleForward(position.getRow() + 2 * direction, position.getCol());
-                if (!board.getPiece(doubleForward)) {
-                    moves.push_back(doubleForward);
-                }
+            // An enemy slider on the king's line with exactly one of our
+            // pieces in between pins that piece
+            Bitboard queens = board.getPieces(enemy, PieceType::QUEEN);
+            Bitboard snipers = (tables.rook(king, 0) & (board.getPieces(enemy, PieceType::ROOK) | queens)) |
+                               (tables.bishop(king, 0) & (board.getPieces(enemy, PieceType::BISHOP) | queens));
+            while (snipers) {
+                Bitboard blockers = tables.between(king, popLowest(snipers)) & occupied;
+                if (countBits(blockers) == 1) pinned |= blockers & own;
             }
+            
+            Bitboard danger = board.attackMap(enemy, occupied & ~squareBit(king));
+            addTargets(king, tables.king(king) & ~own & ~danger, enemies, moves);
+            
+            // Double check: only the king can move
+            if (countBits(checkers) > 1) return;
+            
+            if (!checkers) addCastlingMoves(color, king, occupied, danger, moves);
         }
         
-        // Captures
-        vector<Position> captures = {
-            Position(position.getRow() + direction, position.getCol() - 1),
-            Position(position.getRow() + direction, position.getCol() + 1)
+        // Squares a piece on the given square may move to
+        auto allowed = [&](int from) {
+            return (pinned & squareBit(from)) ? checkMask & tables.line(king, from) : checkMask;
         };
         
-        for (const auto& capture : captures) {
-            if (capture.isValid()) {
-                Piece* target = board.getPiece(capture);
-                if (target && target->getColor() != color) {
-                    moves.push_back(capture);
+        // Pawns
+        int forward = (color == Color::WHITE) ? -8 : 8;
+        int startRow = (color == Color::WHITE) ? 6 : 1;
+        Bitboard pawns = board.getPieces(color, PieceType::PAWN);
+        while (pawns) {
+            int from = popLowest(pawns);
+            Bitboard mask = allowed(from);
+            int to = from + forward;
+            if (!(occupied & squareBit(to))) {
+                if (mask & squareBit(to)) addPawnMoves(from, to, Move::QUIET, moves);
+                if (from / 8 == startRow && !(occupied & squareBit(to + forward)) && (mask & squareBit(to + forward))) {
+                    moves.add(Move(from, to + forward, Move::DOUBLE_PUSH));
                 }
             }
+            
+            Bitboard captures = tables.pawn(color, from) & enemies & mask;
+            while (captures) {
+                addPawnMoves(from, popLowest(captures), Move::CAPTURE, moves);
+            }
+            
+            if (color == currentPlayer && enPassantTarget.isValid() &&
+                (tables.pawn(color, from) & squareBit(enPassantTarget.getSquare()))) {
+                addEnPassantMove(color, from, king, occupied, moves);
+            }
         }
         
-        return moves;
+        // Knights, bishops, rooks and queens
+        Bitboard knights = board.getPieces(color, PieceType::KNIGHT) & ~pinned;
+        while (knights) {
+            int from = popLowest(knights);
+            addTargets(from, tables.knight(from) & ~own & allowed(from), enemies, moves);
+        }
+        Bitboard bishops = board.getPieces(color, PieceType::BISHOP);
+        while (bishops) {
+            int from = popLowest(bishops);
+            addTargets(from, tables.bishop(from, occupied) & ~own & allowed(from), enemies, moves);
+        }
+        Bitboard rooks = board.getPieces(color, PieceType::ROOK);
+        while (rooks) {
+            int from = popLowest(rooks);
+            addTargets(from, tables.rook(from, occupied) & ~own & allowed(from), enemies, moves);
+        }
+        Bitboard queens = board.getPieces(color, PieceType::QUEEN);
+        while (queens) {
+            int from = popLowest(queens);
+            addTargets(from, tables.queen(from, occupied) & ~own & allowed(from), enemies, moves);
+        }
     }
     
-    bool canMoveTo(const Position& pos, const Board& board) const override {
-        vector<Position> validMoves = getValidMoves(board);
-        return find(validMoves.begin(), validMoves.end(), pos) != validMoves.end();
+    // Castling: rights intact, squares between empty, and the king neither
+    // in check nor passing through an attacked square
+    void addCastlingMoves(Color color, int king, Bitboard occupied, Bitboard danger, MoveList& moves) const {
+        uint8_t kingside = (color == Color::WHITE) ? WHITE_KINGSIDE : BLACK_KINGSIDE;
+        uint8_t queenside = (color == Color::WHITE) ? WHITE_QUEENSIDE : BLACK_QUEENSIDE;
+        int home = (color == Color::WHITE) ? 60 : 4;
+        if (king != home) return;
+        
+        if ((castlingRights & kingside) &&
+            !((occupied | danger) & (squareBit(home + 1) | squareBit(home + 2)))) {
+            moves.add(Move(home, home + 2, Move::CASTLING));
+        }
+        if ((castlingRights & queenside) &&
+            !(occupied & (squareBit(home - 1) | squareBit(home - 2) | squareBit(home - 3))) &&
+            !(danger & (squareBit(home - 1) | squareBit(home - 2)))) {
+            moves.add(Move(home, home - 2, Move::CASTLING));
+        }
     }
     
-    PieceType getType() const override { return PieceType::PAWN; }
-};
-
-// Similar implementations for other pieces...
-
-// GameState class implementation
-class GameState {
-private:
-    Board board;
-    Color currentPlayer;
-    vector<Move> moveHistory;
-    bool whiteKingMoved;
-    bool blackKingMoved;
-    bool whiteRookMoved[2];
-    bool blackRookMoved[2];
-    Position enPassantTarget;
-    int halfMoveClock;
-    int fullMoveNumber;
-    unordered_map<string, int> positionHistory;
-    mutex stateMutex;
-
-public:
-    GameState() : currentPlayer(Color::WHITE), whiteKingMoved(false),
-                 blackKingMoved(false), halfMoveClock(0), fullMoveNumber(1) {
-        initializeBoard();
+    // En passant removes two pawns from one line at once, which the pin
+    // masks cannot see, so test the resulting occupancy directly
+    void addEnPassantMove(Color color, int from, int king, Bitboard occupied, MoveList& moves) const {
+        int to = enPassantTarget.getSquare();
+        int captured = color == Color::WHITE ? to + 8 : to - 8;
+        if (king >= 0) {
+            Bitboard after = (occupied & ~squareBit(from) & ~squareBit(captured)) | squareBit(to);
+            if (board.attackersOf(king, opposite(color), after) & ~squareBit(captured)) return;
+        }
+        moves.add(Move(from, to, Move::CAPTURE | Move::EN_PASSANT));
     }
     
-    bool makeMove(const Position& from, const Position& to) {
-        lock_guard<mutex> lock(stateMutex);
+    void doMove(const Move& move) {
+        int from = move.getFromSquare();
+        int to = move.getToSquare();
+        Piece piece = board.getPieceAt(from);
         
-        Piece* piece = board.getPiece(from);
-        if (!piece || piece->getColor() != currentPlayer) {
-            return false;
-        }
+        UndoInfo undo{move, -1, castlingRights,
+                      static_cast<int8_t>(enPassantTarget.isValid() ? enPassantTarget.getSquare() : -1),
+                      halfMoveClock, zobristKey};
+        const ZobristKeys& keys = ZobristKeys::instance();
+        zobristKey ^= enPassantKey() ^ keys.castling(castlingRights);
         
-        if (!piece->canMoveTo(to, board)) {
-            return false;
+        // Store captured piece
+        if (move.getIsEnPassant()) {
+            int square = enPassantCaptureSquare(move, piece.color);
+            undo.capturedType = static_cast<int8_t>(PieceType::PAWN);
+            board.removePiece(square);
+            zobristKey ^= keys.piece(opposite(piece.color), PieceType::PAWN, square);
+        } else if (board.hasPiece(to)) {
+            undo.capturedType = static_cast<int8_t>(board.getPieceAt(to).type);
+            zobristKey ^= keys.piece(opposite(piece.color), board.getPieceAt(to).type, to);
         }
         
-        // Create move
-        Move move(from, to, piece);
-        
-        // Handle special cases
-        if (piece->getType() == PieceType::KING) {
-            handleCastling(move);
-        } else if (piece->getType() == PieceType::PAWN) {
-            handleEnPassant(move);
-            handlePromotion(move);
+        // Move piece
+        PieceType placed = move.getIsPromotion() ? move.getPromotionType() : piece.type;
+        board.movePiece(from, to);
+        if (move.getIsPromotion()) {
+            board.setPiece(to, piece.color, placed);
+        }
+        zobristKey ^= keys.piece(piece.color, piece.type, from) ^ keys.piece(piece.color, placed, to);
+        if (move.getIsCastling()) {
+            board.movePiece(castlingRookFrom(move), castlingRookTo(move));
+            zobristKey ^= keys.piece(piece.color, PieceType::ROOK, castlingRookFrom(move)) ^
+                          keys.piece(piece.color, PieceType::ROOK, castlingRookTo(move));
         }
         
-        // Execute move
-        executeMove(move);
+        // Moving the king or a rook, or capturing a rook on its home
+        // square, loses the matching castling rights
+        castlingRights &= castlingMask(from) & castlingMask(to);
         
-        // Update game state
-        updateGameState();
+        enPassantTarget = move.getIsDoublePush() ? Position::fromSquare((from + to) / 2) : Position();
+        halfMoveClock = (piece.type == PieceType::PAWN || move.getIsCapture()) ? 0 : halfMoveClock + 1;
+        if (currentPlayer == Color::BLACK) fullMoveNumber++;
         
-        return true;
+        // Update move history
+        moveHistory.push_back(undo);
+        
+        // Switch player
+        currentPlayer = opposite(currentPlayer);
+        zobristKey ^= keys.side() ^ keys.castling(castlingRights) ^ enPassantKey();
     }
     
-    bool isCheck(Color color) const {
-        // Find king
-        Position kingPos;
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                Piece* piece = board.getPiece(Position(row, col));
-                if (piece && piece->getType() == PieceType::KING && 
-                    piece->getColor() == color) {
-                    kingPos = Position(row, col);
-                    break;
-                }
-            }
-        }
+    void unmakeMove() {
+        const UndoInfo& undo = moveHistory.back();
+        const Move& move = undo.move;
+        int from = move.getFromSquare();
+        int to = move.getToSquare();
+        Piece piece = board.getPieceAt(to);
         
-        // Check if any opponent piece can capture the king
-        Color opponentColor = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                Piece* piece = board.getPiece(Position(row, col));
-                if (piece && piece->getColor() == opponentColor) {
-                    if (piece->canMoveTo(kingPos, board)) {
-                        return true;
-                    }
-                }
-            }
+        currentPlayer = opposite(currentPlayer);
+        if (currentPlayer == Color::BLACK) fullMoveNumber--;
+        
+        // Put the pieces back
+        if (move.getIsCastling()) {
+            board.movePiece(castlingRookTo(move), castlingRookFrom(move));
+        }
+        if (move.getIsPromotion()) {
+            board.setPiece(to, piece.color, PieceType::PAWN);
+        }
+        board.movePiece(to, from);
+        if (undo.capturedType >= 0) {
+            int square = move.getIsEnPassant() ? enPassantCaptureSquare(move, piece.color) : to;
+            board.setPiece(square, opposite(piece.color), static_cast<PieceType>(undo.capturedType));
         }
         
-        return false;
+        // Restore the irreversible state
+        castlingRights = undo.castlingRights;
+        enPassantTarget = undo.enPassantSquare >= 0 ? Position::fromSquare(undo.enPassantSquare) : Position();
+        halfMoveClock = undo.halfMoveClock;
+        zobristKey = undo.zobristKey;
+        moveHistory.pop_back();
     }
     
-    bool isCheckmate(Color color) const {
-        if (!isCheck(color)) return false;
-        
-        // Try all possible moves for all pieces
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                Piece* piece = board.getPiece(Position(row, col));
-                if (piece && piece->getColor() == color) {
-                    vector<Position> moves = piece->getValidMoves(board);
-                    for (const auto& move : moves) {
-                        // Try move
-                        Board tempBoard = board;
-                        tempBoard.movePiece(piece->getPosition(), move);
-                        
-                        // Check if still in check
-                        if (!isCheck(color)) {
-                            return false;
-                        }
-                    }
-                }
-            }
+    static int enPassantCaptureSquare(const Move& move, Color mover) {
+        return mover == Color::WHITE ? move.getToSquare() + 8 : move.getToSquare() - 8;
+    }
+    
+    // Kingside rook jumps from h to f, queenside from a to d
+    static int castlingRookFrom(const Move& move) {
+        return move.getToSquare() > move.getFromSquare() ? move.getToSquare() + 1 : move.getToSquare() - 2;
+    }
+    
+    static int castlingRookTo(const Move& move) {
+        return move.getToSquare() > move.getFromSquare() ? move.getToSquare() - 1 : move.getToSquare() + 1;
+    }
+    
+    static uint8_t castlingMask(int square) {
+        switch (square) {
+            case 0: return static_cast<uint8_t>(~BLACK_QUEENSIDE);
+            case 4: return static_cast<uint8_t>(~(BLACK_KINGSIDE | BLACK_QUEENSIDE));
+            case 7: return static_cast<uint8_t>(~BLACK_KINGSIDE);
+            case 56: return static_cast<uint8_t>(~WHITE_QUEENSIDE);
+            case 60: return static_cast<uint8_t>(~(WHITE_KINGSIDE | WHITE_QUEENSIDE));
+            case 63: return static_cast<uint8_t>(~WHITE_KINGSIDE);
+            default: return 0xF;
         }
-        
-        return true;
     }
     
-    bool isStalemate(Color color) const {
-        if (isCheck(color)) return false;
+    // The en passant file only counts when the side to move can actually
+    // capture there, so otherwise identical positions share a key
+    uint64_t enPassantKey() const {
+        if (!enPassantTarget.isValid()) return 0;
+        Bitboard capturers = AttackTables::instance().pawn(opposite(currentPlayer), enPassantTarget.getSquare()) &
+                             board.getPieces(currentPlayer, PieceType::PAWN);
+        return capturers ? ZobristKeys::instance().enPassant(enPassantTarget.getCol()) : 0;
+    }
+    
+    uint64_t computeZobristKey() const {
+        const ZobristKeys& keys = ZobristKeys::instance();
+        uint64_t key = keys.castling(castlingRights) ^ enPassantKey();
+        if (currentPlayer == Color::BLACK) key ^= keys.side();
         
-        // Check if any legal moves exist
-        for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                Piece* piece = board.getPiece(Position(row, col));
-                if (piece && piece->getColor() == color) {
-                    vector<Position> moves = piece->getValidMoves(board);
-                    if (!moves.empty()) {
-                        return false;
-                    }
-                }
-            }
+        Bitboard occupied = board.getOccupancy();
+        while (occupied) {
+            int square = popLowest(occupied);
+            Piece piece = board.getPieceAt(square);
+            key ^= keys.piece(piece.color, piece.type, square);
         }
-        
-        return true;
+        return key;
     }
     
-    bool isDraw() const {
-        // Check for insufficient material
-        if (isInsufficientMaterial()) return true;
-        
-        // Check for threefold repetition
-        if (isThreefoldRepetition()) return true;
-        
-        // Check for fifty-move rule
-        if (halfMoveClock >= 50) return true;
+    bool isInsufficientMaterial() const {
+        // Only kings, or kings plus a single bishop or knight
+        Bitboard heavy = 0;
+        for (Color color : {Color::WHITE, Color::BLACK}) {
+            heavy |= board.getPieces(color, PieceType::PAWN) | board.getPieces(color, PieceType::ROOK) |
+                     board.getPieces(color, PieceType::QUEEN);
+        }
+        if (heavy) return false;
         
-        return false;
+        Bitboard minors = 0;
+        for (Color color : {Color::WHITE, Color::BLACK}) {
+            minors |= board.getPieces(color, PieceType::BISHOP) | board.getPieces(color, PieceType::KNIGHT);
+        }
+        return countBits(minors) <= 1;
     }
     
-    vector<Position> getValidMoves(const Position& pos) const {
-        Piece* piece = board.getPiece(pos);
-        if (!piece) return {};
-        
-        vector<Position> moves = piece->getValidMoves(board);
-        vector<Position> validMoves;
-        
-        for (const auto& move : moves) {
-            // Try move
-            Board tempBoard = board;
-            tempBoard.movePiece(pos, move);
-            
-            // Check if move is legal
-            if (!isCheck(piece->getColor())) {
-                validMoves.push_back(move);
+    // Only positions since the last capture or pawn move can repeat, and
+    // only those with the same side to move, so look back every other ply
+    // up to the halfmove clock
+    bool hasRepeated(int times) const {
+        int plies = min(halfMoveClock, static_cast<int>(moveHistory.size()));
+        int repetitions = 0;
+        for (int back = 2; back <= plies; back += 2) {
+            if (moveHistory[moveHistory.size() - back].zobristKey == zobristKey && ++repetitions >= times) {
+                return true;
             }
         }
-        
-        return validMoves;
+        return false;
     }
     
-    void undoMove() {
-        if (moveHistory.empty()) return;
-        
-        Move lastMove = moveHistory.back();
-        moveHistory.pop_back();
-        
-        // Restore board state
-        board.movePiece(lastMove.getTo(), lastMove.getFrom());
-        if (lastMove.getCapturedPiece()) {
-            board.setPiece(lastMove.getTo(), 
-                         unique_ptr<Piece>(lastMove.getCapturedPiece()));
-        }
-        
-        // Restore piece state
-        lastMove.getPiece()->setHasMoved(!lastMove.getPiece()->getHasMoved());
-        
-        // Switch player
-        currentPlayer = (currentPlayer == Color::WHITE) ? Color::BLACK : Color::WHITE;
+    bool isThreefoldRepetition() const {
+        return hasRepeated(2);
     }
     
-    string getFEN() const {
-        // Implementation of FEN string generation
-        // This is a simplified version
+    string getFENLocked() const {
         string fen;
         
         // Board position
         for (int row = 0; row < 8; row++) {
             int emptyCount = 0;
             for (int col = 0; col < 8; col++) {
-                Piece* piece = board.getPiece(Position(row, col));
-                if (piece) {
+                Piece piece;
+                if (board.getPiece(Position(row, col), piece)) {
                     if (emptyCount > 0) {
                         fen += to_string(emptyCount);
                         emptyCount = 0;
@@ -434,106 +1680,241 @@ public:
         
         return fen;
     }
-
-private:
-    void initializeBoard() {
-        // Initialize pawns
-        for (int col = 0; col < 8; col++) {
-            board.setPiece(Position(1, col), 
-                         make_unique<Pawn>(Color::BLACK, Position(1, col)));
-            board.setPiece(Position(6, col), 
-                         make_unique<Pawn>(Color::WHITE, Position(6, col)));
+    
+    char getPieceChar(const Piece& piece) const {
+        char c;
+        switch (piece.type) {
+            case PieceType::PAWN: c = 'p'; break;
+            case PieceType::ROOK: c = 'r'; break;
+            case PieceType::KNIGHT: c = 'n'; break;
+            case PieceType::BISHOP: c = 'b'; break;
+            case PieceType::QUEEN: c = 'q'; break;
+            case PieceType::KING: c = 'k'; break;
+            default: c = '?'; break;
         }
-        
-        // Initialize other pieces
-        // ... (implementation for other pieces)
+        return (piece.color == Color::WHITE) ? toupper(c) : c;
     }
     
-    void handleCastling(Move& move) {
-        // Implementation of castling logic
+    static bool getPieceType(char c, PieceType& type) {
+        switch (tolower(c)) {
+            case 'p': type = PieceType::PAWN; return true;
+            case 'r': type = PieceType::ROOK; return true;
+            case 'n': type = PieceType::KNIGHT; return true;
+            case 'b': type = PieceType::BISHOP; return true;
+            case 'q': type = PieceType::QUEEN; return true;
+            case 'k': type = PieceType::KING; return true;
+            default: return false;
+        }
     }
     
-    void handleEnPassant(Move& move) {
-        // Implementation of en passant logic
+    string getCastlingString() const {
+        string castling;
+        if (castlingRights & WHITE_KINGSIDE) castling += 'K';
+        if (castlingRights & WHITE_QUEENSIDE) castling += 'Q';
+        if (castlingRights & BLACK_KINGSIDE) castling += 'k';
+        if (castlingRights & BLACK_QUEENSIDE) castling += 'q';
+        return castling.empty() ? "-" : castling;
     }
+};
+
+// WorkStealingPool class implementation
+// Each worker owns a deque: it pops its own tasks from the back and steals
+// from the front of the others' when it runs dry, so one long game does not
+// hold up the rest of a batch. Tasks receive the index of the worker running
+// them, which callers use to reach per-worker state without locking.
+class WorkStealingPool {
+private:
+    typedef function<void(size_t)> Task;
+    
+    struct WorkerQueue {
+        mutex queueMutex;
+        deque<Task> tasks;
+    };
     
-    void handlePromotion(Move& move) {
-        // Implementation of pawn promotion logic
+    vector<unique_ptr<WorkerQueue>> queues;
+    vector<thread> workers;
+    mutex poolMutex;
+    condition_variable workAvailable;
+    condition_variable allDone;
+    long queuedTasks;
+    size_t pendingTasks;
+    size_t nextQueue;
+    bool stopping;
+
+public:
+    explicit WorkStealingPool(size_t threadCount = thread::hardware_concurrency())
+        : queuedTasks(0), pendingTasks(0), nextQueue(0), stopping(false) {
+        threadCount = max<size_t>(threadCount, 1);
+        for (size_t i = 0; i < threadCount; i++) {
+            queues.push_back(make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back(&WorkStealingPool::run, this, i);
+        }
     }
     
-    void executeMove(Move& move) {
-        // Store captured piece
-        Piece* capturedPiece = board.getPiece(move.getTo());
-        if (capturedPiece) {
-            move.setCapturedPiece(capturedPiece);
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> lock(poolMutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
         }
-        
-        // Move piece
-        board.movePiece(move.getFrom(), move.getTo());
-        move.getPiece()->setHasMoved(true);
-        
-        // Update move history
-        moveHistory.push_back(move);
-        
-        // Switch player
-        currentPlayer = (currentPlayer == Color::WHITE) ? Color::BLACK : Color::WHITE;
     }
     
-    void updateGameState() {
-        // Update halfmove clock
-        if (moveHistory.back().getCapturedPiece() || 
-            moveHistory.back().getPiece()->getType() == PieceType::PAWN) {
-            halfMoveClock = 0;
-        } else {
-            halfMoveClock++;
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    // Queues round-robin; stealing evens out whatever the split gets wrong
+    void submit(Task task) {
+        size_t target;
+        {
+            lock_guard<mutex> lock(poolMutex);
+            target = nextQueue++ % queues.size();
+            pendingTasks++;
         }
-        
-        // Update fullmove number
-        if (currentPlayer == Color::WHITE) {
-            fullMoveNumber++;
+        {
+            lock_guard<mutex> lock(queues[target]->queueMutex);
+            queues[target]->tasks.push_back(move(task));
         }
-        
-        // Update position history
-        string fen = getFEN();
-        positionHistory[fen]++;
+        {
+            lock_guard<mutex> lock(poolMutex);
+            queuedTasks++;
+        }
+        workAvailable.notify_one();
     }
     
-    bool isInsufficientMaterial() const {
-        // Implementation of insufficient material check
-        return false;  // Simplified
+    // Blocks until every submitted task has finished
+    void wait() {
+        unique_lock<mutex> lock(poolMutex);
+        allDone.wait(lock, [this] { return pendingTasks == 0; });
     }
     
-    bool isThreefoldRepetition() const {
-        for (const auto& entry : positionHistory) {
-            if (entry.second >= 3) return true;
+    size_t size() const {
+        return workers.size();
+    }
+
+private:
+    bool tryPop(size_t worker, Task& task) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            WorkerQueue& queue = *queues[(worker + i) % queues.size()];
+            lock_guard<mutex> lock(queue.queueMutex);
+            if (queue.tasks.empty()) continue;
+            
+            if (i == 0) {
+                task = move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
         }
         return false;
     }
     
-    char getPieceChar(Piece* piece) const {
-        char c;
-        switch (piece->getType()) {
-            case PieceType::PAWN: c = 'p'; break;
-            case PieceType::ROOK: c = 'r'; break;
-            case PieceType::KNIGHT: c = 'n'; break;
-            case PieceType::BISHOP: c = 'b'; break;
-            case PieceType::QUEEN: c = 'q'; break;
-            case PieceType::KING: c = 'k'; break;
+    void run(size_t worker) {
+        while (true) {
+            Task task;
+            if (tryPop(worker, task)) {
+                {
+                    lock_guard<mutex> lock(poolMutex);
+                    queuedTasks--;
+                }
+                task(worker);
+                
+                lock_guard<mutex> lock(poolMutex);
+                if (--pendingTasks == 0) allDone.notify_all();
+                continue;
+            }
+            
+            // The count can briefly run ahead of the deques while a submit
+            // is in flight, in which case the loop just retries
+            unique_lock<mutex> lock(poolMutex);
+            workAvailable.wait(lock, [this] { return stopping || queuedTasks > 0; });
+            if (stopping && queuedTasks <= 0) return;
+        }
+    }
+};
+
+// One game to replay: a FEN start (empty for the standard position) and its
+// moves in coordinate notation
+struct GameRecord {
+    string startFEN;
+    vector<string> moves;
+};
+
+// Compact per-game result of a batch analysis
+struct GameAnalysis {
+    string finalFEN;        // empty if the start FEN did not parse
+    uint32_t movesPlayed;   // moves applied before the first illegal one
+    GameStatus status;
+    bool legal;
+    bool repetition;
+};
+
+// BatchAnalyzer class implementation
+// Replays games on a work-stealing pool. Every worker keeps one GameState
+// and resets it between games instead of constructing a new one.
+class BatchAnalyzer {
+private:
+    WorkStealingPool pool;
+    vector<unique_ptr<GameState>> states;
+    mutex batchMutex;
+
+public:
+    explicit BatchAnalyzer(size_t threadCount = thread::hardware_concurrency()) : pool(threadCount) {
+        for (size_t i = 0; i < pool.size(); i++) {
+            states.push_back(make_unique<GameState>());
         }
-        return (piece->getColor() == Color::WHITE) ? toupper(c) : c;
     }
     
-    string getCastlingString() const {
-        string castling;
-        if (!whiteKingMoved) {
-            if (!whiteRookMoved[0]) castling += 'K';
-            if (!whiteRookMoved[1]) castling += 'Q';
+    vector<GameAnalysis> analyze(const vector<GameRecord>& games) {
+        // The pool's wait() covers every task, so batches run one at a time
+        lock_guard<mutex> lock(batchMutex);
+        
+        vector<GameAnalysis> results(games.size());
+        for (size_t i = 0; i < games.size(); i++) {
+            pool.submit([this, &games, &results, i](size_t worker) {
+                results[i] = analyzeGame(*states[worker], games[i]);
+            });
+        }
+        pool.wait();
+        return results;
+    }
+    
+    size_t getThreadCount() const {
+        return pool.size();
+    }
+
+private:
+    static GameAnalysis analyzeGame(GameState& game, const GameRecord& record) {
+        GameAnalysis result = {"", 0, GameStatus::ACTIVE, false, false};
+        try {
+            if (record.startFEN.empty()) {
+                game.reset();
+            } else {
+                game.reset(record.startFEN);
+            }
+        } catch (const invalid_argument&) {
+            return result;
         }
-        if (!blackKingMoved) {
-            if (!blackRookMoved[0]) castling += 'k';
-            if (!blackRookMoved[1]) castling += 'q';
+        
+        result.legal = true;
+        for (const string& move : record.moves) {
+            if (!game.makeMove(move)) {
+                result.legal = false;
+                break;
+            }
+            result.movesPlayed++;
         }
-        return castling.empty() ? "-" : castling;
+        
+        result.finalFEN = game.getFEN();
+        result.status = game.getStatus();
+        result.repetition = game.isRepetition();
+        return result;
     }
 };
 
@@ -562,5 +1943,19 @@ int main() {
     // Get FEN string
     cout << "FEN: " << game.getFEN() << endl;
     
+    // Replay a small batch across worker threads
+    BatchAnalyzer analyzer(2);
+    vector<GameAnalysis> results = analyzer.analyze({
+        {"", {"f2f3", "e7e5", "g2g4", "d8h4"}},
+        {"", {"e2e4", "e7e5", "e1e3"}}
+    });
+    for (const auto& result : results) {
+        cout << (result.legal ? "Legal" : "Illegal") << " after " << result.movesPlayed
+             << " moves: " << result.finalFEN << endl;
+    }
+    
+    // Count positions three plies ahead
+    cout << "Perft(3): " << game.perft(3) << endl;
+    
     return 0;
-} 
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <chrono>
 #include "implementation.cpp"
 
 using namespace std;
@@ -60,6 +61,10 @@ void testInvalidMoves() {
     assertFalse(game.makeMove(Position("e7"), Position("e5")), 
                "Should not be able to move opponent's piece");
     
+    // A promotion suffix is only valid on a pawn reaching the last rank
+    assertFalse(game.makeMove("e2e4q"), "Should not accept a promotion suffix on a non-promotion move");
+    assertTrue(game.makeMove("e2e4"), "Plain move should still be accepted");
+    
     cout << "Invalid moves tests passed!" << endl;
 }
 
@@ -74,6 +79,8 @@ void testCheckDetection() {
     game.makeMove(Position("f1"), Position("c4"));  // White bishop
     game.makeMove(Position("b8"), Position("c6"));  // Black knight
     game.makeMove(Position("d1"), Position("h5"));  // White queen
+    game.makeMove(Position("g8"), Position("f6"));  // Black knight
+    game.makeMove(Position("h5"), Position("f7"));  // White queen takes f7
     
     assertTrue(game.isCheck(Color::BLACK), "Black should be in check");
     assertFalse(game.isCheck(Color::WHITE), "White should not be in check");
@@ -103,18 +110,17 @@ void testStalemateDetection() {
     
     GameState game;
     
-    // Set up a position where black is stalemated
-    game.makeMove(Position("e2"), Position("e4"));  // White pawn
-    game.makeMove(Position("a7"), Position("a5"));  // Black pawn
-    game.makeMove(Position("d1"), Position("h5"));  // White queen
-    game.makeMove(Position("a8"), Position("a6"));  // Black rook
-    game.makeMove(Position("h5"), Position("a5"));  // White queen
-    game.makeMove(Position("h7"), Position("h5"));  // Black pawn
-    game.makeMove(Position("h2"), Position("h4"));  // White pawn
-    game.makeMove(Position("a6"), Position("h6"));  // Black rook
-    game.makeMove(Position("a5"), Position("c7"));  // White queen
-    game.makeMove(Position("f7"), Position("f6"));  // Black pawn
-    game.makeMove(Position("c7"), Position("d7"));  // White queen
+    // Set up a position where black is stalemated (Loyd's ten-move stalemate)
+    const char* moves[][2] = {
+        {"e2", "e3"}, {"a7", "a5"}, {"d1", "h5"}, {"a8", "a6"}, {"h5", "a5"},
+        {"h7", "h5"}, {"h2", "h4"}, {"a6", "h6"}, {"a5", "c7"}, {"f7", "f6"},
+        {"c7", "d7"}, {"e8", "f7"}, {"d7", "b7"}, {"d8", "d3"}, {"b7", "b8"},
+        {"d3", "h7"}, {"b8", "c8"}, {"f7", "g6"}, {"c8", "e6"}
+    };
+    for (const auto& move : moves) {
+        assertTrue(game.makeMove(Position(move[0]), Position(move[1])), 
+                  string("Should be able to play ") + move[0] + move[1]);
+    }
     
     assertTrue(game.isStalemate(Color::BLACK), "Black should be stalemated");
     assertFalse(game.isStalemate(Color::WHITE), "White should not be stalemated");
@@ -134,11 +140,97 @@ void testValidMoves() {
     // Get valid moves for a knight
     game.makeMove(Position("e2"), Position("e4"));  // White pawn
     moves = game.getValidMoves(Position("g1"));
-    assertEqual(2, moves.size(), "Knight should have 2 valid moves");
+    assertEqual(3, moves.size(), "Knight should have 3 valid moves");
     
     cout << "Valid moves tests passed!" << endl;
 }
 
+void testAllPieceMoves() {
+    cout << "Running all piece moves tests..." << endl;
+    
+    GameState game;
+    
+    // Open lines for every back-rank piece
+    game.makeMove(Position("e2"), Position("e4"));
+    game.makeMove(Position("d7"), Position("d5"));
+    game.makeMove(Position("d2"), Position("d4"));
+    game.makeMove(Position("a7"), Position("a6"));
+    
+    assertEqual(5, game.getValidMoves(Position("c1")).size(), "Bishop should have 5 valid moves");
+    assertEqual(5, game.getValidMoves(Position("f1")).size(), "Bishop should have 5 valid moves");
+    assertEqual(6, game.getValidMoves(Position("d1")).size(), "Queen should have 6 valid moves");
+    assertEqual(2, game.getValidMoves(Position("e1")).size(), "King should have 2 valid moves");
+    assertEqual(0, game.getValidMoves(Position("a1")).size(), "Rook should be blocked");
+    
+    // Pawn capture and rook move
+    assertTrue(game.makeMove(Position("e4"), Position("d5")), "Pawn should capture diagonally");
+    assertTrue(game.makeMove(Position("a8"), Position("a7")), "Rook should move along the file");
+    
+    cout << "All piece moves tests passed!" << endl;
+}
+
+void testSpecialMoves() {
+    cout << "Running special moves tests..." << endl;
+    
+    GameState game;
+    
+    // En passant
+    game.makeMove(Position("e2"), Position("e4"));
+    game.makeMove(Position("a7"), Position("a6"));
+    game.makeMove(Position("e4"), Position("e5"));
+    game.makeMove(Position("d7"), Position("d5"));
+    assertTrue(game.makeMove(Position("e5"), Position("d6")), "Should be able to capture en passant");
+    assertTrue(game.getFEN().find("rnbqkbnr/1pp1pppp/p2P4/8/8/8/PPPP1PPP/RNBQKBNR b KQkq -") == 0, 
+              "Captured pawn should be removed");
+    
+    // Castling kingside
+    game.makeMove(Position("a6"), Position("a5"));
+    game.makeMove(Position("g1"), Position("f3"));
+    game.makeMove(Position("a5"), Position("a4"));
+    game.makeMove(Position("f1"), Position("e2"));
+    game.makeMove(Position("a4"), Position("a3"));
+    assertTrue(game.makeMove(Position("e1"), Position("g1")), "Should be able to castle kingside");
+    assertTrue(game.getFEN().find("RNBQ1RK1 b kq") != string::npos, "Rook should jump to f1");
+    
+    // Promotion
+    game.makeMove(Position("a3"), Position("b2"));
+    game.makeMove(Position("d6"), Position("c7"));
+    assertTrue(game.makeMove(Position("b2"), Position("a1"), PieceType::KNIGHT), 
+              "Should be able to promote with capture");
+    assertTrue(game.getFEN().find("/nNBQ1RK1 ") != string::npos, "Pawn should become a knight");
+    
+    cout << "Special moves tests passed!" << endl;
+}
+
+void testPinsAndChecks() {
+    cout << "Running pins and checks tests..." << endl;
+    
+    // Knight pinned against the king by the bishop
+    GameState pinned;
+    pinned.makeMove(Position("e2"), Position("e4"));
+    pinned.makeMove(Position("e7"), Position("e5"));
+    pinned.makeMove(Position("g1"), Position("f3"));
+    pinned.makeMove(Position("b8"), Position("c6"));
+    pinned.makeMove(Position("f1"), Position("b5"));
+    pinned.makeMove(Position("d7"), Position("d6"));
+    assertEqual(0, pinned.getValidMoves(Position("c6")).size(), "Pinned knight should have no moves");
+    
+    // Only capturing the checker resolves the check
+    GameState check;
+    check.makeMove(Position("e2"), Position("e4"));
+    check.makeMove(Position("e7"), Position("e5"));
+    check.makeMove(Position("d1"), Position("h5"));
+    check.makeMove(Position("b8"), Position("c6"));
+    check.makeMove(Position("h5"), Position("f7"));
+    assertTrue(check.isCheck(Color::BLACK), "Black should be in check");
+    assertEqual(1, check.getValidMoves(Position("e8")).size(), "King should only be able to capture");
+    assertEqual(0, check.getValidMoves(Position("g8")).size(), "Knight cannot resolve the check");
+    assertFalse(check.makeMove(Position("e8"), Position("e7")), "King cannot stay in check");
+    assertTrue(check.makeMove(Position("e8"), Position("f7")), "King should capture the queen");
+    
+    cout << "Pins and checks tests passed!" << endl;
+}
+
 void testMoveUndo() {
     cout << "Running move undo tests..." << endl;
     
@@ -154,9 +246,316 @@ void testMoveUndo() {
     assertTrue(game.makeMove(Position("e2"), Position("e4")), 
               "Should be able to make the same move after undo");
     
+    // Undo restores captures, castling rights and the en passant square
+    game.makeMove(Position("d7"), Position("d5"));
+    string beforeCapture = game.getFEN();
+    assertTrue(game.makeMove(Position("e4"), Position("d5")), "Should be able to capture");
+    game.undoMove();
+    assertTrue(game.getFEN() == beforeCapture, "Undo should restore the captured pawn");
+    
+    game.makeMove(Position("e4"), Position("e5"));
+    game.makeMove(Position("f7"), Position("f5"));
+    string beforeEnPassant = game.getFEN();
+    assertTrue(game.makeMove(Position("e5"), Position("f6")), "Should be able to capture en passant");
+    game.undoMove();
+    assertTrue(game.getFEN() == beforeEnPassant, "Undo should restore the en passant state");
+    
+    game.makeMove(Position("g1"), Position("f3"));
+    game.makeMove(Position("a7"), Position("a6"));
+    game.makeMove(Position("f1"), Position("e2"));
+    game.makeMove(Position("a6"), Position("a5"));
+    string beforeCastling = game.getFEN();
+    assertTrue(game.makeMove(Position("e1"), Position("g1")), "Should be able to castle");
+    game.undoMove();
+    assertTrue(game.getFEN() == beforeCastling, "Undo should restore the rook and castling rights");
+    
     cout << "Move undo tests passed!" << endl;
 }
 
+void testRepetition() {
+    cout << "Running repetition tests..." << endl;
+    
+    GameState game;
+    uint64_t startKey = game.getZobristKey();
+    
+    // Shuffle knights back and forth; the start position recurs
+    const char* moves[][2] = {
+        {"g1", "f3"}, {"g8", "f6"}, {"f3", "g1"}, {"f6", "g8"},
+        {"g1", "f3"}, {"g8", "f6"}, {"f3", "g1"}
+    };
+    for (const auto& move : moves) {
+        game.makeMove(Position(move[0]), Position(move[1]));
+    }
+    assertFalse(game.isDraw(), "Position has only occurred twice");
+    game.makeMove(Position("f6"), Position("g8"));
+    assertTrue(game.getZobristKey() == startKey, "Returning to the start should restore the key");
+    assertTrue(game.isDraw(), "Position occurred three times");
+    
+    // Undo restores the previous key
+    game.undoMove();
+    assertFalse(game.isDraw(), "Undo should drop the third occurrence");
+    
+    // Transpositions reach the same key
+    GameState first;
+    first.makeMove(Position("e2"), Position("e4"));
+    first.makeMove(Position("e7"), Position("e5"));
+    first.makeMove(Position("g1"), Position("f3"));
+    GameState second;
+    second.makeMove(Position("g1"), Position("f3"));
+    second.makeMove(Position("e7"), Position("e5"));
+    second.makeMove(Position("e2"), Position("e4"));
+    assertTrue(first.getZobristKey() == second.getZobristKey(), "Transposed positions should share a key");
+    
+    cout << "Repetition tests passed!" << endl;
+}
+
+// Standard perft positions with known node counts
+struct PerftCase {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+};
+
+const PerftCase perftCases[] = {
+    {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 197281},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862},
+    {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+    {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467},
+    {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+    {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 3, 89890}
+};
+
+void testFENLoading() {
+    cout << "Running FEN loading tests..." << endl;
+    
+    GameState start;
+    GameState loaded(start.getFEN());
+    assertTrue(loaded.getFEN() == start.getFEN(), "FEN should round-trip");
+    assertTrue(loaded.getZobristKey() == start.getZobristKey(), "Loaded position should have the same key");
+    
+    for (const PerftCase& test : perftCases) {
+        assertTrue(GameState(test.fen).getFEN() == test.fen, string("FEN should round-trip for ") + test.name);
+    }
+    
+    const char* invalid[] = {
+        "",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1",
+        "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbqxbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "rnbq1bnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkx - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e9 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e4 0 1",
+        "4k3/8/8/8/8/8/3P4/4K3 w - e3 0 1",
+        "4k3/8/8/8/4p3/8/3P4/4K3 w - e6 0 1",
+        "4k3/8/4n3/4p3/8/8/3P4/4K3 w - e6 0 1",
+        "P3k3/8/8/8/8/8/8/4K3 w - - 0 1",
+        "4k3/8/8/8/8/8/8/4K2p b - - 0 1",
+        "4k3/8/8/8/8/8/8/4K3 w KQ - 0 1",
+        "r3k2r/8/8/8/8/8/8/R4K1R w KQkq - 0 1"
+    };
+    for (const char* fen : invalid) {
+        bool threw = false;
+        try {
+            GameState game(fen);
+        } catch (const invalid_argument&) {
+            threw = true;
+        }
+        assertTrue(threw, string("Invalid FEN should be rejected: ") + fen);
+    }
+    
+    cout << "FEN loading tests passed!" << endl;
+}
+
+void testPerft() {
+    cout << "Running perft tests..." << endl;
+    
+    for (const PerftCase& test : perftCases) {
+        GameState game(test.fen);
+        string before = game.getFEN();
+        assertEqual(static_cast<int>(test.nodes), static_cast<int>(game.perft(test.depth)),
+                   string("Perft node count for ") + test.name);
+        assertTrue(game.getFEN() == before, string("Perft should leave the position unchanged for ") + test.name);
+    }
+    
+    // Divide splits the same count by root move
+    GameState start;
+    auto divide = start.perftDivide(3);
+    uint64_t total = 0;
+    for (const auto& entry : divide) {
+        total += entry.second;
+    }
+    assertEqual(20, divide.size(), "Start position should have 20 root moves");
+    assertEqual(8902, static_cast<int>(total), "Divide should sum to perft(3)");
+    
+    GameState promotion("n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1");
+    assertEqual(24, promotion.perft(1), "Promotion position perft(1)");
+    assertEqual(496, promotion.perft(2), "Promotion position perft(2)");
+    
+    cout << "Perft tests passed!" << endl;
+}
+
+void testPerftBenchmark() {
+    cout << "Running perft benchmark..." << endl;
+    
+    // Per-move divide output for the start position
+    GameState start;
+    for (const auto& entry : start.perftDivide(3)) {
+        cout << "  " << entry.first << ": " << entry.second << endl;
+    }
+    
+    for (const PerftCase& test : perftCases) {
+        GameState game(test.fen);
+        auto start = chrono::steady_clock::now();
+        uint64_t nodes = game.perft(test.depth + 1);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        cout << "  " << test.name << " depth " << (test.depth + 1) << ": " << nodes << " nodes, "
+             << static_cast<uint64_t>(nodes / max(seconds, 1e-9)) << " nodes/s" << endl;
+    }
+    
+    cout << "Perft benchmark completed!" << endl;
+}
+
+void testBatchAnalysis() {
+    cout << "Running batch analysis tests..." << endl;
+    
+    vector<GameRecord> games = {
+        {"", {"f2f3", "e7e5", "g2g4", "d8h4"}},
+        {"", {"e2e4", "e7e5", "e1e3", "g8f6"}},
+        {"", {"g1f3", "g8f6", "f3g1", "f6g8", "g1f3", "g8f6", "f3g1", "f6g8"}},
+        {"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N w - - 0 1", {"b7b8n", "d7d6"}},
+        {"not a fen", {"e2e4"}},
+        {"", {"e2e4", "e7e5", "e5e4x"}}
+    };
+    
+    BatchAnalyzer analyzer(4);
+    assertEqual(4, analyzer.getThreadCount(), "Analyzer should start the requested threads");
+    vector<GameAnalysis> results = analyzer.analyze(games);
+    assertEqual(games.size(), results.size(), "Every game should get a result");
+    
+    assertTrue(results[0].legal, "Fool's mate should be legal");
+    assertEqual(4, results[0].movesPlayed, "Fool's mate should play all moves");
+    assertTrue(results[0].status == GameStatus::CHECKMATE, "Fool's mate should end in checkmate");
+    
+    assertFalse(results[1].legal, "King cannot jump two squares forward");
+    assertEqual(2, results[1].movesPlayed, "Replay should stop at the illegal move");
+    assertTrue(results[1].finalFEN == "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2",
+              "Final FEN should be the position before the illegal move");
+    
+    assertTrue(results[2].legal, "Knight shuffle should be legal");
+    assertTrue(results[2].repetition, "Knight shuffle should repeat the position");
+    assertTrue(results[2].status == GameStatus::DRAW, "Repetition should be reported as a draw");
+    
+    assertTrue(results[3].legal, "Underpromotion from FEN should be legal");
+    assertTrue(results[3].finalFEN == "nNn5/P1P5/3k4/8/8/8/4Kppp/5N1N w - - 1 2",
+              "Underpromotion should leave a knight on b8");
+    
+    assertFalse(results[4].legal, "Invalid FEN should not be legal");
+    assertTrue(results[4].finalFEN.empty(), "Invalid FEN should have no final position");
+    
+    assertFalse(results[5].legal, "Malformed move should not be legal");
+    assertEqual(2, results[5].movesPlayed, "Malformed move should stop the replay");
+    
+    // A larger batch with more games than workers reuses the pooled states
+    vector<GameRecord> batch;
+    for (int i = 0; i < 200; i++) {
+        batch.push_back(games[i % games.size()]);
+    }
+    vector<GameAnalysis> batchResults = analyzer.analyze(batch);
+    for (size_t i = 0; i < batch.size(); i++) {
+        const GameAnalysis& expected = results[i % games.size()];
+        assertTrue(batchResults[i].legal == expected.legal && batchResults[i].movesPlayed == expected.movesPlayed &&
+                  batchResults[i].finalFEN == expected.finalFEN && batchResults[i].status == expected.status,
+                  "Batch result should not depend on which worker ran the game");
+    }
+    
+    cout << "Batch analysis tests passed!" << endl;
+}
+
+void testSearch() {
+    cout << "Running search tests..." << endl;
+    
+    GameState start;
+    assertEqual(0, start.evaluate(), "Start position should evaluate as level");
+    
+    SearchLimits limits;
+    limits.maxDepth = 4;
+    
+    // Scholar's mate in one
+    GameState mateInOne("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+    SearchResult mate = mateInOne.findBestMove(limits);
+    assertTrue(mate.bestMove == "h5f7", "Search should find the mate in one");
+    assertTrue(mate.score > 29000, "Mate should get a mate score");
+    
+    // Hanging queen, searched with its own table by two threads
+    TranspositionTable table(16);
+    limits.threads = 2;
+    GameState hanging("rnb1kbnr/pppp1ppp/8/4p3/3qP3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 3");
+    SearchResult capture = hanging.findBestMove(limits, table);
+    assertTrue(capture.bestMove == "f3d4", "Search should capture the hanging queen");
+    assertTrue(capture.score > 300, "Winning the queen should score well");
+    assertEqual(4, capture.depth, "Search should complete the requested depth");
+    assertTrue(hanging.makeMove(capture.bestMove), "Best move should be legal");
+    
+    // Budgets stop the search early but still return a legal move
+    SearchLimits nodeBudget;
+    nodeBudget.maxNodes = 5000;
+    SearchResult limited = start.findBestMove(nodeBudget);
+    assertTrue(limited.nodes < 5000 + 2048, "Node budget should be respected");
+    assertTrue(GameState().makeMove(limited.bestMove), "Node-limited move should be legal");
+    
+    SearchLimits timeBudget;
+    timeBudget.timeMs = 100;
+    auto before = chrono::steady_clock::now();
+    SearchResult timed = start.findBestMove(timeBudget);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - before).count();
+    assertTrue(seconds < 2.0, "Time budget should be respected");
+    assertTrue(GameState().makeMove(timed.bestMove), "Time-limited move should be legal");
+    cout << "  100ms search: depth " << timed.depth << ", " << timed.nodes << " nodes" << endl;
+    
+    // No legal moves
+    GameState mated("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+    SearchResult none = mated.findBestMove(limits);
+    assertTrue(none.bestMove.empty(), "Mated side should have no best move");
+    assertTrue(none.score < -29000, "Mated side should get a mated score");
+    
+    cout << "Search tests passed!" << endl;
+}
+
+void testInstrumentation() {
+    cout << "Running instrumentation tests..." << endl;
+    
+    MetricsSnapshot before = Metrics::snapshot();
+    GameState game;
+    assertTrue(game.makeMove("e2e4") && game.makeMove("e7e5") && game.makeMove("g1f3"), "Opening moves");
+    SearchLimits limits;
+    limits.maxDepth = 2;
+    SearchResult result = game.findBestMove(limits);
+    MetricsSnapshot after = Metrics::snapshot();
+    
+    if (!Metrics::enabled) {
+        assertTrue(after.counters.empty() && after.histograms.empty(), "Disabled builds report nothing");
+        cout << "Instrumentation tests passed!" << endl;
+        return;
+    }
+    
+    auto delta = [&](const string& name) {
+        return static_cast<long long>(after.counter(name) - before.counter(name));
+    };
+    assertEqual(3, static_cast<int>(after.histogram("chess.make_move_ns").count - before.histogram("chess.make_move_ns").count),
+                "Every move is timed");
+    assertEqual(20 + 20 + 29, static_cast<int>(delta("chess.legal_moves_scanned")), "Legal moves generated per move");
+    assertEqual(1, static_cast<int>(after.histogram("chess.search_ns").count - before.histogram("chess.search_ns").count),
+                "The search is timed");
+    assertTrue(delta("chess.search_nodes") == static_cast<long long>(result.nodes), "Search nodes are counted");
+    assertTrue(delta("chess.state_lock.acquisitions") >= 4, "Moves and the search copy take the state lock");
+    
+    cout << "Instrumentation tests passed!" << endl;
+}
+
 int main() {
     try {
         testBasicMoves();
@@ -165,7 +564,17 @@ int main() {
         testCheckmateDetection();
         testStalemateDetection();
         testValidMoves();
+        testAllPieceMoves();
+        testSpecialMoves();
+        testPinsAndChecks();
         testMoveUndo();
+        testRepetition();
+        testFENLoading();
+        testPerft();
+        testBatchAnalysis();
+        testSearch();
+        testInstrumentation();
+        testPerftBenchmark();
         
         cout << "All tests passed!" << endl;
         return 0;
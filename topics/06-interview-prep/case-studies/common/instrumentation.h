@@ -0,0 +1,375 @@
+#ifndef CASE_STUDIES_COMMON_INSTRUMENTATION_H
+#define CASE_STUDIES_COMMON_INSTRUMENTATION_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Instrumentation shared by every case study
+// Per-thread counters and log-linear latency histograms, read through
+// Metrics::snapshot(). A probe is registered by name once and then costs
+// the recording thread a few relaxed stores to its own block; threads never
+// write to each other's cache lines. Names are prefixed with the case study
+// ("parking.", "chess.", ...). Building with -DNO_INSTRUMENTATION turns
+// every probe, ScopedTimer and InstrumentedMutex into a no-op.
+struct HistogramSnapshot {
+    static constexpr int SUB_BUCKETS = 8;                 // per power of two
+    static constexpr int BUCKETS = 42 * SUB_BUCKETS;      // up to 2^44 ns
+    
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, BUCKETS> buckets{};
+    
+    // Exact below SUB_BUCKETS, then within 1/SUB_BUCKETS of the value
+    static int bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<int>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        int bucket = (exponent - 2) * SUB_BUCKETS + static_cast<int>((value >> (exponent - 3)) & (SUB_BUCKETS - 1));
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+    
+    // Largest value that lands in the bucket
+    static uint64_t bucketLimit(int bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        int exponent = bucket / SUB_BUCKETS + 2;
+        uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+    }
+    
+    void record(uint64_t value) {
+        buckets[bucketOf(value)]++;
+        count++;
+        sum += value;
+        max = std::max(max, value);
+    }
+    
+    void merge(const HistogramSnapshot& other) {
+        count += other.count;
+        sum += other.sum;
+        max = std::max(max, other.max);
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            buckets[bucket] += other.buckets[bucket];
+        }
+    }
+    
+    double mean() const {
+        return count ? static_cast<double>(sum) / count : 0.0;
+    }
+    
+    uint64_t percentile(double fraction) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * count));
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            seen += buckets[bucket];
+            if (seen >= rank && seen > 0) return std::min(bucketLimit(bucket), max);
+        }
+        return max;
+    }
+};
+
+struct MetricsSnapshot {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, HistogramSnapshot> histograms;
+    
+    uint64_t counter(const std::string& name) const {
+        auto it = counters.find(name);
+        return it != counters.end() ? it->second : 0;
+    }
+    
+    HistogramSnapshot histogram(const std::string& name) const {
+        auto it = histograms.find(name);
+        return it != histograms.end() ? it->second : HistogramSnapshot();
+    }
+    
+    std::string toString() const {
+        std::string text;
+        for (const auto& entry : counters) {
+            text += entry.first + " " + std::to_string(entry.second) + "\n";
+        }
+        for (const auto& entry : histograms) {
+            const HistogramSnapshot& histogram = entry.second;
+            text += entry.first + " count=" + std::to_string(histogram.count) +
+                    " p50=" + std::to_string(histogram.percentile(0.50)) +
+                    " p99=" + std::to_string(histogram.percentile(0.99)) +
+                    " max=" + std::to_string(histogram.max) + "\n";
+        }
+        return text;
+    }
+};
+
+#ifdef NO_INSTRUMENTATION
+
+class Metrics {
+public:
+    static constexpr bool enabled = false;
+    
+    static int counter(const char*) { return 0; }
+    static int histogram(const char*) { return 0; }
+    static void add(int, uint64_t = 1) {}
+    static void record(int, uint64_t) {}
+    static MetricsSnapshot snapshot() { return MetricsSnapshot(); }
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int) {}
+};
+
+template <typename Mutex>
+class BasicInstrumentedMutex : public Mutex {
+public:
+    explicit BasicInstrumentedMutex(const char*) {}
+};
+
+#else
+
+class Metrics {
+public:
+    static constexpr bool enabled = true;
+    static constexpr int MAX_COUNTERS = 64;
+    static constexpr int MAX_HISTOGRAMS = 16;
+    
+    // Same name, same id; called once per probe, not on the hot path
+    static int counter(const char* name) {
+        return registry().intern(registry().counterNames, name, MAX_COUNTERS);
+    }
+    
+    static int histogram(const char* name) {
+        return registry().intern(registry().histogramNames, name, MAX_HISTOGRAMS);
+    }
+    
+    static void add(int id, uint64_t delta = 1) {
+        bump(local().counters[id], delta);
+    }
+    
+    static void record(int id, uint64_t value) {
+        ThreadHistogram& target = local().histograms[id];
+        bump(target.buckets[HistogramSnapshot::bucketOf(value)], 1);
+        bump(target.count, 1);
+        bump(target.sum, value);
+        if (value > target.max.load(std::memory_order_relaxed)) {
+            target.max.store(value, std::memory_order_relaxed);
+        }
+    }
+    
+    // Totals over live threads and threads that have exited
+    static MetricsSnapshot snapshot() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.registryMutex);
+        MetricsSnapshot result;
+        for (size_t id = 0; id < r.counterNames.size(); id++) {
+            uint64_t total = r.retired.counters[id].load(std::memory_order_relaxed);
+            for (const ThreadBlock* block : r.live) {
+                total += block->counters[id].load(std::memory_order_relaxed);
+            }
+            result.counters[r.counterNames[id]] = total;
+        }
+        for (size_t id = 0; id < r.histogramNames.size(); id++) {
+            HistogramSnapshot& histogram = result.histograms[r.histogramNames[id]];
+            mergeInto(histogram, r.retired.histograms[id]);
+            for (const ThreadBlock* block : r.live) {
+                mergeInto(histogram, block->histograms[id]);
+            }
+        }
+        return result;
+    }
+
+private:
+    struct ThreadHistogram {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+        std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> buckets;
+    };
+    
+    // Written only by its own thread, read by snapshot()
+    struct ThreadBlock {
+        std::array<std::atomic<uint64_t>, MAX_COUNTERS> counters;
+        std::array<ThreadHistogram, MAX_HISTOGRAMS> histograms;
+    };
+    
+    struct Registry {
+        std::mutex registryMutex;
+        std::vector<std::string> counterNames;
+        std::vector<std::string> histogramNames;
+        std::vector<ThreadBlock*> live;
+        ThreadBlock retired{};
+        
+        int intern(std::vector<std::string>& names, const char* name, int limit) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            auto it = std::find(names.begin(), names.end(), name);
+            if (it != names.end()) return static_cast<int>(it - names.begin());
+            if (static_cast<int>(names.size()) >= limit) {
+                throw std::runtime_error(std::string("Too many metrics registering ") + name);
+            }
+            names.push_back(name);
+            return static_cast<int>(names.size()) - 1;
+        }
+    };
+    
+    // Folds the thread's totals into the registry when the thread exits
+    struct LocalBlock {
+        ThreadBlock* block = nullptr;
+        
+        ~LocalBlock() {
+            if (!block) return;
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.registryMutex);
+            for (int id = 0; id < MAX_COUNTERS; id++) {
+                bump(r.retired.counters[id], block->counters[id].load(std::memory_order_relaxed));
+            }
+            for (int id = 0; id < MAX_HISTOGRAMS; id++) {
+                ThreadHistogram& target = r.retired.histograms[id];
+                const ThreadHistogram& source = block->histograms[id];
+                bump(target.count, source.count.load(std::memory_order_relaxed));
+                bump(target.sum, source.sum.load(std::memory_order_relaxed));
+                if (source.max.load(std::memory_order_relaxed) > target.max.load(std::memory_order_relaxed)) {
+                    target.max.store(source.max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+                for (int bucket = 0; bucket < HistogramSnapshot::BUCKETS; bucket++) {
+                    bump(target.buckets[bucket], source.buckets[bucket].load(std::memory_order_relaxed));
+                }
+            }
+            r.live.erase(std::find(r.live.begin(), r.live.end(), block));
+            delete block;
+        }
+    };
+    
+    // Never destroyed, so threads exiting during shutdown can still retire
+    static Registry& registry() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+    
+    // The plain pointer keeps the fast path free of TLS wrapper calls; the
+    // handle with the destructor is only touched on a thread's first probe
+    static ThreadBlock& local() {
+        thread_local ThreadBlock* block = nullptr;
+        if (!block) block = attach();
+        return *block;
+    }
+    
+    static ThreadBlock* attach() {
+        thread_local LocalBlock handle;
+        ThreadBlock* block = new ThreadBlock();
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.registryMutex);
+        r.live.push_back(block);
+        handle.block = block;
+        return block;
+    }
+    
+    // Single writer per slot, so a load and a store replace the RMW
+    static void bump(std::atomic<uint64_t>& slot, uint64_t delta) {
+        slot.store(slot.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+    
+    static void mergeInto(HistogramSnapshot& target, const ThreadHistogram& source) {
+        target.count += source.count.load(std::memory_order_relaxed);
+        target.sum += source.sum.load(std::memory_order_relaxed);
+        target.max = std::max(target.max, source.max.load(std::memory_order_relaxed));
+        for (int bucket = 0; bucket < HistogramSnapshot::BUCKETS; bucket++) {
+            target.buckets[bucket] += source.buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+// Records the lifetime of the scope in nanoseconds
+class ScopedTimer {
+private:
+    int histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(int histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    
+    ~ScopedTimer() {
+        Metrics::record(histogram, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+// Drop-in for std::mutex or std::shared_mutex. Counts acquisitions and,
+// when the first try fails, times the wait; an uncontended lock never reads
+// the clock. Every mutex with the same name reports into the same metrics,
+// so a sharded lock reads back as one total.
+template <typename Mutex>
+class BasicInstrumentedMutex {
+private:
+    Mutex inner;
+    int acquisitions;
+    int contended;
+    int waitTime;
+
+public:
+    explicit BasicInstrumentedMutex(const char* name)
+        : acquisitions(Metrics::counter((std::string(name) + ".acquisitions").c_str())),
+          contended(Metrics::counter((std::string(name) + ".contended").c_str())),
+          waitTime(Metrics::histogram((std::string(name) + ".wait_ns").c_str())) {}
+    
+    void lock() {
+        if (!inner.try_lock()) {
+            auto start = std::chrono::steady_clock::now();
+            inner.lock();
+            recordWait(start);
+        }
+        Metrics::add(acquisitions);
+    }
+    
+    bool try_lock() {
+        if (!inner.try_lock()) return false;
+        Metrics::add(acquisitions);
+        return true;
+    }
+    
+    void unlock() {
+        inner.unlock();
+    }
+    
+    void lock_shared() {
+        if (!inner.try_lock_shared()) {
+            auto start = std::chrono::steady_clock::now();
+            inner.lock_shared();
+            recordWait(start);
+        }
+        Metrics::add(acquisitions);
+    }
+    
+    bool try_lock_shared() {
+        if (!inner.try_lock_shared()) return false;
+        Metrics::add(acquisitions);
+        return true;
+    }
+    
+    void unlock_shared() {
+        inner.unlock_shared();
+    }
+
+private:
+    void recordWait(std::chrono::steady_clock::time_point start) {
+        Metrics::add(contended);
+        Metrics::record(waitTime, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+#endif
+
+using InstrumentedMutex = BasicInstrumentedMutex<std::mutex>;
+using InstrumentedSharedMutex = BasicInstrumentedMutex<std::shared_mutex>;
+
+#endif
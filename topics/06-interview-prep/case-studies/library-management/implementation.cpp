@@ -5,9 +5,31 @@
 #include <unordered_set>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <chrono>
+#include <atomic>
 #include <stdexcept>
 #include <algorithm>
+#include <cstdint>
+#include <cctype>
+#include <iterator>
+#include <queue>
+#include <functional>
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/instrumentation.h"
 
 using namespace std;
 using namespace chrono;
@@ -15,6 +37,9 @@ using namespace chrono;
 // Enums
 enum class UserType { STUDENT, FACULTY, STAFF };
 enum class ReportType { AVAILABILITY, POPULAR, BORROWING, FINE };
+enum class LoanEventType { DUE, OVERDUE };
+enum class LedgerEventType : uint8_t { BORROW, RETURN, FINE, PAYMENT };
+enum class WalRecordType : uint8_t { ADD_BOOK, REMOVE_BOOK, REGISTER_USER, BORROW, RETURN, RENEW, FINE, PAYMENT, OVERDUE_RUN };
 
 // Forward declarations
 class Book;
@@ -23,110 +48,91 @@ class BorrowRecord;
 class Report;
 
 // Book class implementation
+// Copy counts are atomic so availability checks never lock; a borrow only
+// succeeds if it wins a copy with compare-and-swap.
 class Book {
 private:
     string isbn;
     string title;
     string author;
     string category;
-    int totalCopies;
-    int availableCopies;
-    mutex bookMutex;
+    atomic<int> totalCopies;
+    atomic<int> availableCopies;
 
 public:
-    Book(const string& isbn, const string& title, const string& author)
-        : isbn(isbn), title(title), author(author), totalCopies(1), availableCopies(1) {}
+    Book(const string& isbn, const string& title, const string& author, int copies = 1)
+        : isbn(isbn), title(title), author(author), totalCopies(copies), availableCopies(copies) {}
     
     string getIsbn() const { return isbn; }
     string getTitle() const { return title; }
     string getAuthor() const { return author; }
-    int getAvailableCopies() const { return availableCopies; }
+    int getAvailableCopies() const { return availableCopies.load(); }
+    int getTotalCopies() const { return totalCopies.load(); }
     
     bool isAvailable() const {
-        lock_guard<mutex> lock(bookMutex);
-        return availableCopies > 0;
+        return availableCopies.load() > 0;
     }
     
-    void incrementCopies() {
-        lock_guard<mutex> lock(bookMutex);
-        totalCopies++;
-        availableCopies++;
+    // Adds new copies to the collection
+    void incrementCopies(int copies = 1) {
+        totalCopies += copies;
+        availableCopies += copies;
     }
     
-    void decrementCopies() {
-        lock_guard<mutex> lock(bookMutex);
-        if (availableCopies > 0) {
-            availableCopies--;
+    // Takes one copy off the shelf; false if none is left
+    bool decrementCopies() {
+        int available = availableCopies.load();
+        while (available > 0) {
+            if (availableCopies.compare_exchange_weak(available, available - 1)) return true;
         }
-    }
-};
-
-// User class implementation
-class User {
-private:
-    string id;
-    string name;
-    string email;
-    UserType type;
-    double fineAmount;
-    vector<BorrowRecord> borrowHistory;
-    mutex userMutex;
-
-public:
-    User(const string& name, const string& email, UserType type)
-        : id(generateId()), name(name), email(email), type(type), fineAmount(0.0) {}
-    
-    string getId() const { return id; }
-    string getName() const { return name; }
-    UserType getType() const { return type; }
-    double getFineAmount() const { return fineAmount; }
-    
-    void addFine(double amount) {
-        lock_guard<mutex> lock(userMutex);
-        fineAmount += amount;
-    }
-    
-    void payFine(double amount) {
-        lock_guard<mutex> lock(userMutex);
-        fineAmount = max(0.0, fineAmount - amount);
-    }
-    
-    bool canBorrow() const {
-        lock_guard<mutex> lock(userMutex);
-        return fineAmount < 50.0 && borrowHistory.size() < 5;
+        return false;
     }
     
-    void addBorrowRecord(const BorrowRecord& record) {
-        lock_guard<mutex> lock(userMutex);
-        borrowHistory.push_back(record);
-    }
-
-private:
-    string generateId() {
-        static int counter = 0;
-        return "USER" + to_string(++counter);
+    // Puts a borrowed copy back on the shelf
+    void returnCopy() {
+        int available = availableCopies.load();
+        while (available < totalCopies.load()) {
+            if (availableCopies.compare_exchange_weak(available, available + 1)) return;
+        }
     }
 };
 
 // BorrowRecord class implementation
 class BorrowRecord {
+public:
+    static constexpr hours LOAN_PERIOD{24 * 14};
+    static const int MAX_RENEWALS = 2;
+
 private:
     string userId;
     string bookIsbn;
     system_clock::time_point borrowDate;
     system_clock::time_point dueDate;
     int renewalCount;
-    bool isReturned;
+    bool returned;
 
 public:
     BorrowRecord(const string& userId, const string& bookIsbn)
         : userId(userId), bookIsbn(bookIsbn), borrowDate(system_clock::now()),
-          renewalCount(0), isReturned(false) {
-        dueDate = borrowDate + hours(24 * 14); // 14 days
+          renewalCount(0), returned(false) {
+        dueDate = borrowDate + LOAN_PERIOD;
     }
     
+    // Rebuilds a record from the snapshot or the WAL
+    BorrowRecord(const string& userId, const string& bookIsbn, system_clock::time_point borrowDate,
+                 system_clock::time_point dueDate, int renewalCount, bool returned)
+        : userId(userId), bookIsbn(bookIsbn), borrowDate(borrowDate), dueDate(dueDate),
+          renewalCount(renewalCount), returned(returned) {}
+    
+    string getUserId() const { return userId; }
+    string getBookIsbn() const { return bookIsbn; }
+    system_clock::time_point getBorrowDate() const { return borrowDate; }
+    system_clock::time_point getDueDate() const { return dueDate; }
+    int getRenewalCount() const { return renewalCount; }
+    bool isReturned() const { return returned; }
+    
     bool isOverdue() const {
-        return !isReturned && system_clock::now() > dueDate;
+        return !returned && system_clock::now() > dueDate;
     }
     
     double calculateFine() const {
@@ -138,320 +144,2204 @@ public:
     }
     
     bool canRenew() const {
-        return !isReturned && renewalCount < 2;
+        return !returned && renewalCount < MAX_RENEWALS;
     }
     
     void renew() {
         if (canRenew()) {
-            dueDate += hours(24 * 14); // Add 14 days
+            dueDate += LOAN_PERIOD;
             renewalCount++;
         }
     }
     
     void markAsReturned() {
-        isReturned = true;
+        returned = true;
     }
 };
 
-// BookCatalog class implementation
-class BookCatalog {
+// User class implementation
+class User {
 private:
-    unordered_map<string, Book> booksByIsbn;
-    unordered_multimap<string, string> booksByTitle;
-    unordered_multimap<string, string> booksByAuthor;
-    mutex catalogMutex;
+    string id;
+    string name;
+    string email;
+    UserType type;
+    double fineAmount;
+    vector<BorrowRecord> borrowHistory;
+    mutable mutex userMutex;
 
 public:
-    void addBook(const Book& book) {
-        lock_guard<mutex> lock(catalogMutex);
-        booksByIsbn[book.getIsbn()] = book;
-        booksByTitle.insert({book.getTitle(), book.getIsbn()});
-        booksByAuthor.insert({book.getAuthor(), book.getIsbn()});
-    }
+    User(const string& name, const string& email, UserType type)
+        : id(generateId()), name(name), email(email), type(type), fineAmount(0.0) {}
     
-    void removeBook(const string& isbn) {
-        lock_guard<mutex> lock(catalogMutex);
-        auto it = booksByIsbn.find(isbn);
-        if (it != booksByIsbn.end()) {
-            booksByTitle.erase(it->second.getTitle());
-            booksByAuthor.erase(it->second.getAuthor());
-            booksByIsbn.erase(it);
+    // Restores a user under its existing id; ids handed out later skip past it
+    User(const string& id, const string& name, const string& email, UserType type)
+        : id(id), name(name), email(email), type(type), fineAmount(0.0) {
+        if (id.compare(0, 4, "USER") == 0) {
+            int number = atoi(id.c_str() + 4);
+            int current = idCounter().load();
+            while (current < number && !idCounter().compare_exchange_weak(current, number)) {}
         }
     }
     
-    Book* getBook(const string& isbn) {
-        lock_guard<mutex> lock(catalogMutex);
-        auto it = booksByIsbn.find(isbn);
-        return it != booksByIsbn.end() ? &it->second : nullptr;
+    // Copies the data, not the lock
+    User(const User& other) {
+        lock_guard<mutex> lock(other.userMutex);
+        id = other.id;
+        name = other.name;
+        email = other.email;
+        type = other.type;
+        fineAmount = other.fineAmount;
+        borrowHistory = other.borrowHistory;
     }
     
-    vector<Book> searchByTitle(const string& title) {
-        lock_guard<mutex> lock(catalogMutex);
-        vector<Book> results;
-        auto range = booksByTitle.equal_range(title);
-        for (auto it = range.first; it != range.second; ++it) {
-            results.push_back(booksByIsbn[it->second]);
+    User& operator=(const User& other) {
+        if (this != &other) {
+            lock(userMutex, other.userMutex);
+            lock_guard<mutex> ownLock(userMutex, adopt_lock);
+            lock_guard<mutex> otherLock(other.userMutex, adopt_lock);
+            id = other.id;
+            name = other.name;
+            email = other.email;
+            type = other.type;
+            fineAmount = other.fineAmount;
+            borrowHistory = other.borrowHistory;
         }
-        return results;
+        return *this;
     }
     
-    vector<Book> searchByAuthor(const string& author) {
-        lock_guard<mutex> lock(catalogMutex);
-        vector<Book> results;
-        auto range = booksByAuthor.equal_range(author);
-        for (auto it = range.first; it != range.second; ++it) {
-            results.push_back(booksByIsbn[it->second]);
-        }
-        return results;
-    }
-};
-
-// UserManager class implementation
-class UserManager {
-private:
-    unordered_map<string, User> users;
-    mutex userManagerMutex;
-
-public:
-    string registerUser(const string& name, const string& email, UserType type) {
-        lock_guard<mutex> lock(userManagerMutex);
-        User user(name, email, type);
-        string id = user.getId();
-        users[id] = user;
+    string getId() const {
+        lock_guard<mutex> lock(userMutex);
         return id;
     }
     
-    User* getUser(const string& id) {
-        lock_guard<mutex> lock(userManagerMutex);
-        auto it = users.find(id);
-        return it != users.end() ? &it->second : nullptr;
+    string getName() const {
+        lock_guard<mutex> lock(userMutex);
+        return name;
     }
     
-    void updateUser(const User& user) {
-        lock_guard<mutex> lock(userManagerMutex);
-        users[user.getId()] = user;
+    string getEmail() const {
+        lock_guard<mutex> lock(userMutex);
+        return email;
     }
     
-    void removeUser(const string& id) {
-        lock_guard<mutex> lock(userManagerMutex);
-        users.erase(id);
+    UserType getType() const {
+        lock_guard<mutex> lock(userMutex);
+        return type;
+    }
+    
+    // Takes name, email and type from the other user; fines and borrow
+    // history recorded here meanwhile are kept
+    void updateProfile(const User& other) {
+        if (this == &other) return;
+        lock(userMutex, other.userMutex);
+        lock_guard<mutex> ownLock(userMutex, adopt_lock);
+        lock_guard<mutex> otherLock(other.userMutex, adopt_lock);
+        name = other.name;
+        email = other.email;
+        type = other.type;
+    }
+    
+    double getFineAmount() const {
+        lock_guard<mutex> lock(userMutex);
+        return fineAmount;
+    }
+    
+    void addFine(double amount) {
+        lock_guard<mutex> lock(userMutex);
+        fineAmount += amount;
+    }
+    
+    void payFine(double amount) {
+        lock_guard<mutex> lock(userMutex);
+        fineAmount = max(0.0, fineAmount - amount);
+    }
+    
+    bool canBorrow() const {
+        lock_guard<mutex> lock(userMutex);
+        return fineAmount < 50.0 && borrowHistory.size() < 5;
+    }
+    
+    void addBorrowRecord(const BorrowRecord& record) {
+        lock_guard<mutex> lock(userMutex);
+        borrowHistory.push_back(record);
     }
-};
 
-// BorrowingManager class implementation
-class BorrowingManager {
 private:
-    unordered_map<string, vector<BorrowRecord>> userBorrowRecords;
-    unordered_map<string, vector<string>> bookBorrowers;
-    mutex borrowingMutex;
+    static atomic<int>& idCounter() {
+        static atomic<int> counter(0);
+        return counter;
+    }
+    
+    string generateId() {
+        return "USER" + to_string(++idCounter());
+    }
+};
 
-public:
-    bool borrowBook(const string& userId, const string& isbn) {
-        lock_guard<mutex> lock(borrowingMutex);
+// TextIndex class implementation
+// Inverted index from lower-cased word tokens to sorted posting lists of
+// document ids, with a trie over the tokens for prefix lookups. A query
+// matches documents containing every query word; the last word also
+// matches as a prefix, so partially typed queries find results.
+class TextIndex {
+private:
+    struct TrieNode {
+        vector<pair<char, uint32_t>> children;  // sorted by character
+        int32_t token = -1;                     // posting list ending here
+    };
+    
+    vector<TrieNode> trie;              // node 0 is the root
+    vector<vector<uint32_t>> postings;  // by token
+    
+    // Walks the union of one or more posting lists in id order without
+    // copying them; a prefix word gets one list per token below it
+    class Cursor {
+    private:
+        vector<pair<const uint32_t*, const uint32_t*>> ranges;  // unread part of each list
+        size_t total = 0;
+        uint32_t current = 0;
+    
+    public:
+        void addList(const vector<uint32_t>& list) {
+            if (list.empty()) return;
+            ranges.push_back({list.data(), list.data() + list.size()});
+            total += list.size();
+        }
         
-        // Check if user has reached borrowing limit
-        if (userBorrowRecords[userId].size() >= 5) {
-            return false;
+        void start() {
+            Metrics::add(scannedCounter(), ranges.size());
+            settle();
         }
         
-        // Create borrow record
-        BorrowRecord record(userId, isbn);
-        userBorrowRecords[userId].push_back(record);
-        bookBorrowers[isbn].push_back(userId);
+        bool atEnd() const { return ranges.empty(); }
+        uint32_t doc() const { return current; }
+        size_t size() const { return total; }
         
-        return true;
-    }
-    
-    bool returnBook(const string& userId, const string& isbn) {
-        lock_guard<mutex> lock(borrowingMutex);
+        // Moves to the first id not below the target
+        void seek(uint32_t target) {
+            if (atEnd() || current >= target) return;
+            
+            uint64_t landed = 0;
+            for (auto& range : ranges) {
+                if (*range.first >= target) continue;
+                range.first = lower_bound(range.first, range.second, target);
+                if (range.first != range.second) landed++;
+            }
+            Metrics::add(scannedCounter(), landed);
+            settle();
+        }
         
-        auto& records = userBorrowRecords[userId];
-        auto it = find_if(records.begin(), records.end(),
-            [&](const BorrowRecord& record) {
-                return record.getBookIsbn() == isbn && !record.isReturned();
-            });
+        void next() { seek(current + 1); }
+    
+    private:
+        static int scannedCounter() {
+            static const int id = Metrics::counter("library.postings_scanned");
+            return id;
+        }
         
-        if (it != records.end()) {
-            it->markAsReturned();
-            return true;
+        void settle() {
+            ranges.erase(remove_if(ranges.begin(), ranges.end(),
+                                   [](const pair<const uint32_t*, const uint32_t*>& range) {
+                                       return range.first == range.second;
+                                   }),
+                         ranges.end());
+            if (ranges.empty()) return;
+            current = *ranges[0].first;
+            for (const auto& range : ranges) {
+                current = min(current, *range.first);
+            }
+        }
+    };
+
+public:
+    // Lazily intersected matches of one query, in increasing id order. It
+    // points into the index, so it must not outlive the caller's lock.
+    class Matches {
+    private:
+        vector<Cursor> cursors;  // the shortest list leads
+        bool started = false;
+    
+    public:
+        explicit Matches(vector<Cursor> words) : cursors(move(words)) {
+            for (const Cursor& cursor : cursors) {
+                if (cursor.size() == 0) {
+                    cursors.clear();
+                    return;
+                }
+            }
+            sort(cursors.begin(), cursors.end(),
+                 [](const Cursor& a, const Cursor& b) { return a.size() < b.size(); });
+            for (Cursor& cursor : cursors) {
+                cursor.start();
+            }
         }
         
-        return false;
+        // Leapfrogs the other lists to the lead's id until every list agrees,
+        // reading only the postings up to the returned match
+        bool next(uint32_t& doc) {
+            if (cursors.empty()) return false;
+            Cursor& lead = cursors[0];
+            if (started) lead.next();
+            started = true;
+            
+            while (!lead.atEnd()) {
+                uint32_t candidate = lead.doc();
+                size_t i = 1;
+                for (; i < cursors.size(); i++) {
+                    cursors[i].seek(candidate);
+                    if (cursors[i].atEnd()) {
+                        cursors.clear();
+                        return false;
+                    }
+                    if (cursors[i].doc() != candidate) break;
+                }
+                if (i == cursors.size()) {
+                    doc = candidate;
+                    return true;
+                }
+                lead.seek(cursors[i].doc());
+            }
+            cursors.clear();
+            return false;
+        }
+    };
+    
+    TextIndex() : trie(1) {}
+    
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        string token;
+        for (char c : text) {
+            if (isalnum(static_cast<unsigned char>(c))) {
+                token += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            } else if (!token.empty()) {
+                tokens.push_back(token);
+                token.clear();
+            }
+        }
+        if (!token.empty()) tokens.push_back(token);
+        return tokens;
     }
     
-    bool renewBook(const string& userId, const string& isbn) {
-        lock_guard<mutex> lock(borrowingMutex);
+    // Document ids must be added in increasing order so postings stay sorted
+    void add(uint32_t doc, const string& text) {
+        for (const string& token : tokenize(text)) {
+            vector<uint32_t>& list = postings[insertToken(token)];
+            if (list.empty() || list.back() != doc) list.push_back(doc);
+        }
+    }
+    
+    // Drops the given documents from the postings of their own tokens only,
+    // one pass per affected posting list however many documents share it
+    void remove(const vector<pair<uint32_t, string>>& docs) {
+        unordered_map<int32_t, vector<uint32_t>> removals;
+        for (const auto& doc : docs) {
+            for (const string& token : tokenize(doc.second)) {
+                int32_t node = findNode(token);
+                if (node >= 0 && trie[node].token >= 0) {
+                    removals[trie[node].token].push_back(doc.first);
+                }
+            }
+        }
         
-        auto& records = userBorrowRecords[userId];
-        auto it = find_if(records.begin(), records.end(),
-            [&](const BorrowRecord& record) {
-                return record.getBookIsbn() == isbn && !record.isReturned();
-            });
+        for (auto& removal : removals) {
+            vector<uint32_t>& ids = removal.second;
+            sort(ids.begin(), ids.end());
+            vector<uint32_t>& list = postings[removal.first];
+            if (ids.size() == 1) {
+                auto it = lower_bound(list.begin(), list.end(), ids[0]);
+                if (it != list.end() && *it == ids[0]) list.erase(it);
+            } else {
+                vector<uint32_t> kept;
+                kept.reserve(list.size());
+                set_difference(list.begin(), list.end(), ids.begin(), ids.end(), back_inserter(kept));
+                list.swap(kept);
+            }
+        }
+    }
+    
+    // Documents matching every word of the query, produced on demand so a
+    // page of results reads only the postings up to its last hit
+    Matches search(const string& query) const {
+        vector<string> tokens = tokenize(query);
+        if (tokens.empty()) return Matches(vector<Cursor>());
         
-        if (it != records.end() && it->canRenew()) {
-            it->renew();
-            return true;
+        vector<Cursor> words(tokens.size());
+        for (size_t i = 0; i + 1 < tokens.size(); i++) {
+            int32_t node = findNode(tokens[i]);
+            if (node < 0 || trie[node].token < 0) return Matches(vector<Cursor>());
+            words[i].addList(postings[trie[node].token]);
         }
         
-        return false;
+        int32_t node = findNode(tokens.back());
+        if (node < 0) return Matches(vector<Cursor>());
+        addPrefixPostings(node, words.back());
+        return Matches(move(words));
+    }
+
+private:
+    int32_t findNode(const string& text) const {
+        uint32_t node = 0;
+        for (char c : text) {
+            const auto& children = trie[node].children;
+            auto it = lower_bound(children.begin(), children.end(), make_pair(c, 0u));
+            if (it == children.end() || it->first != c) return -1;
+            node = it->second;
+        }
+        return static_cast<int32_t>(node);
     }
     
-    vector<BorrowRecord> getUserBorrowHistory(const string& userId) {
-        lock_guard<mutex> lock(borrowingMutex);
-        return userBorrowRecords[userId];
+    uint32_t insertToken(const string& token) {
+        uint32_t node = 0;
+        for (char c : token) {
+            auto& children = trie[node].children;
+            auto it = lower_bound(children.begin(), children.end(), make_pair(c, 0u));
+            if (it == children.end() || it->first != c) {
+                uint32_t child = static_cast<uint32_t>(trie.size());
+                children.insert(it, {c, child});
+                trie.emplace_back();
+                node = child;
+            } else {
+                node = it->second;
+            }
+        }
+        if (trie[node].token < 0) {
+            trie[node].token = static_cast<int32_t>(postings.size());
+            postings.emplace_back();
+        }
+        return static_cast<uint32_t>(trie[node].token);
     }
     
-    vector<string> getBookBorrowers(const string& isbn) {
-        lock_guard<mutex> lock(borrowingMutex);
-        return bookBorrowers[isbn];
+    // Adds the postings of every token below a trie node to the cursor
+    void addPrefixPostings(int32_t root, Cursor& cursor) const {
+        vector<uint32_t> stack = {static_cast<uint32_t>(root)};
+        while (!stack.empty()) {
+            uint32_t node = stack.back();
+            stack.pop_back();
+            if (trie[node].token >= 0) {
+                cursor.addList(postings[trie[node].token]);
+            }
+            for (const auto& child : trie[node].children) {
+                stack.push_back(child.second);
+            }
+        }
     }
 };
 
-// FineManager class implementation
-class FineManager {
+// Shared handles stay valid after the lookup's lock is released, and after
+// the entry is removed from its manager
+typedef shared_ptr<Book> BookHandle;
+typedef shared_ptr<User> UserHandle;
+
+// One catalog change for the batch APIs
+struct BookEntry {
+    string isbn;
+    string title;
+    string author;
+    int copies;
+};
+
+// One page of search hits as ISBNs, and whether a later page has more
+struct SearchPage {
+    vector<string> isbns;
+    bool hasMore;
+};
+
+// MappedFile class implementation
+// Read-only mapping of a whole file; a missing or empty file maps to nothing
+class MappedFile {
 private:
-    unordered_map<string, double> userFines;
-    mutex fineMutex;
+    const char* data;
+    size_t size;
 
 public:
-    void addFine(const string& userId, double amount) {
-        lock_guard<mutex> lock(fineMutex);
-        userFines[userId] += amount;
-    }
-    
-    void payFine(const string& userId, double amount) {
-        lock_guard<mutex> lock(fineMutex);
-        userFines[userId] = max(0.0, userFines[userId] - amount);
+    explicit MappedFile(const string& path) : data(nullptr), size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const char*>(mapped);
+                size = info.st_size;
+            }
+        }
+        ::close(fd);
     }
     
-    double getUserFine(const string& userId) {
-        lock_guard<mutex> lock(fineMutex);
-        return userFines[userId];
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), size);
     }
     
-    bool canBorrow(const string& userId) {
-        lock_guard<mutex> lock(fineMutex);
-        return userFines[userId] < 50.0;
-    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
     
-    void generateFineReport() {
-        lock_guard<mutex> lock(fineMutex);
-        // Implementation of fine report generation
-    }
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
 };
 
-// Report class implementation
-class Report {
+// WalRecord class implementation
+// One logged mutation: a type byte followed by its fields. Fields are read
+// back in the order they were added.
+class WalRecord {
 private:
-    system_clock::time_point startDate;
-    system_clock::time_point endDate;
-    ReportType type;
+    string bytes;
+    size_t readPos;
 
 public:
-    Report(ReportType type) : type(type) {
-        startDate = system_clock::now() - hours(24 * 30); // Last 30 days
-        endDate = system_clock::now();
-    }
+    explicit WalRecord(WalRecordType type) : bytes(1, static_cast<char>(type)), readPos(1) {}
+    WalRecord(const char* data, size_t size) : bytes(data, size), readPos(1) {}
     
-    void setDateRange(system_clock::time_point start,
-                     system_clock::time_point end) {
-        startDate = start;
-        endDate = end;
+    WalRecordType getType() const { return static_cast<WalRecordType>(bytes[0]); }
+    const string& getBytes() const { return bytes; }
+    
+    WalRecord& addInt(int64_t value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
     }
     
-    string generateBookAvailabilityReport() {
-        // Implementation of book availability report
-        return "Book Availability Report";
+    WalRecord& addDouble(double value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
     }
     
-    string generatePopularBooksReport() {
-        // Implementation of popular books report
-        return "Popular Books Report";
+    WalRecord& addTime(system_clock::time_point time) {
+        return addInt(toMicros(time));
     }
     
-    string generateBorrowingPatternReport() {
-        // Implementation of borrowing pattern report
-        return "Borrowing Pattern Report";
+    WalRecord& addString(const string& value) {
+        addInt(static_cast<int64_t>(value.size()));
+        bytes += value;
+        return *this;
     }
     
-    string generateFineCollectionReport() {
-        // Implementation of fine collection report
-        return "Fine Collection Report";
+    int64_t readInt() {
+        int64_t value;
+        read(&value, sizeof(value));
+        return value;
     }
-};
-
-// LibrarySystem class implementation (Singleton)
-class LibrarySystem {
-private:
-    static LibrarySystem* instance;
-    static mutex instanceMutex;
     
-    BookCatalog bookCatalog;
-    UserManager userManager;
-    BorrowingManager borrowingManager;
-    FineManager fineManager;
+    double readDouble() {
+        double value;
+        read(&value, sizeof(value));
+        return value;
+    }
     
-    LibrarySystem() = default;
+    system_clock::time_point readTime() {
+        return fromMicros(readInt());
+    }
     
-public:
-    static LibrarySystem* getInstance() {
-        lock_guard<mutex> lock(instanceMutex);
-        if (!instance) {
-            instance = new LibrarySystem();
+    string readString() {
+        int64_t length = readInt();
+        if (length < 0 || static_cast<size_t>(length) > bytes.size() - readPos) {
+            throw runtime_error("Malformed WAL record");
         }
-        return instance;
+        string value = bytes.substr(readPos, length);
+        readPos += length;
+        return value;
     }
     
-    string addBook(const string& isbn, const string& title, const string& author) {
-        Book book(isbn, title, author);
-        bookCatalog.addBook(book);
-        return isbn;
+    static int64_t toMicros(system_clock::time_point time) {
+        return duration_cast<microseconds>(time.time_since_epoch()).count();
     }
     
-    string registerUser(const string& name, const string& email, UserType type) {
-        return userManager.registerUser(name, email, type);
+    static system_clock::time_point fromMicros(int64_t micros) {
+        return system_clock::time_point(duration_cast<system_clock::duration>(microseconds(micros)));
+    }
+
+private:
+    void read(void* out, size_t size) {
+        if (size > bytes.size() - readPos) throw runtime_error("Malformed WAL record");
+        memcpy(out, bytes.data() + readPos, size);
+        readPos += size;
     }
+};
+
+// WriteAheadLog class implementation
+// Append-only file of framed records: a header naming the snapshot
+// generation the log applies to, then per record its length, an FNV-1a
+// checksum and the payload. Replay stops at the first torn or corrupt
+// frame, and the file is cut back to the last intact one.
+class WriteAheadLog {
+private:
+    static constexpr char MAGIC[8] = {'L', 'I', 'B', 'W', 'A', 'L', '0', '1'};
+    static const size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint64_t);
     
-    bool borrowBook(const string& userId, const string& isbn) {
-        User* user = userManager.getUser(userId);
-        Book* book = bookCatalog.getBook(isbn);
-        
-        if (!user || !book || !user->canBorrow() || !book->isAvailable()) {
-            return false;
-        }
-        
-        if (borrowingManager.borrowBook(userId, isbn)) {
-            book->decrementCopies();
-            return true;
+    int fd;
+    bool syncOnAppend;
+    atomic<size_t> recordCount;  // since the last reset
+    mutex walMutex;
+
+public:
+    explicit WriteAheadLog(bool syncOnAppend = true) : fd(-1), syncOnAppend(syncOnAppend), recordCount(0) {}
+    
+    ~WriteAheadLog() {
+        if (fd >= 0) ::close(fd);
+    }
+    
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    
+    // Feeds every intact record of the log at path to apply if the log
+    // belongs to generation, then opens it for appending after them
+    void open(const string& path, uint64_t generation, const function<void(WalRecord&)>& apply) {
+        size_t validLength = 0;
+        size_t replayed = 0;
+        {
+            MappedFile file(path);
+            const char* data = file.getData();
+            if (file.getSize() >= HEADER_SIZE && memcmp(data, MAGIC, sizeof(MAGIC)) == 0) {
+                uint64_t logGeneration;
+                memcpy(&logGeneration, data + sizeof(MAGIC), sizeof(logGeneration));
+                if (logGeneration > generation) throw runtime_error("WAL is newer than the snapshot: " + path);
+                if (logGeneration == generation) {
+                    validLength = HEADER_SIZE;
+                    uint32_t frame[2];  // length, checksum
+                    while (file.getSize() - validLength >= sizeof(frame)) {
+                        memcpy(frame, data + validLength, sizeof(frame));
+                        const char* payload = data + validLength + sizeof(frame);
+                        if (frame[0] == 0 || frame[0] > file.getSize() - validLength - sizeof(frame) ||
+                            checksum(payload, frame[0]) != frame[1]) {
+                            break;
+                        }
+                        WalRecord record(payload, frame[0]);
+                        apply(record);
+                        validLength += sizeof(frame) + frame[0];
+                        replayed++;
+                    }
+                }
+            }
         }
         
-        return false;
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw runtime_error("Cannot open WAL: " + path);
+        if (ftruncate(fd, validLength) != 0) throw runtime_error("Cannot truncate WAL: " + path);
+        if (validLength == 0) writeHeader(generation);
+        recordCount = replayed;
     }
     
-    bool returnBook(const string& userId, const string& isbn) {
-        if (borrowingManager.returnBook(userId, isbn)) {
-            Book* book = bookCatalog.getBook(isbn);
-            if (book) {
-                book->incrementCopies();
-            }
-            return true;
+    void append(const WalRecord& record) {
+        append(vector<WalRecord>{record});
+    }
+    
+    // A batch goes out in one write and one sync
+    void append(const vector<WalRecord>& records) {
+        string frames;
+        for (const WalRecord& record : records) {
+            const string& bytes = record.getBytes();
+            uint32_t frame[2] = {static_cast<uint32_t>(bytes.size()), checksum(bytes.data(), bytes.size())};
+            frames.append(reinterpret_cast<const char*>(frame), sizeof(frame));
+            frames += bytes;
         }
-        return false;
+        lock_guard<mutex> lock(walMutex);
+        writeAll(frames.data(), frames.size());
+        if (syncOnAppend) fdatasync(fd);
+        recordCount += records.size();
     }
     
-    vector<Book> searchBooks(const string& query) {
-        vector<Book> results;
-        vector<Book> titleResults = bookCatalog.searchByTitle(query);
-        vector<Book> authorResults = bookCatalog.searchByAuthor(query);
-        
-        results.insert(results.end(), titleResults.begin(), titleResults.end());
-        results.insert(results.end(), authorResults.begin(), authorResults.end());
-        
-        return results;
+    // Empties the log once a snapshot of the given generation is durable
+    void reset(uint64_t generation) {
+        lock_guard<mutex> lock(walMutex);
+        if (ftruncate(fd, 0) != 0) throw runtime_error("Cannot truncate WAL");
+        writeHeader(generation);
+        recordCount = 0;
     }
     
-    Report generateReport(ReportType type) {
-        return Report(type);
+    size_t getRecordCount() const { return recordCount.load(); }
+
+private:
+    void writeHeader(uint64_t generation) {
+        char header[HEADER_SIZE];
+        memcpy(header, MAGIC, sizeof(MAGIC));
+        memcpy(header + sizeof(MAGIC), &generation, sizeof(generation));
+        writeAll(header, sizeof(header));
+        fdatasync(fd);
+    }
+    
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) throw runtime_error("WAL write failed");
+            data += written;
+            size -= written;
+        }
+    }
+    
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+// BookCatalog class implementation
+// Books get a dense document id in insertion order; the title and author
+// indexes store those ids rather than ISBN strings. Ids are not reused, so
+// postings stay sorted by appending. Lookups and searches share the lock;
+// only catalog changes take it exclusively.
+class BookCatalog {
+private:
+    vector<BookHandle> books;  // by document id, null once removed
+    unordered_map<string, uint32_t> idByIsbn;
+    TextIndex titleIndex;
+    TextIndex authorIndex;
+    WriteAheadLog* journal = nullptr;
+    mutable InstrumentedSharedMutex catalogMutex{"library.catalog_lock"};
+
+public:
+    // Catalog changes are logged under the catalog lock, in the order applied
+    void setJournal(WriteAheadLog* wal) {
+        journal = wal;
+    }
+    
+    // Adding an ISBN the catalog already has adds copies to it
+    void addBook(const string& isbn, const string& title, const string& author, int copies = 1) {
+        unique_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        addBookLocked(isbn, title, author, copies);
+        if (journal) journal->append(bookRecord(isbn, title, author, copies));
+    }
+    
+    // Bulk feed: the whole batch goes in under one lock
+    void addBooks(const vector<BookEntry>& entries) {
+        unique_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        books.reserve(books.size() + entries.size());
+        for (const BookEntry& entry : entries) {
+            addBookLocked(entry.isbn, entry.title, entry.author, entry.copies);
+        }
+        if (journal) {
+            vector<WalRecord> records;
+            records.reserve(entries.size());
+            for (const BookEntry& entry : entries) {
+                records.push_back(bookRecord(entry.isbn, entry.title, entry.author, entry.copies));
+            }
+            journal->append(records);
+        }
+    }
+    
+    void removeBook(const string& isbn) {
+        removeBooks({isbn});
+    }
+    
+    // Removes only the listed ISBNs from the indexes; returns how many
+    // were in the catalog
+    size_t removeBooks(const vector<string>& isbns) {
+        unique_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        
+        vector<pair<uint32_t, string>> titles, authors;
+        vector<WalRecord> records;
+        for (const string& isbn : isbns) {
+            auto it = idByIsbn.find(isbn);
+            if (it == idByIsbn.end()) continue;
+            
+            if (journal) records.push_back(WalRecord(WalRecordType::REMOVE_BOOK).addString(isbn));
+            const Book& book = *books[it->second];
+            titles.emplace_back(it->second, book.getTitle());
+            authors.emplace_back(it->second, book.getAuthor());
+            books[it->second].reset();
+            idByIsbn.erase(it);
+        }
+        titleIndex.remove(titles);
+        authorIndex.remove(authors);
+        if (!records.empty()) journal->append(records);
+        return titles.size();
+    }
+    
+    // The handle keeps the book alive even if it is removed meanwhile
+    BookHandle getBook(const string& isbn) const {
+        shared_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        auto it = idByIsbn.find(isbn);
+        return it != idByIsbn.end() ? books[it->second] : nullptr;
+    }
+    
+    SearchPage searchByTitle(const string& query, size_t offset = 0, size_t limit = 20) const {
+        ScopedTimer timer(searchTimer());
+        shared_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        TextIndex::Matches matches = titleIndex.search(query);
+        return makePage([&matches](uint32_t& doc) { return matches.next(doc); }, offset, limit);
+    }
+    
+    SearchPage searchByAuthor(const string& query, size_t offset = 0, size_t limit = 20) const {
+        ScopedTimer timer(searchTimer());
+        shared_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        TextIndex::Matches matches = authorIndex.search(query);
+        return makePage([&matches](uint32_t& doc) { return matches.next(doc); }, offset, limit);
+    }
+    
+    // Books whose title or author matches, each listed once
+    SearchPage search(const string& query, size_t offset = 0, size_t limit = 20) const {
+        ScopedTimer timer(searchTimer());
+        shared_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        TextIndex::Matches titles = titleIndex.search(query);
+        TextIndex::Matches authors = authorIndex.search(query);
+        uint32_t titleDoc = 0, authorDoc = 0;
+        bool hasTitle = titles.next(titleDoc);
+        bool hasAuthor = authors.next(authorDoc);
+        
+        // Merges the two streams, taking a book found by both once
+        auto next = [&](uint32_t& doc) {
+            if (!hasTitle && !hasAuthor) return false;
+            bool takeTitle = hasTitle && (!hasAuthor || titleDoc <= authorDoc);
+            bool takeAuthor = hasAuthor && (!hasTitle || authorDoc <= titleDoc);
+            doc = takeTitle ? titleDoc : authorDoc;
+            if (takeTitle) hasTitle = titles.next(titleDoc);
+            if (takeAuthor) hasAuthor = authors.next(authorDoc);
+            return true;
+        };
+        return makePage(next, offset, limit);
+    }
+    
+    // Every book in the catalog, with its total copies
+    vector<BookEntry> exportBooks() const {
+        shared_lock<InstrumentedSharedMutex> lock(catalogMutex);
+        vector<BookEntry> entries;
+        entries.reserve(idByIsbn.size());
+        for (const BookHandle& book : books) {
+            if (book) entries.push_back({book->getIsbn(), book->getTitle(), book->getAuthor(), book->getTotalCopies()});
+        }
+        return entries;
+    }
+
+private:
+    static int searchTimer() {
+        static const int id = Metrics::histogram("library.search_ns");
+        return id;
+    }
+    
+    static WalRecord bookRecord(const string& isbn, const string& title, const string& author, int copies) {
+        WalRecord record(WalRecordType::ADD_BOOK);
+        record.addString(isbn).addString(title).addString(author).addInt(copies);
+        return record;
+    }
+    
+    
+    void addBookLocked(const string& isbn, const string& title, const string& author, int copies) {
+        auto it = idByIsbn.find(isbn);
+        if (it != idByIsbn.end()) {
+            books[it->second]->incrementCopies(copies);
+            return;
+        }
+        
+        uint32_t id = static_cast<uint32_t>(books.size());
+        books.push_back(make_shared<Book>(isbn, title, author, copies));
+        idByIsbn[isbn] = id;
+        titleIndex.add(id, title);
+        authorIndex.add(id, author);
+    }
+    
+    // Pulls matches from the source only until the page is full and one
+    // more match shows whether another page exists
+    template <typename Source>
+    SearchPage makePage(Source next, size_t offset, size_t limit) const {
+        SearchPage page = {{}, false};
+        uint32_t doc;
+        for (size_t i = 0; i < offset; i++) {
+            if (!next(doc)) return page;
+        }
+        while (page.isbns.size() < limit && next(doc)) {
+            page.isbns.push_back(books[doc]->getIsbn());
+        }
+        page.hasMore = page.isbns.size() == limit && next(doc);
+        return page;
+    }
+};
+
+// UserManager class implementation
+class UserManager {
+private:
+    unordered_map<string, UserHandle> users;
+    WriteAheadLog* journal = nullptr;
+    mutable shared_mutex userManagerMutex;
+
+public:
+    void setJournal(WriteAheadLog* wal) {
+        journal = wal;
+    }
+    
+    string registerUser(const string& name, const string& email, UserType type) {
+        UserHandle user = make_shared<User>(name, email, type);
+        string id = user->getId();
+        unique_lock<shared_mutex> lock(userManagerMutex);
+        users.emplace(id, user);
+        if (journal) {
+            journal->append(WalRecord(WalRecordType::REGISTER_USER).addString(id).addString(name)
+                            .addString(email).addInt(static_cast<int64_t>(type)));
+        }
+        return id;
+    }
+    
+    // Recovery path: re-adds a user under its original id, unlogged
+    void restoreUser(const string& id, const string& name, const string& email, UserType type) {
+        UserHandle user = make_shared<User>(id, name, email, type);
+        unique_lock<shared_mutex> lock(userManagerMutex);
+        users[id] = user;
+    }
+    
+    vector<UserHandle> exportUsers() const {
+        shared_lock<shared_mutex> lock(userManagerMutex);
+        vector<UserHandle> result;
+        result.reserve(users.size());
+        for (const auto& entry : users) {
+            result.push_back(entry.second);
+        }
+        return result;
+    }
+    
+    UserHandle getUser(const string& id) const {
+        shared_lock<shared_mutex> lock(userManagerMutex);
+        auto it = users.find(id);
+        return it != users.end() ? it->second : nullptr;
+    }
+    
+    // Updates the profile under the user's own lock, so only the map is
+    // shared; holders of the handle see the change, not a torn string
+    void updateUser(const User& user) {
+        shared_lock<shared_mutex> lock(userManagerMutex);
+        auto it = users.find(user.getId());
+        if (it != users.end()) {
+            it->second->updateProfile(user);
+        }
+    }
+    
+    void removeUser(const string& id) {
+        unique_lock<shared_mutex> lock(userManagerMutex);
+        users.erase(id);
+    }
+};
+
+// IdInterner class implementation
+// Maps string ids to dense 32-bit keys, handed out in first-seen order and
+// never reused. Lookups share the lock; only a new id takes it exclusively.
+class IdInterner {
+private:
+    unordered_map<string, uint32_t> keys;
+    vector<string> ids;
+    mutable shared_mutex internMutex;
+
+public:
+    static const uint32_t NONE = UINT32_MAX;
+    
+    uint32_t intern(const string& id) {
+        uint32_t key = find(id);
+        if (key != NONE) return key;
+        
+        unique_lock<shared_mutex> lock(internMutex);
+        auto it = keys.emplace(id, static_cast<uint32_t>(ids.size()));
+        if (it.second) ids.push_back(id);
+        return it.first->second;
+    }
+    
+    // NONE if the id has never been interned
+    uint32_t find(const string& id) const {
+        shared_lock<shared_mutex> lock(internMutex);
+        auto it = keys.find(id);
+        return it != keys.end() ? it->second : NONE;
+    }
+    
+    string getId(uint32_t key) const {
+        shared_lock<shared_mutex> lock(internMutex);
+        return ids.at(key);
+    }
+    
+    size_t size() const {
+        shared_lock<shared_mutex> lock(internMutex);
+        return ids.size();
+    }
+};
+
+// One numbering of user ids and ISBNs for every loan component, so the
+// borrowing manager hands its keys to the scheduler and the ledger as is
+struct LoanIds {
+    IdInterner users;
+    IdInterner books;
+};
+
+// ChunkedArray class implementation
+// Grow-only array of default-constructed slots allocated in fixed blocks,
+// so a slot never moves once it exists. Block pointers are published
+// atomically, so indexing takes no lock; only growing does.
+template <typename T>
+class ChunkedArray {
+private:
+    static const size_t BLOCK_SIZE = 4096;
+    static const size_t MAX_BLOCKS = 16384;  // 64M slots
+    
+    unique_ptr<atomic<T*>[]> blocks;
+    size_t blockCount;
+    mutex growMutex;
+
+public:
+    ChunkedArray() : blocks(new atomic<T*>[MAX_BLOCKS]()), blockCount(0) {}
+    
+    ~ChunkedArray() {
+        for (size_t i = 0; i < blockCount; i++) {
+            delete[] blocks[i].load();
+        }
+    }
+    
+    ChunkedArray(const ChunkedArray&) = delete;
+    ChunkedArray& operator=(const ChunkedArray&) = delete;
+    
+    // The slot must exist; see ensure
+    T& operator[](size_t index) const {
+        return blocks[index / BLOCK_SIZE].load(memory_order_acquire)[index % BLOCK_SIZE];
+    }
+    
+    // Allocates blocks until the slot at index exists
+    void ensure(size_t index) {
+        size_t block = index / BLOCK_SIZE;
+        if (block < MAX_BLOCKS && blocks[block].load(memory_order_acquire)) return;
+        
+        lock_guard<mutex> lock(growMutex);
+        if (block >= MAX_BLOCKS) throw length_error("ChunkedArray is full");
+        while (blockCount <= block) {
+            blocks[blockCount].store(new T[BLOCK_SIZE], memory_order_release);
+            blockCount++;
+        }
+    }
+};
+
+// LoanLedger class implementation
+// Append-only log of borrow, return, fine and payment events, stored column
+// by column in fixed-size chunks. User ids and ISBNs are interned to dense
+// 32-bit ids, so a scan reads only small int columns. Each chunk records
+// the time span it covers; range scans skip chunks outside the range and
+// split the rest across threads. Full chunks are sealed and shared, and a
+// snapshot copies only the open chunk, so appends never wait on a report.
+class LoanLedger {
+public:
+    static const size_t CHUNK_SIZE = 4096;
+    static const uint32_t NO_BOOK = UINT32_MAX;
+    
+    struct Chunk {
+        vector<int64_t> times;      // seconds since the epoch
+        vector<uint32_t> users;
+        vector<uint32_t> books;     // NO_BOOK for fines and payments
+        vector<LedgerEventType> types;
+        vector<int32_t> amounts;    // cents
+        int64_t minTime = INT64_MAX;
+        int64_t maxTime = INT64_MIN;
+        
+        size_t size() const { return times.size(); }
+    };
+
+private:
+    vector<shared_ptr<const Chunk>> sealed;
+    shared_ptr<Chunk> open;
+    LoanIds ownIds;
+    LoanIds* ids;
+    mutable mutex ledgerMutex;
+
+public:
+    LoanLedger() : open(newChunk()), ids(&ownIds) {}
+    
+    // Numbers ids with the shared interners from now on; call before the
+    // first append
+    void shareIds(LoanIds& shared) {
+        lock_guard<mutex> lock(ledgerMutex);
+        ids = &shared;
+    }
+    
+    void append(LedgerEventType type, const string& userId, const string& isbn,
+                system_clock::time_point time, double amount = 0.0) {
+        append(type, ids->users.intern(userId), isbn.empty() ? NO_BOOK : ids->books.intern(isbn), time, amount);
+    }
+    
+    // Keys from the shared interners; NO_BOOK for fines and payments
+    void append(LedgerEventType type, uint32_t user, uint32_t book, system_clock::time_point time,
+                double amount = 0.0) {
+        int64_t seconds = toSeconds(time);
+        lock_guard<mutex> lock(ledgerMutex);
+        Chunk& chunk = *open;
+        chunk.times.push_back(seconds);
+        chunk.users.push_back(user);
+        chunk.books.push_back(book);
+        chunk.types.push_back(type);
+        chunk.amounts.push_back(static_cast<int32_t>(llround(amount * 100)));
+        chunk.minTime = min(chunk.minTime, seconds);
+        chunk.maxTime = max(chunk.maxTime, seconds);
+        if (chunk.size() == CHUNK_SIZE) {
+            sealed.push_back(open);
+            open = newChunk();
+        }
+    }
+    
+    size_t size() const {
+        lock_guard<mutex> lock(ledgerMutex);
+        return sealed.size() * CHUNK_SIZE + open->size();
+    }
+    
+    string getUserId(uint32_t id) const {
+        return ids->users.getId(id);
+    }
+    
+    string getIsbn(uint32_t id) const {
+        return ids->books.getId(id);
+    }
+    
+    // Calls visit(chunk, row, partial) for every event in [start, end] and
+    // returns one partial result per scanning thread, each seeded from init
+    template <typename Partial, typename Visit>
+    vector<Partial> scan(system_clock::time_point start, system_clock::time_point end,
+                         const Partial& init, Visit visit) const {
+        int64_t from = toSeconds(start), to = toSeconds(end);
+        vector<shared_ptr<const Chunk>> chunks;
+        {
+            lock_guard<mutex> lock(ledgerMutex);
+            for (const auto& chunk : sealed) {
+                if (chunk->maxTime >= from && chunk->minTime <= to) chunks.push_back(chunk);
+            }
+            if (open->size() && open->maxTime >= from && open->minTime <= to) {
+                chunks.push_back(make_shared<const Chunk>(*open));
+            }
+        }
+        
+        size_t workers = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), chunks.size()));
+        vector<Partial> partials(workers, init);
+        auto run = [&](size_t worker) {
+            for (size_t c = worker; c < chunks.size(); c += workers) {
+                const Chunk& chunk = *chunks[c];
+                for (size_t row = 0; row < chunk.size(); row++) {
+                    if (chunk.times[row] >= from && chunk.times[row] <= to) visit(chunk, row, partials[worker]);
+                }
+            }
+        };
+        vector<thread> threads;
+        for (size_t worker = 1; worker < workers; worker++) {
+            threads.emplace_back(run, worker);
+        }
+        run(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+        return partials;
+    }
+    
+    static int64_t toSeconds(system_clock::time_point time) {
+        return duration_cast<seconds>(time.time_since_epoch()).count();
+    }
+
+private:
+    static shared_ptr<Chunk> newChunk() {
+        shared_ptr<Chunk> chunk = make_shared<Chunk>();
+        chunk->times.reserve(CHUNK_SIZE);
+        chunk->users.reserve(CHUNK_SIZE);
+        chunk->books.reserve(CHUNK_SIZE);
+        chunk->types.reserve(CHUNK_SIZE);
+        chunk->amounts.reserve(CHUNK_SIZE);
+        return chunk;
+    }
+};
+
+// FineManager class implementation
+class FineManager {
+private:
+    unordered_map<string, double> userFines;
+    LoanLedger* ledger;
+    WriteAheadLog* journal;
+    mutable shared_mutex fineMutex;
+
+public:
+    FineManager() : ledger(nullptr), journal(nullptr) {}
+    
+    void setJournal(WriteAheadLog* wal) {
+        journal = wal;
+    }
+    
+    // Fines assessed and paid are logged for the fine collection report
+    void setLedger(LoanLedger* loanLedger) {
+        ledger = loanLedger;
+    }
+    
+    void addFine(const string& userId, double amount) {
+        unique_lock<shared_mutex> lock(fineMutex);
+        userFines[userId] += amount;
+        if (journal) journal->append(WalRecord(WalRecordType::FINE).addString(userId).addDouble(amount));
+        if (ledger) ledger->append(LedgerEventType::FINE, userId, "", system_clock::now(), amount);
+    }
+    
+    void payFine(const string& userId, double amount) {
+        unique_lock<shared_mutex> lock(fineMutex);
+        auto it = userFines.find(userId);
+        if (it != userFines.end()) {
+            double paid = min(amount, it->second);
+            it->second -= paid;
+            if (journal && paid > 0) journal->append(WalRecord(WalRecordType::PAYMENT).addString(userId).addDouble(paid));
+            if (ledger && paid > 0) ledger->append(LedgerEventType::PAYMENT, userId, "", system_clock::now(), paid);
+        }
+    }
+    
+    double getUserFine(const string& userId) const {
+        shared_lock<shared_mutex> lock(fineMutex);
+        auto it = userFines.find(userId);
+        return it != userFines.end() ? it->second : 0.0;
+    }
+    
+    bool canBorrow(const string& userId) const {
+        return getUserFine(userId) < 50.0;
+    }
+    
+    vector<pair<string, double>> exportFines() const {
+        shared_lock<shared_mutex> lock(fineMutex);
+        vector<pair<string, double>> result;
+        for (const auto& entry : userFines) {
+            if (entry.second > 0) result.push_back(entry);
+        }
+        return result;
+    }
+    
+    void generateFineReport() const {
+        shared_lock<shared_mutex> lock(fineMutex);
+        // Implementation of fine report generation
+    }
+};
+
+// Fired by OverdueScheduler when a loan falls due and for every further
+// day it stays out
+struct LoanEvent {
+    LoanEventType type;
+    string userId;
+    string isbn;
+    system_clock::time_point time;
+    int daysOverdue;
+};
+
+// OverdueScheduler class implementation
+// Min-heap of loan timers keyed by the time they next fire. A loan's first
+// timer is its due date; after that one timer per overdue day accrues the
+// daily fine into FineManager and re-arms itself. Returns and renewals bump
+// the loan's version instead of searching the heap, and stale timers are
+// dropped when they surface, so a run costs O(events fired).
+class OverdueScheduler {
+private:
+    struct Timer {
+        system_clock::time_point when;
+        uint64_t loan;
+        uint32_t version;
+        int daysOverdue;
+        
+        bool operator>(const Timer& other) const { return when > other.when; }
+    };
+    
+    struct Loan {
+        uint32_t user;
+        uint32_t book;
+        uint32_t version;
+    };
+    
+    priority_queue<Timer, vector<Timer>, greater<Timer>> timers;
+    unordered_map<uint64_t, uint64_t> loanIds;  // packed (user, book) -> loan
+    unordered_map<uint64_t, Loan> loans;
+    unordered_set<uint64_t> overdueLoans;
+    uint64_t nextLoanId;
+    FineManager& fines;
+    double finePerDay;
+    function<void(const LoanEvent&)> listener;
+    system_clock::time_point lastRun;
+    WriteAheadLog* journal;
+    LoanIds ownIds;
+    LoanIds* ids;
+    mutable mutex schedulerMutex;
+
+public:
+    explicit OverdueScheduler(FineManager& fines, double finePerDay = 1.0)
+        : nextLoanId(0), fines(fines), finePerDay(finePerDay), journal(nullptr), ids(&ownIds) {}
+    
+    // Numbers ids with the shared interners from now on; call before the
+    // first loan is scheduled
+    void shareIds(LoanIds& shared) {
+        lock_guard<mutex> lock(schedulerMutex);
+        ids = &shared;
+    }
+    
+    // Runs are logged so recovery can move the timers past them; the fines
+    // they accrue are logged by FineManager
+    void setJournal(WriteAheadLog* wal) {
+        journal = wal;
+    }
+    
+    // Called outside the scheduler lock, after a run's fines are applied
+    void setListener(function<void(const LoanEvent&)> callback) {
+        lock_guard<mutex> lock(schedulerMutex);
+        listener = move(callback);
+    }
+    
+    // Arms a new loan, or re-arms a renewed one at its new due date
+    void schedule(const string& userId, const string& isbn, system_clock::time_point dueDate) {
+        schedule(ids->users.intern(userId), ids->books.intern(isbn), dueDate);
+    }
+    
+    // Keys from the shared interners
+    void schedule(uint32_t user, uint32_t book, system_clock::time_point dueDate) {
+        lock_guard<mutex> lock(schedulerMutex);
+        uint64_t key = loanKey(user, book);
+        auto it = loanIds.find(key);
+        uint64_t id;
+        if (it == loanIds.end()) {
+            id = nextLoanId++;
+            loanIds[key] = id;
+            loans[id] = Loan{user, book, 0};
+        } else {
+            id = it->second;
+            loans[id].version++;
+            overdueLoans.erase(id);
+        }
+        timers.push(Timer{dueDate, id, loans[id].version, 0});
+    }
+    
+    // The loan was returned; its pending timers become stale
+    void cancel(const string& userId, const string& isbn) {
+        uint32_t user = ids->users.find(userId);
+        uint32_t book = ids->books.find(isbn);
+        if (user == IdInterner::NONE || book == IdInterner::NONE) return;
+        cancel(user, book);
+    }
+    
+    void cancel(uint32_t user, uint32_t book) {
+        lock_guard<mutex> lock(schedulerMutex);
+        auto it = loanIds.find(loanKey(user, book));
+        if (it == loanIds.end()) return;
+        loans.erase(it->second);
+        overdueLoans.erase(it->second);
+        loanIds.erase(it);
+    }
+    
+    // Fires every timer due by now and returns how many fired. Recovery
+    // replays past runs with accrueFines off: timers move on and overdue
+    // loans are marked, but no fines or events are produced again.
+    size_t advanceTo(system_clock::time_point now, bool accrueFines = true) {
+        vector<LoanEvent> events;
+        function<void(const LoanEvent&)> callback;
+        size_t fired = 0;
+        {
+            lock_guard<mutex> lock(schedulerMutex);
+            if (journal && accrueFines) journal->append(WalRecord(WalRecordType::OVERDUE_RUN).addTime(now));
+            lastRun = max(lastRun, now);
+            while (!timers.empty() && timers.top().when <= now) {
+                Timer timer = timers.top();
+                timers.pop();
+                auto it = loans.find(timer.loan);
+                if (it == loans.end() || it->second.version != timer.version) continue;
+                
+                const Loan& loan = it->second;
+                if (timer.daysOverdue > 0) {
+                    if (accrueFines) fines.addFine(ids->users.getId(loan.user), finePerDay);
+                    overdueLoans.insert(timer.loan);
+                }
+                if (accrueFines) {
+                    events.push_back(LoanEvent{timer.daysOverdue > 0 ? LoanEventType::OVERDUE : LoanEventType::DUE,
+                                               ids->users.getId(loan.user), ids->books.getId(loan.book),
+                                               timer.when, timer.daysOverdue});
+                }
+                fired++;
+                timers.push(Timer{timer.when + hours(24), timer.loan, timer.version, timer.daysOverdue + 1});
+            }
+            callback = listener;
+        }
+        
+        if (callback) {
+            for (const LoanEvent& event : events) {
+                callback(event);
+            }
+        }
+        return fired;
+    }
+    
+    system_clock::time_point getLastRun() const {
+        lock_guard<mutex> lock(schedulerMutex);
+        return lastRun;
+    }
+    
+    // Loans at least one day overdue, as (user, ISBN) pairs
+    vector<pair<string, string>> getOverdueLoans() const {
+        lock_guard<mutex> lock(schedulerMutex);
+        vector<pair<string, string>> result;
+        result.reserve(overdueLoans.size());
+        for (uint64_t id : overdueLoans) {
+            const Loan& loan = loans.at(id);
+            result.emplace_back(ids->users.getId(loan.user), ids->books.getId(loan.book));
+        }
+        return result;
+    }
+    
+    size_t getPendingTimers() const {
+        lock_guard<mutex> lock(schedulerMutex);
+        return timers.size();
+    }
+
+private:
+    static uint64_t loanKey(uint32_t user, uint32_t book) {
+        return static_cast<uint64_t>(user) << 32 | book;
+    }
+};
+
+// BorrowingManager class implementation
+// User ids and ISBNs are interned to 32-bit keys once, at the API edge;
+// everything below works on keys. Records live in one pooled array of
+// compact rows, each chained to the previous record of the same user and
+// of the same book, so there is no per-user vector or map. Borrows and
+// returns are each one transaction under the user's lock and then the
+// book's lock, always in that order so two transactions can never
+// deadlock. A renewal takes only the user's lock: it changes the due date
+// and renewal count, which are read under that lock alone, and leaves the
+// book's chain and copies untouched.
+class BorrowingManager {
+public:
+    static const size_t MAX_ACTIVE_LOANS = 5;
+
+private:
+    static const uint32_t NO_RECORD = UINT32_MAX;
+    
+    struct LoanRecord {
+        system_clock::time_point borrowDate;
+        system_clock::time_point dueDate;
+        uint32_t user;
+        uint32_t book;
+        uint32_t previousForUser;
+        uint32_t previousForBook;
+        uint16_t renewalCount;
+        bool returned;
+    };
+    
+    struct UserLoans {
+        mutex loanMutex;
+        uint32_t newestRecord = NO_RECORD;
+        uint32_t activeCount = 0;
+        array<uint32_t, MAX_ACTIVE_LOANS> active;  // records of open loans
+    };
+    
+    struct BookLoans {
+        mutex loanMutex;
+        uint32_t newestRecord = NO_RECORD;
+    };
+    
+    LoanIds ids;
+    mutable ChunkedArray<UserLoans> userLoans;
+    mutable ChunkedArray<BookLoans> bookLoans;
+    ChunkedArray<LoanRecord> records;
+    atomic<uint32_t> recordCount;
+    OverdueScheduler* scheduler;
+    LoanLedger* ledger;
+    WriteAheadLog* journal;
+
+public:
+    BorrowingManager() : recordCount(0), scheduler(nullptr), ledger(nullptr), journal(nullptr) {}
+    
+    // Loans are armed, re-armed and cancelled on the scheduler as they
+    // change; the scheduler lock is taken after the loan locks. The
+    // scheduler adopts this manager's interners, so keys pass unchanged.
+    void setScheduler(OverdueScheduler* overdueScheduler) {
+        scheduler = overdueScheduler;
+        if (scheduler) scheduler->shareIds(ids);
+    }
+    
+    // Borrows and returns are logged for the reports, under shared keys
+    void setLedger(LoanLedger* loanLedger) {
+        ledger = loanLedger;
+        if (ledger) ledger->shareIds(ids);
+    }
+    
+    // Loan changes are logged under the loan locks, so the log holds each
+    // user's and each book's changes in the order they were applied
+    void setJournal(WriteAheadLog* wal) {
+        journal = wal;
+    }
+    
+    // Checks the loan limit, the fine limit and that the user does not
+    // already hold the title, then takes a copy, all under both locks
+    bool borrowBook(const string& userId, Book& book, const FineManager& fines) {
+        uint32_t user = ids.users.intern(userId);
+        uint32_t bookKey = ids.books.intern(book.getIsbn());
+        UserLoans& loans = slot(userLoans, user);
+        BookLoans& holders = slot(bookLoans, bookKey);
+        lock_guard<mutex> userLock(loans.loanMutex);
+        lock_guard<mutex> bookLock(holders.loanMutex);
+        
+        if (loans.activeCount >= MAX_ACTIVE_LOANS || !fines.canBorrow(userId) ||
+            findActive(loans, bookKey) >= 0 || !book.decrementCopies()) {
+            return false;
+        }
+        
+        auto now = system_clock::now();
+        const LoanRecord& record = addRecord(loans, holders, {now, now + BorrowRecord::LOAN_PERIOD, user, bookKey,
+                                                              NO_RECORD, NO_RECORD, 0, false});
+        if (scheduler) scheduler->schedule(user, bookKey, record.dueDate);
+        if (journal) {
+            journal->append(WalRecord(WalRecordType::BORROW).addString(userId).addString(book.getIsbn())
+                            .addTime(record.borrowDate).addTime(record.dueDate));
+        }
+        if (ledger) ledger->append(LedgerEventType::BORROW, user, bookKey, record.borrowDate);
+        return true;
+    }
+    
+    // Recovery path: puts back a loan without checks or logging; an
+    // active loan takes its copy again and is re-armed on the scheduler
+    void restoreLoan(const BorrowRecord& record, const BookHandle& book) {
+        uint32_t user = ids.users.intern(record.getUserId());
+        uint32_t bookKey = ids.books.intern(record.getBookIsbn());
+        UserLoans& loans = slot(userLoans, user);
+        BookLoans& holders = slot(bookLoans, bookKey);
+        lock_guard<mutex> userLock(loans.loanMutex);
+        lock_guard<mutex> bookLock(holders.loanMutex);
+        
+        bool returned = record.isReturned() || loans.activeCount >= MAX_ACTIVE_LOANS;
+        addRecord(loans, holders, {record.getBorrowDate(), record.getDueDate(), user, bookKey, NO_RECORD, NO_RECORD,
+                                   static_cast<uint16_t>(record.getRenewalCount()), returned});
+        if (!returned) {
+            if (book) book->decrementCopies();
+            if (scheduler) scheduler->schedule(user, bookKey, record.getDueDate());
+        }
+    }
+    
+    // The book is null if it has left the catalog; the loan still closes
+    bool returnBook(const string& userId, const string& isbn, const BookHandle& book) {
+        uint32_t user = ids.users.find(userId);
+        uint32_t bookKey = ids.books.find(isbn);
+        if (user == IdInterner::NONE || bookKey == IdInterner::NONE) return false;
+        UserLoans& loans = slot(userLoans, user);
+        BookLoans& holders = slot(bookLoans, bookKey);
+        lock_guard<mutex> userLock(loans.loanMutex);
+        lock_guard<mutex> bookLock(holders.loanMutex);
+        
+        int position = findActive(loans, bookKey);
+        if (position < 0) return false;
+        
+        records[loans.active[position]].returned = true;
+        loans.active[position] = loans.active[--loans.activeCount];
+        if (book) book->returnCopy();
+        if (scheduler) scheduler->cancel(user, bookKey);
+        if (journal) journal->append(WalRecord(WalRecordType::RETURN).addString(userId).addString(isbn));
+        if (ledger) ledger->append(LedgerEventType::RETURN, user, bookKey, system_clock::now());
+        return true;
+    }
+    
+    // Under the user's lock only; see the class comment
+    bool renewBook(const string& userId, const string& isbn) {
+        uint32_t user = ids.users.find(userId);
+        uint32_t bookKey = ids.books.find(isbn);
+        if (user == IdInterner::NONE || bookKey == IdInterner::NONE) return false;
+        UserLoans& loans = slot(userLoans, user);
+        lock_guard<mutex> userLock(loans.loanMutex);
+        
+        int position = findActive(loans, bookKey);
+        if (position < 0) return false;
+        LoanRecord& record = records[loans.active[position]];
+        if (record.renewalCount >= BorrowRecord::MAX_RENEWALS) return false;
+        
+        record.dueDate += BorrowRecord::LOAN_PERIOD;
+        record.renewalCount++;
+        if (scheduler) scheduler->schedule(user, bookKey, record.dueDate);
+        if (journal) journal->append(WalRecord(WalRecordType::RENEW).addString(userId).addString(isbn));
+        return true;
+    }
+    
+    size_t getActiveLoanCount(const string& userId) const {
+        uint32_t user = ids.users.find(userId);
+        if (user == IdInterner::NONE) return 0;
+        UserLoans& loans = slot(userLoans, user);
+        lock_guard<mutex> userLock(loans.loanMutex);
+        return loans.activeCount;
+    }
+    
+    // Oldest first
+    vector<BorrowRecord> getUserBorrowHistory(const string& userId) const {
+        uint32_t user = ids.users.find(userId);
+        if (user == IdInterner::NONE) return {};
+        UserLoans& loans = slot(userLoans, user);
+        vector<uint32_t> indexes;
+        {
+            lock_guard<mutex> userLock(loans.loanMutex);
+            for (uint32_t i = loans.newestRecord; i != NO_RECORD; i = records[i].previousForUser) {
+                indexes.push_back(i);
+            }
+        }
+        return expand(indexes.rbegin(), indexes.rend());
+    }
+    
+    // Everyone who has borrowed the book, oldest first
+    vector<string> getBookBorrowers(const string& isbn) const {
+        uint32_t bookKey = ids.books.find(isbn);
+        if (bookKey == IdInterner::NONE) return {};
+        BookLoans& holders = slot(bookLoans, bookKey);
+        vector<uint32_t> users;
+        {
+            lock_guard<mutex> bookLock(holders.loanMutex);
+            for (uint32_t i = holders.newestRecord; i != NO_RECORD; i = records[i].previousForBook) {
+                users.push_back(records[i].user);
+            }
+        }
+        vector<string> borrowers;
+        borrowers.reserve(users.size());
+        for (auto it = users.rbegin(); it != users.rend(); ++it) {
+            borrowers.push_back(ids.users.getId(*it));
+        }
+        return borrowers;
+    }
+    
+    // Every record, returned loans included, in the order they were made
+    vector<BorrowRecord> exportLoans() const {
+        vector<uint32_t> indexes;
+        size_t users = ids.users.size();
+        for (uint32_t user = 0; user < users; user++) {
+            UserLoans& loans = slot(userLoans, user);
+            lock_guard<mutex> userLock(loans.loanMutex);
+            for (uint32_t i = loans.newestRecord; i != NO_RECORD; i = records[i].previousForUser) {
+                indexes.push_back(i);
+            }
+        }
+        sort(indexes.begin(), indexes.end());
+        return expand(indexes.begin(), indexes.end());
+    }
+
+private:
+    // Slots may be read before the key's first borrow creates them
+    template <typename Entry>
+    static Entry& slot(ChunkedArray<Entry>& entries, uint32_t key) {
+        entries.ensure(key);
+        return entries[key];
+    }
+    
+    // Position of the user's open loan of the book in active, or -1
+    int findActive(const UserLoans& loans, uint32_t book) const {
+        for (uint32_t i = 0; i < loans.activeCount; i++) {
+            if (records[loans.active[i]].book == book) return static_cast<int>(i);
+        }
+        return -1;
+    }
+    
+    // Takes the next pooled row and links it at the head of both chains;
+    // the caller holds both locks
+    LoanRecord& addRecord(UserLoans& loans, BookLoans& holders, const LoanRecord& fields) {
+        uint32_t index = recordCount.fetch_add(1);
+        records.ensure(index);
+        LoanRecord& record = records[index];
+        record = fields;
+        record.previousForUser = loans.newestRecord;
+        record.previousForBook = holders.newestRecord;
+        loans.newestRecord = index;
+        holders.newestRecord = index;
+        if (!record.returned) loans.active[loans.activeCount++] = index;
+        return record;
+    }
+    
+    // Rebuilds full records, with string ids, at the API edge. Records only
+    // change under their user's lock, so the rows are read under it.
+    template <typename Iterator>
+    vector<BorrowRecord> expand(Iterator begin, Iterator end) const {
+        vector<BorrowRecord> result;
+        for (Iterator it = begin; it != end; ++it) {
+            LoanRecord row;
+            {
+                uint32_t user = records[*it].user;
+                lock_guard<mutex> userLock(slot(userLoans, user).loanMutex);
+                row = records[*it];
+            }
+            result.emplace_back(ids.users.getId(row.user), ids.books.getId(row.book), row.borrowDate, row.dueDate,
+                                row.renewalCount, row.returned);
+        }
+        return result;
+    }
+};
+
+// Snapshot file layout: the header, then fixed-size rows for books, users,
+// loans and fines, then one blob holding every string the rows point into.
+// All rows are 8-byte aligned, so they are read in place from the mapping.
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t generation;
+    int64_t lastOverdueRun;  // microseconds since the epoch
+    uint64_t bookCount;
+    uint64_t userCount;
+    uint64_t loanCount;
+    uint64_t fineCount;
+    uint64_t stringBytes;
+};
+
+struct SnapshotString {
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct SnapshotBook {
+    SnapshotString isbn;
+    SnapshotString title;
+    SnapshotString author;
+    int64_t copies;
+};
+
+struct SnapshotUser {
+    SnapshotString id;
+    SnapshotString name;
+    SnapshotString email;
+    int64_t type;
+};
+
+struct SnapshotLoan {
+    SnapshotString userId;
+    SnapshotString isbn;
+    int64_t borrowDate;  // microseconds since the epoch
+    int64_t dueDate;
+    int32_t renewalCount;
+    int32_t returned;
+};
+
+struct SnapshotFine {
+    SnapshotString userId;
+    double amount;
+};
+
+// LibraryStore class implementation
+// Durable library state: a compact binary snapshot plus a WAL of every
+// mutation since it was taken. Both carry a generation number. A
+// checkpoint writes snapshot g+1 to a temporary file, renames it into
+// place and only then restarts the WAL at g+1, so after a crash at any
+// point each mutation is applied exactly once. Recovery maps the snapshot,
+// bulk-loads its rows and replays the WAL on top. Checkpoints must not
+// run concurrently with mutations; LibrarySystem holds its state lock
+// exclusively around them.
+class LibraryStore {
+private:
+    static constexpr char SNAPSHOT_MAGIC[8] = {'L', 'I', 'B', 'S', 'N', 'A', 'P', '1'};
+    
+    string snapshotPath;
+    string walPath;
+    string directory;
+    BookCatalog& catalog;
+    UserManager& users;
+    BorrowingManager& loans;
+    FineManager& fines;
+    OverdueScheduler& scheduler;
+    WriteAheadLog wal;
+    uint64_t generation;
+    size_t checkpointEvery;
+
+public:
+    LibraryStore(const string& directory, BookCatalog& catalog, UserManager& users, BorrowingManager& loans,
+                 FineManager& fines, OverdueScheduler& scheduler, size_t checkpointEvery = 100000,
+                 bool syncOnAppend = true)
+        : snapshotPath(directory + "/library.snapshot"), walPath(directory + "/library.wal"),
+          directory(directory), catalog(catalog), users(users), loans(loans), fines(fines),
+          scheduler(scheduler), wal(syncOnAppend), generation(0), checkpointEvery(checkpointEvery) {}
+    
+    ~LibraryStore() {
+        attach(nullptr);
+    }
+    
+    // Loads the snapshot and the WAL into the empty managers, then starts
+    // logging their mutations
+    void recover() {
+        mkdir(directory.c_str(), 0755);
+        generation = loadSnapshot();
+        wal.open(walPath, generation, [this](WalRecord& record) { apply(record); });
+        attach(&wal);
+    }
+    
+    void checkpoint() {
+        uint64_t next = generation + 1;
+        writeSnapshot(next);
+        generation = next;
+        wal.reset(next);
+    }
+    
+    bool needsCheckpoint() const {
+        return wal.getRecordCount() >= checkpointEvery;
+    }
+    
+    uint64_t getGeneration() const { return generation; }
+    size_t getWalRecordCount() const { return wal.getRecordCount(); }
+
+private:
+    void attach(WriteAheadLog* journal) {
+        catalog.setJournal(journal);
+        users.setJournal(journal);
+        loans.setJournal(journal);
+        fines.setJournal(journal);
+        scheduler.setJournal(journal);
+    }
+    
+    void apply(WalRecord& record) {
+        switch (record.getType()) {
+            case WalRecordType::ADD_BOOK: {
+                string isbn = record.readString();
+                string title = record.readString();
+                string author = record.readString();
+                catalog.addBook(isbn, title, author, static_cast<int>(record.readInt()));
+                break;
+            }
+            case WalRecordType::REMOVE_BOOK:
+                catalog.removeBook(record.readString());
+                break;
+            case WalRecordType::REGISTER_USER: {
+                string id = record.readString();
+                string name = record.readString();
+                string email = record.readString();
+                users.restoreUser(id, name, email, static_cast<UserType>(record.readInt()));
+                break;
+            }
+            case WalRecordType::BORROW: {
+                string userId = record.readString();
+                string isbn = record.readString();
+                auto borrowDate = record.readTime();
+                auto dueDate = record.readTime();
+                loans.restoreLoan(BorrowRecord(userId, isbn, borrowDate, dueDate, 0, false), catalog.getBook(isbn));
+                break;
+            }
+            case WalRecordType::RETURN: {
+                string userId = record.readString();
+                string isbn = record.readString();
+                loans.returnBook(userId, isbn, catalog.getBook(isbn));
+                break;
+            }
+            case WalRecordType::RENEW: {
+                string userId = record.readString();
+                loans.renewBook(userId, record.readString());
+                break;
+            }
+            case WalRecordType::FINE: {
+                string userId = record.readString();
+                fines.addFine(userId, record.readDouble());
+                break;
+            }
+            case WalRecordType::PAYMENT: {
+                string userId = record.readString();
+                fines.payFine(userId, record.readDouble());
+                break;
+            }
+            case WalRecordType::OVERDUE_RUN:
+                scheduler.advanceTo(record.readTime(), false);
+                break;
+            default:
+                throw runtime_error("Unknown WAL record type");
+        }
+    }
+    
+    // Returns the snapshot's generation, or 0 if there is none yet
+    uint64_t loadSnapshot() {
+        MappedFile file(snapshotPath);
+        if (!file.getData()) return 0;
+        
+        SnapshotHeader header;
+        if (file.getSize() < sizeof(header)) throw runtime_error("Truncated snapshot: " + snapshotPath);
+        memcpy(&header, file.getData(), sizeof(header));
+        size_t expected = sizeof(header) + header.bookCount * sizeof(SnapshotBook) +
+                          header.userCount * sizeof(SnapshotUser) + header.loanCount * sizeof(SnapshotLoan) +
+                          header.fineCount * sizeof(SnapshotFine) + header.stringBytes;
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || expected != file.getSize()) {
+            throw runtime_error("Corrupt snapshot: " + snapshotPath);
+        }
+        
+        const char* cursor = file.getData() + sizeof(header);
+        auto bookRows = reinterpret_cast<const SnapshotBook*>(cursor);
+        cursor += header.bookCount * sizeof(SnapshotBook);
+        auto userRows = reinterpret_cast<const SnapshotUser*>(cursor);
+        cursor += header.userCount * sizeof(SnapshotUser);
+        auto loanRows = reinterpret_cast<const SnapshotLoan*>(cursor);
+        cursor += header.loanCount * sizeof(SnapshotLoan);
+        auto fineRows = reinterpret_cast<const SnapshotFine*>(cursor);
+        cursor += header.fineCount * sizeof(SnapshotFine);
+        const char* strings = cursor;
+        auto text = [&](const SnapshotString& ref) {
+            if (ref.offset > header.stringBytes || ref.length > header.stringBytes - ref.offset) {
+                throw runtime_error("Corrupt snapshot: " + snapshotPath);
+            }
+            return string(strings + ref.offset, ref.length);
+        };
+        
+        vector<BookEntry> entries;
+        entries.reserve(header.bookCount);
+        for (uint64_t i = 0; i < header.bookCount; i++) {
+            const SnapshotBook& row = bookRows[i];
+            entries.push_back({text(row.isbn), text(row.title), text(row.author), static_cast<int>(row.copies)});
+        }
+        catalog.addBooks(entries);
+        
+        for (uint64_t i = 0; i < header.userCount; i++) {
+            const SnapshotUser& row = userRows[i];
+            users.restoreUser(text(row.id), text(row.name), text(row.email), static_cast<UserType>(row.type));
+        }
+        for (uint64_t i = 0; i < header.fineCount; i++) {
+            fines.addFine(text(fineRows[i].userId), fineRows[i].amount);
+        }
+        for (uint64_t i = 0; i < header.loanCount; i++) {
+            const SnapshotLoan& row = loanRows[i];
+            string isbn = text(row.isbn);
+            loans.restoreLoan(BorrowRecord(text(row.userId), isbn, WalRecord::fromMicros(row.borrowDate),
+                                           WalRecord::fromMicros(row.dueDate), row.renewalCount, row.returned != 0),
+                              catalog.getBook(isbn));
+        }
+        scheduler.advanceTo(WalRecord::fromMicros(header.lastOverdueRun), false);
+        return header.generation;
+    }
+    
+    void writeSnapshot(uint64_t snapshotGeneration) const {
+        string blob;
+        auto ref = [&blob](const string& value) {
+            SnapshotString result = {blob.size(), value.size()};
+            blob += value;
+            return result;
+        };
+        
+        vector<SnapshotBook> bookRows;
+        for (const BookEntry& entry : catalog.exportBooks()) {
+            bookRows.push_back({ref(entry.isbn), ref(entry.title), ref(entry.author), entry.copies});
+        }
+        vector<SnapshotUser> userRows;
+        for (const UserHandle& user : users.exportUsers()) {
+            userRows.push_back({ref(user->getId()), ref(user->getName()), ref(user->getEmail()),
+                                static_cast<int64_t>(user->getType())});
+        }
+        vector<SnapshotLoan> loanRows;
+        for (const BorrowRecord& record : loans.exportLoans()) {
+            loanRows.push_back({ref(record.getUserId()), ref(record.getBookIsbn()),
+                                WalRecord::toMicros(record.getBorrowDate()), WalRecord::toMicros(record.getDueDate()),
+                                record.getRenewalCount(), record.isReturned() ? 1 : 0});
+        }
+        vector<SnapshotFine> fineRows;
+        for (const auto& fine : fines.exportFines()) {
+            fineRows.push_back({ref(fine.first), fine.second});
+        }
+        
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.generation = snapshotGeneration;
+        header.lastOverdueRun = WalRecord::toMicros(scheduler.getLastRun());
+        header.bookCount = bookRows.size();
+        header.userCount = userRows.size();
+        header.loanCount = loanRows.size();
+        header.fineCount = fineRows.size();
+        header.stringBytes = blob.size();
+        
+        string tempPath = snapshotPath + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if (!out) throw runtime_error("Cannot write snapshot: " + tempPath);
+        bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                       writeRows(out, bookRows) && writeRows(out, userRows) &&
+                       writeRows(out, loanRows) && writeRows(out, fineRows) &&
+                       fwrite(blob.data(), 1, blob.size(), out) == blob.size() &&
+                       fflush(out) == 0 && fsync(fileno(out)) == 0;
+        fclose(out);
+        if (!written || rename(tempPath.c_str(), snapshotPath.c_str()) != 0) {
+            throw runtime_error("Cannot write snapshot: " + snapshotPath);
+        }
+        
+        // Make the rename itself durable before the WAL is reset
+        int dir = ::open(directory.c_str(), O_RDONLY);
+        if (dir >= 0) {
+            fsync(dir);
+            ::close(dir);
+        }
+    }
+    
+    template <typename Row>
+    static bool writeRows(FILE* out, const vector<Row>& rows) {
+        return rows.empty() || fwrite(rows.data(), sizeof(Row), rows.size(), out) == rows.size();
+    }
+};
+
+// Report class implementation
+// Event reports are computed by scanning the loan ledger over the date
+// range; each scanning thread aggregates into its own partial by dense id,
+// and the partials are merged at the end.
+class Report {
+private:
+    system_clock::time_point startDate;
+    system_clock::time_point endDate;
+    ReportType type;
+    const LoanLedger* ledger;
+    
+    static const size_t TOP_ENTRIES = 10;
+
+public:
+    Report(ReportType type, const LoanLedger* ledger = nullptr) : type(type), ledger(ledger) {
+        startDate = system_clock::now() - hours(24 * 30); // Last 30 days
+        endDate = system_clock::now();
+    }
+    
+    void setDateRange(system_clock::time_point start,
+                     system_clock::time_point end) {
+        startDate = start;
+        endDate = end;
+    }
+    
+    string generateBookAvailabilityReport() {
+        // Implementation of book availability report
+        return "Book Availability Report";
+    }
+    
+    // Most borrowed titles in the range
+    string generatePopularBooksReport() {
+        ostringstream out;
+        out << "Popular Books Report";
+        if (!ledger) return out.str();
+        
+        vector<uint64_t> borrows = mergeCounts(ledger->scan(startDate, endDate, vector<uint64_t>(),
+            [](const LoanLedger::Chunk& chunk, size_t row, vector<uint64_t>& counts) {
+                if (chunk.types[row] == LedgerEventType::BORROW) bump(counts, chunk.books[row], 1);
+            }));
+        for (const auto& entry : topEntries(borrows)) {
+            out << "\n" << ledger->getIsbn(entry.first) << ": " << entry.second << " borrows";
+        }
+        return out.str();
+    }
+    
+    // Borrow and return volume, distinct borrowers and borrows by weekday
+    string generateBorrowingPatternReport() {
+        ostringstream out;
+        out << "Borrowing Pattern Report";
+        if (!ledger) return out.str();
+        
+        vector<PatternTotals> partials = ledger->scan(startDate, endDate, PatternTotals(),
+            [](const LoanLedger::Chunk& chunk, size_t row, PatternTotals& totals) {
+                if (chunk.types[row] == LedgerEventType::BORROW) {
+                    totals.borrows++;
+                    totals.byWeekday[weekday(chunk.times[row])]++;
+                    bump(totals.borrowers, chunk.users[row], 1);
+                } else if (chunk.types[row] == LedgerEventType::RETURN) {
+                    totals.returns++;
+                }
+            });
+        PatternTotals totals;
+        vector<uint64_t> borrowers;
+        for (const PatternTotals& partial : partials) {
+            totals.borrows += partial.borrows;
+            totals.returns += partial.returns;
+            for (size_t day = 0; day < 7; day++) totals.byWeekday[day] += partial.byWeekday[day];
+            addCounts(borrowers, partial.borrowers);
+        }
+        
+        static const char* const DAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        out << "\nBorrows: " << totals.borrows << "\nReturns: " << totals.returns
+            << "\nBorrowers: " << count_if(borrowers.begin(), borrowers.end(), [](uint64_t n) { return n > 0; });
+        for (size_t day = 0; day < 7; day++) {
+            out << "\n" << DAYS[day] << ": " << totals.byWeekday[day];
+        }
+        return out.str();
+    }
+    
+    // Fines assessed and collected in the range, and the largest payers
+    string generateFineCollectionReport() {
+        ostringstream out;
+        out << "Fine Collection Report";
+        if (!ledger) return out.str();
+        
+        vector<FineTotals> partials = ledger->scan(startDate, endDate, FineTotals(),
+            [](const LoanLedger::Chunk& chunk, size_t row, FineTotals& totals) {
+                if (chunk.types[row] == LedgerEventType::FINE) {
+                    totals.assessed += chunk.amounts[row];
+                } else if (chunk.types[row] == LedgerEventType::PAYMENT) {
+                    totals.collected += chunk.amounts[row];
+                    bump(totals.paidByUser, chunk.users[row], chunk.amounts[row]);
+                }
+            });
+        FineTotals totals;
+        for (const FineTotals& partial : partials) {
+            totals.assessed += partial.assessed;
+            totals.collected += partial.collected;
+            addCounts(totals.paidByUser, partial.paidByUser);
+        }
+        
+        out << fixed << setprecision(2) << "\nAssessed: $" << totals.assessed / 100.0
+            << "\nCollected: $" << totals.collected / 100.0;
+        for (const auto& entry : topEntries(totals.paidByUser)) {
+            out << "\n" << ledger->getUserId(entry.first) << ": $" << entry.second / 100.0;
+        }
+        return out.str();
+    }
+
+private:
+    struct PatternTotals {
+        uint64_t borrows = 0;
+        uint64_t returns = 0;
+        array<uint64_t, 7> byWeekday{};
+        vector<uint64_t> borrowers;  // borrows by user id
+    };
+    
+    struct FineTotals {
+        uint64_t assessed = 0;       // cents
+        uint64_t collected = 0;
+        vector<uint64_t> paidByUser;
+    };
+    
+    static void bump(vector<uint64_t>& counts, uint32_t id, uint64_t amount) {
+        if (id == LoanLedger::NO_BOOK) return;
+        if (id >= counts.size()) counts.resize(id + 1);
+        counts[id] += amount;
+    }
+    
+    static void addCounts(vector<uint64_t>& into, const vector<uint64_t>& counts) {
+        if (counts.size() > into.size()) into.resize(counts.size());
+        for (size_t id = 0; id < counts.size(); id++) into[id] += counts[id];
+    }
+    
+    static vector<uint64_t> mergeCounts(const vector<vector<uint64_t>>& partials) {
+        vector<uint64_t> counts;
+        for (const auto& partial : partials) addCounts(counts, partial);
+        return counts;
+    }
+    
+    // Largest non-zero counts, highest first, ties by id
+    static vector<pair<uint32_t, uint64_t>> topEntries(const vector<uint64_t>& counts) {
+        vector<pair<uint32_t, uint64_t>> entries;
+        for (size_t id = 0; id < counts.size(); id++) {
+            if (counts[id] > 0) entries.emplace_back(static_cast<uint32_t>(id), counts[id]);
+        }
+        auto byCount = [](const pair<uint32_t, uint64_t>& a, const pair<uint32_t, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        };
+        size_t keep = entries.size() < TOP_ENTRIES ? entries.size() : TOP_ENTRIES;
+        partial_sort(entries.begin(), entries.begin() + keep, entries.end(), byCount);
+        entries.resize(keep);
+        return entries;
+    }
+    
+    // 0 is Sunday; the epoch fell on a Thursday
+    static size_t weekday(int64_t seconds) {
+        int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+        return static_cast<size_t>(((days + 4) % 7 + 7) % 7);
+    }
+};
+
+// LibrarySystem class implementation (Singleton)
+class LibrarySystem {
+private:
+    static LibrarySystem* instance;
+    static mutex instanceMutex;
+    
+    BookCatalog bookCatalog;
+    UserManager userManager;
+    BorrowingManager borrowingManager;
+    FineManager fineManager;
+    OverdueScheduler overdueScheduler;
+    LoanLedger loanLedger;
+    unique_ptr<LibraryStore> store;
+    InstrumentedSharedMutex stateMutex{"library.state_lock"};  // mutations shared, checkpoints exclusive
+    
+    LibrarySystem() : overdueScheduler(fineManager) {
+        borrowingManager.setScheduler(&overdueScheduler);
+        borrowingManager.setLedger(&loanLedger);
+        fineManager.setLedger(&loanLedger);
+    }
+
+public:
+    static LibrarySystem* getInstance() {
+        lock_guard<mutex> lock(instanceMutex);
+        if (!instance) {
+            instance = new LibrarySystem();
+        }
+        return instance;
+    }
+    
+    // Recovers state from the directory's snapshot and WAL, then logs
+    // every later change there. Call once, before the system is used.
+    void enablePersistence(const string& directory, size_t checkpointEvery = 100000) {
+        unique_lock<InstrumentedSharedMutex> lock(stateMutex);
+        borrowingManager.setLedger(nullptr);
+        fineManager.setLedger(nullptr);
+        store = make_unique<LibraryStore>(directory, bookCatalog, userManager, borrowingManager, fineManager,
+                                          overdueScheduler, checkpointEvery);
+        store->recover();
+        borrowingManager.setLedger(&loanLedger);
+        fineManager.setLedger(&loanLedger);
+    }
+    
+    // Writes a snapshot and empties the WAL
+    void checkpoint() {
+        unique_lock<InstrumentedSharedMutex> lock(stateMutex);
+        if (store) store->checkpoint();
+    }
+    
+    string addBook(const string& isbn, const string& title, const string& author, int copies = 1) {
+        return mutate([&] {
+            bookCatalog.addBook(isbn, title, author, copies);
+            return isbn;
+        });
+    }
+    
+    void addBooks(const vector<BookEntry>& entries) {
+        mutate([&] { bookCatalog.addBooks(entries); });
+    }
+    
+    size_t removeBooks(const vector<string>& isbns) {
+        return mutate([&] { return bookCatalog.removeBooks(isbns); });
+    }
+    
+    string registerUser(const string& name, const string& email, UserType type) {
+        return mutate([&] { return userManager.registerUser(name, email, type); });
+    }
+    
+    bool borrowBook(const string& userId, const string& isbn) {
+        UserHandle user = userManager.getUser(userId);
+        BookHandle book = bookCatalog.getBook(isbn);
+        
+        if (!user || !book) {
+            return false;
+        }
+        
+        return mutate([&] { return borrowingManager.borrowBook(userId, *book, fineManager); });
+    }
+    
+    bool returnBook(const string& userId, const string& isbn) {
+        return mutate([&] { return borrowingManager.returnBook(userId, isbn, bookCatalog.getBook(isbn)); });
+    }
+    
+    bool renewBook(const string& userId, const string& isbn) {
+        return mutate([&] { return borrowingManager.renewBook(userId, isbn); });
+    }
+    
+    void payFine(const string& userId, double amount) {
+        mutate([&] { fineManager.payFine(userId, amount); });
+    }
+    
+    // Nightly fine run: fires due and overdue timers up to now
+    size_t processOverdueLoans(system_clock::time_point now = system_clock::now()) {
+        return mutate([&] { return overdueScheduler.advanceTo(now); });
+    }
+    
+    vector<pair<string, string>> getOverdueLoans() const {
+        return overdueScheduler.getOverdueLoans();
+    }
+    
+    double getUserFine(const string& userId) const {
+        return fineManager.getUserFine(userId);
+    }
+    
+    // Title and author words; the last word may be a prefix
+    SearchPage searchBooks(const string& query, size_t offset = 0, size_t limit = 20) {
+        return bookCatalog.search(query, offset, limit);
+    }
+    
+    Report generateReport(ReportType type) {
+        return Report(type, &loanLedger);
+    }
+
+private:
+    // Runs one mutation under the shared state lock, then checkpoints once
+    // the WAL has grown past its limit
+    template <typename Mutation>
+    auto mutate(Mutation mutation) -> decltype(mutation()) {
+        static const int mutationTime = Metrics::histogram("library.mutation_ns");
+        ScopedTimer timer(mutationTime);
+        if constexpr (is_void<decltype(mutation())>::value) {
+            {
+                shared_lock<InstrumentedSharedMutex> lock(stateMutex);
+                mutation();
+            }
+            checkpointIfDue();
+        } else {
+            auto result = [&] {
+                shared_lock<InstrumentedSharedMutex> lock(stateMutex);
+                return mutation();
+            }();
+            checkpointIfDue();
+            return result;
+        }
+    }
+    
+    void checkpointIfDue() {
+        if (!store || !store->needsCheckpoint()) return;
+        unique_lock<InstrumentedSharedMutex> lock(stateMutex);
+        if (store->needsCheckpoint()) store->checkpoint();
     }
 };
 
@@ -476,8 +2366,8 @@ int main() {
     }
     
     // Search books
-    vector<Book> results = library->searchBooks("Gatsby");
-    cout << "Found " << results.size() << " books" << endl;
+    SearchPage results = library->searchBooks("Gatsby");
+    cout << "Found " << results.isbns.size() << " books" << endl;
     
     // Generate report
     Report report = library->generateReport(ReportType::AVAILABILITY);
@@ -1,6 +1,11 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <sstream>
 #include "implementation.cpp"
 
 using namespace std;
@@ -24,6 +29,9 @@ void assertEqual(int expected, int actual, const string& message) {
     }
 }
 
+// Page size that returns every match
+const size_t EVERY_MATCH = SIZE_MAX;
+
 // Test cases
 void testBookManagement() {
     cout << "Running book management tests..." << endl;
@@ -35,15 +43,152 @@ void testBookManagement() {
     string isbn2 = library->addBook("978-0140283334", "1984", "George Orwell");
     
     // Test searching books
-    vector<Book> results = library->searchBooks("Gatsby");
-    assertEqual(1, results.size(), "Should find one book with 'Gatsby' in title");
+    SearchPage results = library->searchBooks("Gatsby");
+    assertEqual(1, results.isbns.size(), "Should find one book with 'Gatsby' in title");
     
     results = library->searchBooks("George");
-    assertEqual(1, results.size(), "Should find one book by George Orwell");
+    assertEqual(1, results.isbns.size(), "Should find one book by George Orwell");
     
     cout << "Book management tests passed!" << endl;
 }
 
+void testSearchIndex() {
+    cout << "Running search index tests..." << endl;
+    
+    BookCatalog catalog;
+    catalog.addBook("1", "The Lord of the Rings", "J. R. R. Tolkien");
+    catalog.addBook("2", "The Hobbit", "J. R. R. Tolkien");
+    catalog.addBook("3", "Lord of the Flies", "William Golding");
+    catalog.addBook("4", "Rings of Saturn", "W. G. Sebald");
+    catalog.addBook("5", "Tolkien: A Biography", "Humphrey Carpenter");
+    
+    assertEqual(2, catalog.searchByTitle("lord").isbns.size(), "Title search should be case-insensitive");
+    assertEqual(1, catalog.searchByTitle("lord rings").isbns.size(), "Every word should match");
+    assertEqual(2, catalog.searchByTitle("the lord of").isbns.size(), "Last word should match as a prefix");
+    assertEqual(2, catalog.searchByTitle("ring").isbns.size(), "Prefix should match longer words");
+    assertEqual(0, catalog.searchByTitle("ring saturn").isbns.size(), "Only the last word is a prefix");
+    assertEqual(0, catalog.searchByTitle("").isbns.size(), "Empty query should match nothing");
+    assertEqual(2, catalog.searchByAuthor("tolk").isbns.size(), "Author prefix search should work");
+    assertEqual(3, catalog.search("tolkien").isbns.size(), "Title and author matches should be combined");
+    
+    SearchPage page = catalog.search("tolkien", 0, 1);
+    assertEqual(1, page.isbns.size(), "Page should be limited");
+    assertTrue(page.isbns[0] == "1", "Results should come back in catalog order");
+    assertTrue(page.hasMore, "A full page should report more matches");
+    page = catalog.search("tolkien", 2, 10);
+    assertEqual(1, page.isbns.size(), "Last page should hold the remainder");
+    assertTrue(page.isbns[0] == "5", "Offset should skip earlier matches");
+    assertFalse(page.hasMore, "The last page should report no more matches");
+    assertFalse(catalog.search("tolkien", 0, 3).hasMore, "An exactly full last page has no more");
+    
+    catalog.removeBook("1");
+    assertEqual(1, catalog.searchByTitle("lord").isbns.size(), "Removed books should not be found");
+    assertTrue(catalog.getBook("1") == nullptr, "Removed book should be gone");
+    
+    catalog.addBook("2", "The Hobbit", "J. R. R. Tolkien", 2);
+    assertEqual(3, catalog.getBook("2")->getTotalCopies(), "Adding an existing ISBN should add copies");
+    assertEqual(1, catalog.searchByTitle("hobbit").isbns.size(), "Extra copies should not duplicate the entry");
+    
+    cout << "Search index tests passed!" << endl;
+}
+
+void testCatalogRemoval() {
+    cout << "Running catalog removal tests..." << endl;
+    
+    // Removing one book must not drop others that share its title or author
+    BookCatalog catalog;
+    catalog.addBook("1", "Collected Poems", "Emily Dickinson");
+    catalog.addBook("2", "Collected Poems", "Robert Frost");
+    catalog.addBook("3", "Selected Letters", "Emily Dickinson");
+    catalog.removeBook("1");
+    assertEqual(1, catalog.searchByTitle("collected poems").isbns.size(), "Other book with the same title should remain");
+    assertEqual(1, catalog.searchByAuthor("emily dickinson").isbns.size(), "Other book by the same author should remain");
+    assertEqual(0, catalog.removeBooks({"1", "missing"}), "Unknown ISBNs should be ignored");
+    
+    // Nightly feed: bulk import, then remove every other book in one batch
+    const int feedSize = 20000;
+    vector<BookEntry> feed;
+    vector<string> removals;
+    for (int i = 0; i < feedSize; i++) {
+        string isbn = "FEED-" + to_string(i);
+        feed.push_back({isbn, "Volume " + to_string(i) + " of the series", "Author " + to_string(i % 100), 1});
+        if (i % 2 == 0) removals.push_back(isbn);
+    }
+    
+    auto start = chrono::steady_clock::now();
+    catalog.addBooks(feed);
+    assertEqual(feedSize, catalog.searchByTitle("series", 0, EVERY_MATCH).isbns.size(), "Bulk import should index every book");
+    assertEqual(feedSize / 2, catalog.removeBooks(removals), "Bulk removal should remove every listed book");
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  " << feedSize << " adds and " << removals.size() << " removals in " << seconds << "s" << endl;
+    
+    assertEqual(feedSize / 2, catalog.searchByTitle("series", 0, EVERY_MATCH).isbns.size(), "Removed books should leave the index");
+    assertEqual(0, catalog.searchByTitle("volume 0").isbns.size(), "Removed book should not be found");
+    assertEqual(1, catalog.searchByTitle("volume 1 of").isbns.size(), "Kept book should still be found");
+    assertEqual(200, catalog.searchByAuthor("author 99", 0, EVERY_MATCH).isbns.size(), "Author postings should keep the odd books");
+    assertEqual(0, catalog.searchByAuthor("author 98").isbns.size(), "Author postings should drop the even books");
+    
+    cout << "Catalog removal tests passed!" << endl;
+}
+
+void testConcurrentReads() {
+    cout << "Running concurrent read tests..." << endl;
+    
+    BookCatalog catalog;
+    for (int i = 0; i < 1000; i++) {
+        catalog.addBook("READ-" + to_string(i), "Shared Title " + to_string(i), "Author " + to_string(i % 10), 2);
+    }
+    
+    // Handles outlive removal from the catalog
+    BookHandle handle = catalog.getBook("READ-0");
+    catalog.removeBook("READ-0");
+    assertTrue(catalog.getBook("READ-0") == nullptr, "Removed book should not be found");
+    assertTrue(handle->getTitle() == "Shared Title 0", "Handle should stay valid after removal");
+    
+    UserManager users;
+    string userId = users.registerUser("Reader", "reader@example.com", UserType::STAFF);
+    UserHandle user = users.getUser(userId);
+    users.removeUser(userId);
+    assertTrue(users.getUser(userId) == nullptr, "Removed user should not be found");
+    assertTrue(user->getName() == "Reader", "User handle should stay valid after removal");
+    
+    // Readers search and check availability while a writer changes the
+    // catalog; both run a fixed amount of work since rwlocks may favour readers
+    atomic<long> reads(0);
+    atomic<bool> failed(false);
+    vector<thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&, t] {
+            for (int i = 0; i < 2000; i++) {
+                if (catalog.searchByTitle("shared title", 0, EVERY_MATCH).isbns.size() < 999) failed = true;
+                BookHandle book = catalog.getBook("READ-" + to_string(1 + (reads + t) % 999));
+                if (!book || book->getAvailableCopies() < 0 || book->getAvailableCopies() > 2) failed = true;
+                reads++;
+            }
+        });
+    }
+    
+    thread writer([&] {
+        for (int i = 0; i < 500; i++) {
+            BookHandle book = catalog.getBook("READ-" + to_string(1 + i % 999));
+            if (book->decrementCopies()) book->returnCopy();
+            catalog.addBook("WRITE-" + to_string(i), "Shared Title Extra", "Writer");
+            catalog.removeBook("WRITE-" + to_string(i));
+        }
+    });
+    
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    
+    assertFalse(failed, "Readers should always see a consistent catalog");
+    assertEqual(999, catalog.searchByTitle("shared title", 0, EVERY_MATCH).isbns.size(), "Writer changes should be undone");
+    cout << "  " << reads << " reads alongside 500 write rounds" << endl;
+    
+    cout << "Concurrent read tests passed!" << endl;
+}
+
 void testUserManagement() {
     cout << "Running user management tests..." << endl;
     
@@ -57,6 +202,20 @@ void testUserManagement() {
     assertTrue(!userId2.empty(), "Should generate valid user ID");
     assertTrue(userId1 != userId2, "User IDs should be unique");
     
+    // Updating the profile keeps fines recorded after the copy was taken
+    UserManager users;
+    string userId = users.registerUser("Ann Lee", "ann@example.com", UserType::STUDENT);
+    User edited = *users.getUser(userId);
+    users.getUser(userId)->addFine(5.0);
+    User renamed(userId, "Ann Park", "ann.park@example.com", UserType::FACULTY);
+    users.updateUser(renamed);
+    assertTrue(users.getUser(userId)->getName() == "Ann Park", "Update should change the name");
+    assertTrue(users.getUser(userId)->getType() == UserType::FACULTY, "Update should change the type");
+    assertTrue(users.getUser(userId)->getFineAmount() == 5.0, "Update should keep the fine");
+    users.updateUser(edited);
+    assertTrue(users.getUser(userId)->getEmail() == "ann@example.com", "Update should change the email");
+    assertTrue(users.getUser(userId)->getFineAmount() == 5.0, "A stale copy should not clear the fine");
+    
     cout << "User management tests passed!" << endl;
 }
 
@@ -95,6 +254,7 @@ void testFineManagement() {
     
     // Borrow and return book late
     library->borrowBook(userId, isbn);
+    library->returnBook(userId, isbn);
     
     // Simulate late return by modifying the borrow record
     // This would normally be handled by the system's time tracking
@@ -133,13 +293,206 @@ void testBorrowingLimits() {
     cout << "Borrowing limits tests passed!" << endl;
 }
 
+void testLoanTransactions() {
+    cout << "Running loan transaction tests..." << endl;
+    
+    BookCatalog catalog;
+    FineManager fines;
+    BorrowingManager loans;
+    for (int i = 0; i < 8; i++) {
+        catalog.addBook("LOAN-" + to_string(i), "Loan Book " + to_string(i), "Author", i == 0 ? 3 : 1);
+    }
+    
+    // Returned loans do not count toward the limit
+    for (int i = 0; i < 5; i++) {
+        assertTrue(loans.borrowBook("patron", *catalog.getBook("LOAN-" + to_string(i)), fines), "Should borrow up to the limit");
+    }
+    assertFalse(loans.borrowBook("patron", *catalog.getBook("LOAN-5"), fines), "Sixth active loan should be refused");
+    assertTrue(loans.returnBook("patron", "LOAN-4", catalog.getBook("LOAN-4")), "Should return a loan");
+    assertEqual(4, loans.getActiveLoanCount("patron"), "Active count should drop on return");
+    assertTrue(loans.borrowBook("patron", *catalog.getBook("LOAN-5"), fines), "Returned loan should free a slot");
+    assertEqual(6, loans.getUserBorrowHistory("patron").size(), "History should keep returned loans");
+    assertTrue(loans.renewBook("patron", "LOAN-5"), "Active loan should renew");
+    assertFalse(loans.renewBook("patron", "LOAN-4"), "Returned loan should not renew");
+    
+    // Fines over the limit block borrowing
+    fines.addFine("fined", 60.0);
+    assertFalse(loans.borrowBook("fined", *catalog.getBook("LOAN-6"), fines), "Fined user should not borrow");
+    fines.payFine("fined", 20.0);
+    assertTrue(loans.borrowBook("fined", *catalog.getBook("LOAN-6"), fines), "Paying the fine should allow borrowing");
+    assertEqual(0, catalog.getBook("LOAN-6")->getAvailableCopies(), "Borrowing should take the copy");
+    
+    // Returning a book that left the catalog still closes the loan
+    catalog.removeBook("LOAN-6");
+    assertTrue(loans.returnBook("fined", "LOAN-6", catalog.getBook("LOAN-6")), "Removed book should still return");
+    assertEqual(0, loans.getActiveLoanCount("fined"), "Loan should be closed");
+    
+    // Many kiosks racing for the remaining copies of one book
+    BookCatalog raceCatalog;
+    BorrowingManager raceLoans;
+    raceCatalog.addBook("RACE", "Race Book", "Author", 3);
+    for (int i = 0; i < 5; i++) {
+        raceCatalog.addBook("RACE-" + to_string(i), "Race Book " + to_string(i), "Author");
+    }
+    atomic<int> limitWins(0);
+    vector<thread> kiosks;
+    for (int t = 0; t < 8; t++) {
+        kiosks.emplace_back([&, t] {
+            raceLoans.borrowBook("kiosk" + to_string(t), *raceCatalog.getBook("RACE"), fines);
+        });
+    }
+    for (int t = 0; t < 8; t++) {
+        kiosks.emplace_back([&, t] {
+            string isbn = t < 5 ? "RACE-" + to_string(t) : "RACE";
+            if (raceLoans.borrowBook("collector", *raceCatalog.getBook(isbn), fines)) limitWins++;
+        });
+    }
+    for (auto& kiosk : kiosks) {
+        kiosk.join();
+    }
+    
+    assertEqual(3, raceLoans.getBookBorrowers("RACE").size(), "Exactly the available copies should be lent");
+    assertEqual(0, raceCatalog.getBook("RACE")->getAvailableCopies(), "No copies should be left");
+    assertTrue(limitWins <= 5, "One user should never exceed the loan limit");
+    assertEqual(limitWins, raceLoans.getActiveLoanCount("collector"), "Active count should match successful borrows");
+    
+    cout << "Loan transaction tests passed!" << endl;
+}
+
+void testOverdueScheduler() {
+    cout << "Running overdue scheduler tests..." << endl;
+    
+    BookCatalog catalog;
+    FineManager fines;
+    BorrowingManager loans;
+    OverdueScheduler scheduler(fines);
+    loans.setScheduler(&scheduler);
+    catalog.addBook("DUE-1", "Due Book", "Author");
+    catalog.addBook("DUE-2", "Renewed Book", "Author");
+    catalog.addBook("DUE-3", "Returned Book", "Author");
+    
+    int dueEvents = 0, overdueEvents = 0;
+    scheduler.setListener([&](const LoanEvent& event) {
+        if (event.type == LoanEventType::DUE) dueEvents++;
+        else overdueEvents++;
+    });
+    
+    auto start = system_clock::now();
+    assertTrue(loans.borrowBook("reader", *catalog.getBook("DUE-1"), fines), "Should borrow");
+    assertTrue(loans.borrowBook("reader", *catalog.getBook("DUE-3"), fines), "Should borrow");
+    assertTrue(loans.borrowBook("renewer", *catalog.getBook("DUE-2"), fines), "Should borrow");
+    assertTrue(loans.renewBook("renewer", "DUE-2"), "Should renew");
+    
+    // Nothing fires before a due date
+    assertEqual(0, scheduler.advanceTo(start + hours(24 * 13)), "No timers should fire early");
+    
+    // Returned loan stops, renewed loan moved two weeks out
+    assertTrue(loans.returnBook("reader", "DUE-3", catalog.getBook("DUE-3")), "Should return");
+    assertEqual(1, scheduler.advanceTo(start + hours(24 * 14 + 1)), "Only the open loan should fall due");
+    assertEqual(1, dueEvents, "Due event should fire once");
+    assertTrue(scheduler.getOverdueLoans().empty(), "Due is not yet overdue");
+    
+    assertEqual(3, scheduler.advanceTo(start + hours(24 * 17 + 1)), "One event per overdue day");
+    assertEqual(3, overdueEvents, "Overdue events should fire daily");
+    assertTrue(fines.getUserFine("reader") == 3.0, "Fines should accrue by the day");
+    assertTrue(fines.getUserFine("renewer") == 0.0, "Renewed loan should not accrue");
+    assertEqual(1, scheduler.getOverdueLoans().size(), "One loan should be overdue");
+    assertTrue(scheduler.getOverdueLoans()[0].first == "reader", "Overdue loan should belong to the reader");
+    
+    // Re-running the same night is a no-op
+    assertEqual(0, scheduler.advanceTo(start + hours(24 * 17 + 1)), "Fired timers should not refire");
+    
+    assertTrue(loans.returnBook("reader", "DUE-1", catalog.getBook("DUE-1")), "Should return late");
+    assertEqual(1, scheduler.advanceTo(start + hours(24 * 28 + 1)), "Renewed loan should fall due later");
+    assertTrue(fines.getUserFine("reader") == 3.0, "Returned loan should stop accruing");
+    assertTrue(scheduler.getOverdueLoans().empty(), "Nothing should be overdue yet");
+    
+    // Stale timers are dropped as they surface
+    assertEqual(1, scheduler.getPendingTimers(), "Only the live loan's timer should remain");
+    
+    // A ledger wired in later numbers ids with the manager's interners, so
+    // the keys the manager hands it resolve to the right user
+    LoanLedger ledger;
+    loans.setLedger(&ledger);
+    ledger.append(LedgerEventType::FINE, "cashier", "", start, 1.0);
+    assertTrue(loans.borrowBook("renewer", *catalog.getBook("DUE-3"), fines), "Should borrow again");
+    assertTrue(ledger.getUserId(0) == "reader", "The ledger shares the manager's numbering");
+    auto borrowers = ledger.scan(start - hours(1), system_clock::now() + hours(1), vector<string>(),
+                                 [&](const LoanLedger::Chunk& chunk, size_t row, vector<string>& names) {
+                                     if (chunk.types[row] == LedgerEventType::BORROW) {
+                                         names.push_back(ledger.getUserId(chunk.users[row]));
+                                     }
+                                 });
+    vector<string> names;
+    for (const auto& partial : borrowers) names.insert(names.end(), partial.begin(), partial.end());
+    assertTrue(names.size() == 1 && names[0] == "renewer", "Borrow is logged under the borrower");
+    
+    cout << "Overdue scheduler tests passed!" << endl;
+}
+
+void testCompactLoanStore() {
+    cout << "Running compact loan store tests..." << endl;
+    
+    BookCatalog catalog;
+    FineManager fines;
+    BorrowingManager loans;
+    for (int i = 0; i < 100; i++) {
+        catalog.addBook("POOL-" + to_string(i), "Pool Book " + to_string(i), "Author", 1000);
+    }
+    
+    // History comes back oldest first with its renewals
+    for (int i = 0; i < 3; i++) {
+        assertTrue(loans.borrowBook("regular", *catalog.getBook("POOL-" + to_string(i)), fines), "Should borrow");
+    }
+    assertTrue(loans.renewBook("regular", "POOL-1"), "Should renew");
+    assertTrue(loans.returnBook("regular", "POOL-0", catalog.getBook("POOL-0")), "Should return");
+    vector<BorrowRecord> history = loans.getUserBorrowHistory("regular");
+    assertEqual(3, history.size(), "History should hold every loan");
+    for (int i = 0; i < 3; i++) {
+        assertTrue(history[i].getBookIsbn() == "POOL-" + to_string(i), "History should be oldest first");
+    }
+    assertTrue(history[0].isReturned() && !history[1].isReturned(), "Return flags should be kept");
+    assertTrue(history[1].getDueDate() - history[1].getBorrowDate() == 2 * BorrowRecord::LOAN_PERIOD, "Renewal should move the due date");
+    assertEqual(1, history[1].getRenewalCount(), "Renewals should be counted");
+    assertFalse(loans.returnBook("stranger", "POOL-0", catalog.getBook("POOL-0")), "Unknown users have no loans");
+    assertFalse(loans.renewBook("regular", "POOL-99"), "Unborrowed books cannot be renewed");
+    assertEqual(0, loans.getActiveLoanCount("stranger"), "Unknown users have no loans");
+    
+    // Many patrons borrowing and returning from several threads
+    const int THREADS = 4, PATRONS = 2500;
+    vector<thread> desks;
+    for (int t = 0; t < THREADS; t++) {
+        desks.emplace_back([&, t] {
+            for (int i = 0; i < PATRONS; i++) {
+                string patron = "P" + to_string(t) + "-" + to_string(i);
+                string isbn = "POOL-" + to_string(i % 100);
+                BookHandle book = catalog.getBook(isbn);
+                loans.borrowBook(patron, *book, fines);
+                if (i % 2 == 0) loans.returnBook(patron, isbn, book);
+            }
+        });
+    }
+    for (auto& desk : desks) {
+        desk.join();
+    }
+    
+    assertEqual(3 + THREADS * PATRONS, loans.exportLoans().size(), "Every loan should be pooled");
+    assertEqual(THREADS * PATRONS / 100 + 1, loans.getBookBorrowers("POOL-0").size(), "Book chains should hold every borrower");
+    assertEqual(0, loans.getActiveLoanCount("P0-0"), "Returned loans should close");
+    assertEqual(1, loans.getActiveLoanCount("P3-1"), "Open loans should stay open");
+    assertEqual(1000 - THREADS * PATRONS / 100 - 1, catalog.getBook("POOL-1")->getAvailableCopies(), "Odd patrons keep their loans");
+    assertEqual(1000, catalog.getBook("POOL-0")->getAvailableCopies(), "Even patrons return theirs");
+    
+    cout << "Compact loan store tests passed!" << endl;
+}
+
 void testConcurrentOperations() {
     cout << "Running concurrent operations tests..." << endl;
     
     LibrarySystem* library = LibrarySystem::getInstance();
     
     // Add a book with multiple copies
-    string isbn = library->addBook("978-0743273565", "The Great Gatsby", "F. Scott Fitzgerald");
+    string isbn = library->addBook("978-0743273565", "The Great Gatsby", "F. Scott Fitzgerald", 3);
     
     // Register multiple users
     vector<string> userIds;
@@ -162,6 +515,218 @@ void testConcurrentOperations() {
     cout << "Concurrent operations tests passed!" << endl;
 }
 
+void testLoanLedger() {
+    cout << "Running loan ledger tests..." << endl;
+    
+    // Three years of history at noon each day, ending yesterday
+    LoanLedger ledger;
+    auto today = system_clock::time_point(hours(24) * (system_clock::now().time_since_epoch() / hours(24)));
+    const int DAYS = 3 * 365;
+    for (int day = DAYS; day >= 1; day--) {
+        auto noon = today - hours(24 * day) + hours(12);
+        for (int i = 0; i < 100; i++) {
+            string isbn = "HIST-" + to_string((day + i) % 40);
+            ledger.append(LedgerEventType::BORROW, "reader" + to_string(i), isbn, noon);
+            ledger.append(LedgerEventType::RETURN, "reader" + to_string(i), isbn, noon + hours(1));
+        }
+        if (day <= 30) {
+            for (int i = 0; i < 5; i++) ledger.append(LedgerEventType::BORROW, "fan" + to_string(i), "HOT", noon);
+        }
+        ledger.append(LedgerEventType::FINE, "reader" + to_string(day % 10), "", noon, 1.0);
+        ledger.append(LedgerEventType::PAYMENT, "payer", "", noon, 0.5);
+    }
+    assertEqual(DAYS * 202 + 150, ledger.size(), "Every event should be logged");
+    
+    auto monthStart = today - hours(24 * 30);
+    Report popular(ReportType::POPULAR, &ledger);
+    popular.setDateRange(monthStart, today);
+    auto scanStart = steady_clock::now();
+    string popularText = popular.generatePopularBooksReport();
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - scanStart).count();
+    assertTrue(popularText.find("Popular Books Report\nHOT: 150 borrows\n") == 0, "Most borrowed book should lead the report");
+    
+    Report fines(ReportType::FINE, &ledger);
+    fines.setDateRange(monthStart, today);
+    string fineText = fines.generateFineCollectionReport();
+    assertTrue(fineText.find("Assessed: $30.00") != string::npos, "Fines assessed in the range should be summed");
+    assertTrue(fineText.find("Collected: $15.00\npayer: $15.00") != string::npos, "Payments should be summed by user");
+    
+    Report pattern(ReportType::BORROWING, &ledger);
+    pattern.setDateRange(today - hours(24 * 7), today);
+    string patternText = pattern.generateBorrowingPatternReport();
+    assertTrue(patternText.find("Borrows: 735\nReturns: 700\nBorrowers: 105") != string::npos, "Week totals should match");
+    for (const char* day : {"Sun: 105", "Mon: 105", "Sat: 105"}) {
+        assertTrue(patternText.find(day) != string::npos, "Each weekday should appear once in a week");
+    }
+    
+    // Back-dated events land in an open chunk but still fall in their range
+    ledger.append(LedgerEventType::BORROW, "archivist", "OLD", today - hours(24 * 5 * 365));
+    Report archive(ReportType::POPULAR, &ledger);
+    archive.setDateRange(today - hours(24 * 6 * 365), today - hours(24 * 4 * 365));
+    assertTrue(archive.generatePopularBooksReport() == "Popular Books Report\nOLD: 1 borrows", "Back-dated event should be found");
+    
+    // Reports run while kiosks keep appending
+    atomic<bool> done(false);
+    thread kiosk([&] {
+        for (int i = 0; i < 20000; i++) ledger.append(LedgerEventType::BORROW, "kiosk", "LIVE", today + hours(1));
+        done = true;
+    });
+    Report live(ReportType::POPULAR, &ledger);
+    live.setDateRange(today, today + hours(2));
+    while (!done) live.generatePopularBooksReport();
+    kiosk.join();
+    assertTrue(live.generatePopularBooksReport() == "Popular Books Report\nLIVE: 20000 borrows", "Every appended event should be counted");
+    
+    cout << "30-day popular report over " << ledger.size() << " events: " << elapsed << " ms" << endl;
+    cout << "Loan ledger tests passed!" << endl;
+}
+
+// One library's managers, as a freshly started process builds them
+struct PersistentLibrary {
+    BookCatalog catalog;
+    UserManager users;
+    BorrowingManager loans;
+    FineManager fines;
+    OverdueScheduler scheduler;
+    LibraryStore store;
+    
+    PersistentLibrary(const string& directory, bool syncOnAppend = true)
+        : scheduler(fines), store(directory, catalog, users, loans, fines, scheduler, 100000, syncOnAppend) {
+        loans.setScheduler(&scheduler);
+        store.recover();
+    }
+};
+
+string readFile(const string& path) {
+    ifstream in(path, ios::binary);
+    ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+void writeFile(const string& path, const string& contents, ios::openmode mode = ios::trunc) {
+    ofstream out(path, ios::binary | mode);
+    out << contents;
+}
+
+void removeStore(const string& directory) {
+    remove((directory + "/library.snapshot").c_str());
+    remove((directory + "/library.snapshot.tmp").c_str());
+    remove((directory + "/library.wal").c_str());
+    rmdir(directory.c_str());
+}
+
+void testPersistence() {
+    cout << "Running persistence tests..." << endl;
+    
+    const string dir = "library_persistence_test";
+    const string walPath = dir + "/library.wal";
+    removeStore(dir);
+    
+    string alice, bob;
+    auto start = system_clock::now();
+    auto firstRun = start + hours(24 * 16 + 1);
+    {
+        PersistentLibrary library(dir);
+        library.catalog.addBooks({{"P-1", "Persistent Book", "Writer", 2},
+                                  {"P-2", "Second Book", "Writer", 1},
+                                  {"P-3", "Gone Book", "Writer", 1}});
+        alice = library.users.registerUser("Alice", "alice@example.com", UserType::STUDENT);
+        bob = library.users.registerUser("Bob", "bob@example.com", UserType::FACULTY);
+        assertTrue(library.loans.borrowBook(alice, *library.catalog.getBook("P-1"), library.fines), "Should borrow");
+        assertTrue(library.loans.borrowBook(bob, *library.catalog.getBook("P-1"), library.fines), "Should borrow");
+        assertTrue(library.loans.borrowBook(alice, *library.catalog.getBook("P-2"), library.fines), "Should borrow");
+        assertTrue(library.loans.returnBook(bob, "P-1", library.catalog.getBook("P-1")), "Should return");
+        library.catalog.removeBook("P-3");
+        
+        // Snapshot, then keep going in the WAL
+        library.store.checkpoint();
+        assertEqual(0, library.store.getWalRecordCount(), "Checkpoint should empty the WAL");
+        assertTrue(library.loans.renewBook(alice, "P-2"), "Should renew");
+        assertEqual(3, library.scheduler.advanceTo(firstRun), "P-1 falls due and is two days overdue");
+        library.fines.payFine(alice, 0.5);
+        assertTrue(library.fines.getUserFine(alice) == 1.5, "Fines should accrue");
+    }
+    
+    // Restart: snapshot plus WAL rebuild the same state
+    {
+        PersistentLibrary library(dir);
+        assertEqual(1, library.store.getGeneration(), "Snapshot generation should be loaded");
+        assertTrue(library.users.getUser(alice) && library.users.getUser(alice)->getName() == "Alice", "Users should be restored");
+        assertTrue(library.users.getUser(bob)->getType() == UserType::FACULTY, "User types should be restored");
+        assertEqual(1, library.catalog.getBook("P-1")->getAvailableCopies(), "Active loans should hold their copies");
+        assertEqual(0, library.catalog.getBook("P-2")->getAvailableCopies(), "Active loans should hold their copies");
+        assertTrue(!library.catalog.getBook("P-3"), "Removed books should stay removed");
+        assertEqual(2, library.catalog.search("persistent book").isbns.size() + library.catalog.search("second").isbns.size(),
+                    "Indexes should be rebuilt");
+        assertEqual(2, library.loans.getActiveLoanCount(alice), "Active loans should be restored");
+        assertEqual(0, library.loans.getActiveLoanCount(bob), "Returned loans should stay returned");
+        assertEqual(2, library.loans.getBookBorrowers("P-1").size(), "Borrow history should be restored");
+        assertTrue(library.fines.getUserFine(alice) == 1.5, "Fines and payments should be replayed");
+        assertEqual(1, library.scheduler.getOverdueLoans().size(), "Overdue loans should be restored");
+        assertEqual(0, library.scheduler.advanceTo(firstRun), "Past runs should not fire again");
+        assertEqual(1, library.scheduler.advanceTo(firstRun + hours(24)), "The next day should accrue once");
+        assertTrue(library.fines.getUserFine(alice) == 2.5, "Only the new day should be fined");
+        assertTrue(library.loans.renewBook(alice, "P-2"), "Second renewal should be allowed");
+        assertFalse(library.loans.renewBook(alice, "P-2"), "Renewal count should survive the restart");
+        string carol = library.users.registerUser("Carol", "carol@example.com", UserType::STUDENT);
+        assertTrue(carol != alice && carol != bob, "New ids should not collide with restored ones");
+    }
+    
+    // A torn write at the tail is cut off and the log continues after it
+    writeFile(walPath, string("\x40\x00\x00\x00torn", 8), ios::app);
+    {
+        PersistentLibrary library(dir);
+        assertTrue(library.fines.getUserFine(alice) == 2.5, "Intact records should replay");
+        library.catalog.addBook("P-4", "Fourth Book", "Writer");
+    }
+    
+    // A crash between writing a snapshot and resetting the WAL leaves the
+    // older log behind; it must not be applied on top of the snapshot
+    string staleWal;
+    {
+        PersistentLibrary library(dir);
+        assertEqual(1, library.catalog.getBook("P-4")->getTotalCopies(), "Records after the cut should replay");
+        staleWal = readFile(walPath);
+        library.store.checkpoint();
+    }
+    writeFile(walPath, staleWal);
+    {
+        PersistentLibrary library(dir);
+        assertEqual(2, library.store.getGeneration(), "Newest snapshot should win");
+        assertEqual(1, library.catalog.getBook("P-4")->getTotalCopies(), "Stale WAL should be ignored");
+        assertTrue(library.fines.getUserFine(alice) == 2.5, "Snapshot should hold the fines");
+        assertEqual(2, library.loans.getActiveLoanCount(alice), "Snapshot should hold the loans");
+    }
+    removeStore(dir);
+    
+    // Warm start from a large snapshot
+    {
+        PersistentLibrary library(dir, false);
+        vector<BookEntry> entries;
+        for (int i = 0; i < 20000; i++) {
+            entries.push_back({"BULK-" + to_string(i), "Bulk Title " + to_string(i), "Bulk Author " + to_string(i % 100), 2});
+        }
+        library.catalog.addBooks(entries);
+        for (int i = 0; i < 2000; i++) {
+            string user = library.users.registerUser("Patron " + to_string(i), "patron@example.com", UserType::STUDENT);
+            library.loans.borrowBook(user, *library.catalog.getBook("BULK-" + to_string(i)), library.fines);
+        }
+        library.store.checkpoint();
+    }
+    auto loadStart = steady_clock::now();
+    {
+        PersistentLibrary library(dir, false);
+        auto elapsed = duration_cast<milliseconds>(steady_clock::now() - loadStart).count();
+        assertEqual(1, library.catalog.getBook("BULK-0")->getAvailableCopies(), "Bulk loans should be restored");
+        assertEqual(200, library.catalog.search("bulk author 99", 0, EVERY_MATCH).isbns.size(), "Bulk indexes should be rebuilt");
+        cout << "Recovered 20000 books and 2000 loans from the snapshot in " << elapsed << " ms" << endl;
+    }
+    removeStore(dir);
+    
+    cout << "Persistence tests passed!" << endl;
+}
+
 void testReportGeneration() {
     cout << "Running report generation tests..." << endl;
     
@@ -182,19 +747,78 @@ void testReportGeneration() {
               "Should generate borrowing pattern report");
     assertTrue(!fineReport.generateFineCollectionReport().empty(), 
               "Should generate fine collection report");
+    assertTrue(popularReport.generatePopularBooksReport().find("978-0743273565") != string::npos,
+              "Popular books report should include borrowed books");
     
     cout << "Report generation tests passed!" << endl;
 }
 
+void testInstrumentation() {
+    cout << "Running instrumentation tests..." << endl;
+    
+    MetricsSnapshot before = Metrics::snapshot();
+    BookCatalog catalog;
+    catalog.addBook("1", "The Lord of the Rings", "J. R. R. Tolkien");
+    catalog.addBook("2", "Lord of the Flies", "William Golding");
+    catalog.addBook("3", "Rings of Saturn", "W. G. Sebald");
+    assertEqual(1, catalog.searchByTitle("lord ring").isbns.size(), "One title has both words");
+    
+    LibrarySystem* library = LibrarySystem::getInstance();
+    library->addBook("978-0000000030", "Instrumented", "Probe Author");
+    MetricsSnapshot after = Metrics::snapshot();
+    
+    if (!Metrics::enabled) {
+        assertTrue(after.counters.empty() && after.histograms.empty(), "Disabled builds report nothing");
+        cout << "Instrumentation tests passed!" << endl;
+        return;
+    }
+    
+    auto delta = [&](const string& name) {
+        return static_cast<int>(after.counter(name) - before.counter(name));
+    };
+    auto timed = [&](const string& name) {
+        return static_cast<int>(after.histogram(name).count - before.histogram(name).count);
+    };
+    assertEqual(4, delta("library.postings_scanned"), "Each of the four postings is read once");
+    assertEqual(1, timed("library.search_ns"), "The search is timed");
+    assertEqual(1, timed("library.mutation_ns"), "The system mutation is timed");
+    assertEqual(5, delta("library.catalog_lock.acquisitions"), "Four adds and a search");
+    assertTrue(delta("library.state_lock.acquisitions") >= 1, "Mutations share the state lock");
+    
+    // A page reads only the postings up to its last hit and one more
+    vector<BookEntry> shelf;
+    for (int i = 0; i < 1000; i++) {
+        shelf.push_back({"SHELF-" + to_string(i), "Series volume " + to_string(i), "Shelf Author", 1});
+    }
+    catalog.addBooks(shelf);
+    before = Metrics::snapshot();
+    SearchPage page = catalog.searchByTitle("series", 0, 10);
+    after = Metrics::snapshot();
+    assertEqual(10, page.isbns.size(), "The page should be full");
+    assertTrue(page.hasMore, "More pages should follow");
+    assertEqual(11, delta("library.postings_scanned"), "Ten hits and one lookahead");
+    
+    cout << "Instrumentation tests passed!" << endl;
+}
+
 int main() {
     try {
         testBookManagement();
+        testSearchIndex();
+        testCatalogRemoval();
+        testConcurrentReads();
         testUserManagement();
         testBorrowingOperations();
         testFineManagement();
         testBorrowingLimits();
+        testLoanTransactions();
+        testOverdueScheduler();
+        testCompactLoanStore();
         testConcurrentOperations();
+        testLoanLedger();
+        testPersistence();
         testReportGeneration();
+        testInstrumentation();
         
         cout << "All tests passed!" << endl;
         return 0;
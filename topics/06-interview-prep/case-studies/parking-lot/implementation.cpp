@@ -3,9 +3,17 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <new>
+#include <optional>
 #include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <cstdint>
 #include <stdexcept>
 
+#include "../common/instrumentation.h"
+
 using namespace std;
 
 // Enums
@@ -58,6 +66,8 @@ public:
 };
 
 // ParkingSpot class implementation
+// A value snapshot of one spot. Levels keep their spots in a SpotStore and
+// build a ParkingSpot only when a caller asks about a specific spot.
 class ParkingSpot {
 protected:
     int level;
@@ -67,39 +77,26 @@ protected:
     Vehicle* parkedVehicle;
 
 public:
-    ParkingSpot(int level, int row, int spotNumber, VehicleType spotType)
+    ParkingSpot(int level, int row, int spotNumber, VehicleType spotType,
+                Vehicle* parkedVehicle = nullptr)
         : level(level), row(row), spotNumber(spotNumber), spotType(spotType),
-          parkedVehicle(nullptr) {}
-    
-    virtual ~ParkingSpot() = default;
-    
-    bool isAvailable() const { return parkedVehicle == nullptr; }
+          parkedVehicle(parkedVehicle) {}
     
-    bool canFitVehicle(Vehicle* vehicle) const {
-        if (!isAvailable()) return false;
-        
-        // Check if the spot type is appropriate for the vehicle
-        if (vehicle->getType() == VehicleType::MOTORCYCLE) return true;
-        if (vehicle->getType() == VehicleType::CAR) 
+    // Check if the spot type is appropriate for the vehicle
+    static bool fits(VehicleType spotType, VehicleType vehicleType) {
+        if (vehicleType == VehicleType::MOTORCYCLE) return true;
+        if (vehicleType == VehicleType::CAR) 
             return spotType == VehicleType::CAR || spotType == VehicleType::BUS;
-        if (vehicle->getType() == VehicleType::BUS) 
+        if (vehicleType == VehicleType::BUS) 
             return spotType == VehicleType::BUS;
-            
+        
         return false;
     }
     
-    bool park(Vehicle* vehicle) {
-        if (!canFitVehicle(vehicle)) return false;
-        parkedVehicle = vehicle;
-        return true;
-    }
+    bool isAvailable() const { return parkedVehicle == nullptr; }
     
-    bool unpark() {
-        if (!isAvailable()) {
-            parkedVehicle = nullptr;
-            return true;
-        }
-        return false;
+    bool canFitVehicle(Vehicle* vehicle) const {
+        return isAvailable() && fits(spotType, vehicle->getType());
     }
     
     int getLevel() const { return level; }
@@ -109,122 +106,494 @@ public:
     Vehicle* getParkedVehicle() const { return parkedVehicle; }
 };
 
-class MotorcycleSpot : public ParkingSpot {
+// ParkingTicket struct implementation
+// Issued on a successful park. It records where the vehicle went, so the
+// caller never has to search for it and can unpark in O(1). The serial
+// tells apart two parks of the same vehicle in the same spot.
+struct ParkingTicket {
+    int level;
+    int row;
+    int spotNumber;
+    int spotsUsed;
+    Vehicle* vehicle;
+    uint64_t serial;
+    
+    ParkingTicket() : level(-1), row(-1), spotNumber(-1), spotsUsed(0), vehicle(nullptr), serial(0) {}
+    
+    bool isValid() const { return vehicle != nullptr; }
+    
+    bool operator==(const ParkingTicket& other) const {
+        return level == other.level && row == other.row &&
+               spotNumber == other.spotNumber && vehicle == other.vehicle &&
+               serial == other.serial;
+    }
+};
+
+// A ticket freed without touching the plate map, kept with the plate so
+// its tracking entry can be dropped after the vehicle is gone
+struct ReleasedTicket {
+    string licensePlate;
+    ParkingTicket ticket;
+};
+
+// SpotStore class implementation
+// Struct-of-arrays storage for every spot of a level: parked vehicle
+// pointers, an occupancy bitmap and one packed type byte per spot, all
+// carved out of a single allocation. Occupancy queries walk the dense
+// bitmap with popcount instead of chasing one heap object per spot.
+class SpotStore {
+private:
+    size_t count;
+    size_t words;
+    unique_ptr<unsigned char[]> storage;
+    Vehicle** vehicles;
+    uint64_t* occupied;
+    uint8_t* types;
+
 public:
-    MotorcycleSpot(int level, int row, int spotNumber)
-        : ParkingSpot(level, row, spotNumber, VehicleType::MOTORCYCLE) {}
+    SpotStore() : count(0), words(0), vehicles(nullptr), occupied(nullptr), types(nullptr) {}
+    
+    void resize(size_t spotCount) {
+        count = spotCount;
+        words = (count + 63) / 64;
+        
+        // Pointers first, then bitmap words, then type bytes, so every
+        // array is naturally aligned
+        storage.reset(new unsigned char[count * sizeof(Vehicle*) + words * sizeof(uint64_t) + count]);
+        vehicles = new (storage.get()) Vehicle*[count]();
+        occupied = new (storage.get() + count * sizeof(Vehicle*)) uint64_t[words]();
+        types = new (storage.get() + count * sizeof(Vehicle*) + words * sizeof(uint64_t)) uint8_t[count]();
+    }
+    
+    size_t size() const { return count; }
+    
+    void setType(size_t index, VehicleType spotType) { types[index] = static_cast<uint8_t>(spotType); }
+    VehicleType getType(size_t index) const { return static_cast<VehicleType>(types[index]); }
+    
+    bool isFree(size_t index) const { return !(occupied[index / 64] & (1ULL << (index % 64))); }
+    Vehicle* getVehicle(size_t index) const { return vehicles[index]; }
+    
+    bool canFitVehicle(size_t index, Vehicle* vehicle) const {
+        return isFree(index) && ParkingSpot::fits(getType(index), vehicle->getType());
+    }
+    
+    void occupy(size_t index, Vehicle* vehicle) {
+        vehicles[index] = vehicle;
+        occupied[index / 64] |= 1ULL << (index % 64);
+    }
+    
+    void release(size_t index) {
+        vehicles[index] = nullptr;
+        occupied[index / 64] &= ~(1ULL << (index % 64));
+    }
+    
+    int countAvailable() const {
+        int used = 0;
+        for (size_t w = 0; w < words; w++) {
+            used += __builtin_popcountll(occupied[w]);
+        }
+        return static_cast<int>(count) - used;
+    }
+    
+    // Returns the first occupied spot at or after the given index, or size()
+    size_t nextOccupied(size_t index) const {
+        while (index < count) {
+            uint64_t bits = occupied[index / 64] & (~0ULL << (index % 64));
+            if (bits) return (index / 64) * 64 + __builtin_ctzll(bits);
+            index = (index / 64 + 1) * 64;
+        }
+        return count;
+    }
 };
 
-class CompactSpot : public ParkingSpot {
+// FreeSpotIndex class implementation
+// Two-level bitmap of free spot indices for one spot type. A summary bit is
+// set when its 64-spot word has any free spot, so finding the lowest free
+// spot touches one summary word and one leaf word per 4096 spots.
+class FreeSpotIndex {
+private:
+    vector<uint64_t> words;
+    vector<uint64_t> summary;
+    int freeCount;
+
 public:
-    CompactSpot(int level, int row, int spotNumber)
-        : ParkingSpot(level, row, spotNumber, VehicleType::CAR) {}
+    FreeSpotIndex() : freeCount(0) {}
+    
+    void resize(size_t capacity) {
+        words.assign((capacity + 63) / 64, 0);
+        summary.assign((words.size() + 63) / 64, 0);
+        freeCount = 0;
+    }
+    
+    void insert(int index) {
+        uint64_t bit = 1ULL << (index % 64);
+        if (words[index / 64] & bit) return;
+        words[index / 64] |= bit;
+        summary[index / 4096] |= 1ULL << ((index / 64) % 64);
+        freeCount++;
+    }
+    
+    void erase(int index) {
+        uint64_t bit = 1ULL << (index % 64);
+        if (!(words[index / 64] & bit)) return;
+        words[index / 64] &= ~bit;
+        if (words[index / 64] == 0) {
+            summary[index / 4096] &= ~(1ULL << ((index / 64) % 64));
+        }
+        freeCount--;
+    }
+    
+    // Returns the lowest free spot index, or -1 if none is free
+    int lowest() const {
+        for (size_t s = 0; s < summary.size(); s++) {
+            if (summary[s] == 0) continue;
+            size_t word = s * 64 + __builtin_ctzll(summary[s]);
+            return static_cast<int>(word * 64 + __builtin_ctzll(words[word]));
+        }
+        return -1;
+    }
+    
+    int size() const { return freeCount; }
 };
 
-class LargeSpot : public ParkingSpot {
+// RunAllocator class implementation
+// Segment tree over the large spots of a level. Each node keeps the longest
+// free prefix, suffix and run of its range, so the leftmost run of k free
+// spots is found in O(log n). A blocked leaf separates consecutive rows, so
+// a run never spans a row boundary.
+class RunAllocator {
+private:
+    struct Node {
+        int prefix;
+        int suffix;
+        int best;
+    };
+    
+    int spotsInRow;
+    int leaves;
+    vector<Node> tree;
+
 public:
-    LargeSpot(int level, int row, int spotNumber)
-        : ParkingSpot(level, row, spotNumber, VehicleType::BUS) {}
+    RunAllocator() : spotsInRow(0), leaves(0) {}
+    
+    void resize(int rows, int spotsPerRow) {
+        spotsInRow = spotsPerRow;
+        leaves = 1;
+        while (leaves < rows * (spotsPerRow + 1)) leaves *= 2;
+        tree.assign(2 * leaves, Node{0, 0, 0});
+    }
+    
+    void setFree(int spotIndex, bool free) {
+        int node = leaves + toLeaf(spotIndex);
+        int value = free ? 1 : 0;
+        tree[node] = Node{value, value, value};
+        for (int width = 1; node > 1; width *= 2) {
+            node /= 2;
+            const Node& left = tree[2 * node];
+            const Node& right = tree[2 * node + 1];
+            tree[node].prefix = left.prefix == width ? width + right.prefix : left.prefix;
+            tree[node].suffix = right.suffix == width ? width + left.suffix : right.suffix;
+            tree[node].best = max({left.best, right.best, left.suffix + right.prefix});
+        }
+    }
+    
+    // Returns the first spot index of the leftmost free run of the given
+    // length, or -1 if no row has one
+    int findRun(int length) const {
+        static const int nodesScanned = Metrics::counter("parking.run_nodes_scanned");
+        if (length <= 0 || tree.empty() || tree[1].best < length) return -1;
+        
+        int node = 1;
+        int start = 0;
+        int depth = 0;
+        for (int width = leaves / 2; width > 0; width /= 2, depth++) {
+            const Node& left = tree[2 * node];
+            const Node& right = tree[2 * node + 1];
+            if (left.best >= length) {
+                node = 2 * node;
+            } else if (left.suffix + right.prefix >= length) {
+                Metrics::add(nodesScanned, 2 * (depth + 1));
+                return toSpot(start + width - left.suffix);
+            } else {
+                node = 2 * node + 1;
+                start += width;
+            }
+        }
+        Metrics::add(nodesScanned, 2 * depth);
+        return toSpot(start);
+    }
+
+private:
+    int toLeaf(int spotIndex) const { return spotIndex + spotIndex / spotsInRow; }
+    int toSpot(int leaf) const { return leaf - leaf / (spotsInRow + 1); }
 };
 
 // Level class implementation
 class Level {
 private:
     int levelNumber;
-    vector<unique_ptr<ParkingSpot>> spots;
-    mutex levelMutex;
+    int spotsInRow;
+    SpotStore spots;
+    // Free spots indexed by spot type (MOTORCYCLE, CAR, BUS)
+    FreeSpotIndex freeSpots[3];
+    // Free runs of large spots for vehicles needing more than one spot
+    RunAllocator largeRuns;
+    atomic<int> availableSpots;
+    // Serial of the ticket issued for the vehicle starting at each spot
+    vector<uint64_t> ticketSerials;
+    uint64_t nextSerial;
+    // Tickets unparked since the last park on this level
+    vector<ReleasedTicket> released;
+    mutable InstrumentedMutex levelMutex{"parking.level_lock"};
 
 public:
-    Level(int levelNumber, int rows, int spotsPerRow) : levelNumber(levelNumber) {
+    Level(int levelNumber, int rows, int spotsPerRow)
+        : levelNumber(levelNumber), spotsInRow(max(spotsPerRow, 3)), availableSpots(0), nextSerial(0) {
         // Create spots for each row
+        spots.resize(static_cast<size_t>(rows) * spotsInRow);
         for (int row = 0; row < rows; row++) {
+            size_t rowStart = static_cast<size_t>(row) * spotsInRow;
+            
             // First spot in each row is for motorcycles
-            spots.push_back(make_unique<MotorcycleSpot>(levelNumber, row, 0));
+            spots.setType(rowStart, VehicleType::MOTORCYCLE);
             
             // Next 2 spots are compact spots
             for (int spot = 1; spot <= 2; spot++) {
-                spots.push_back(make_unique<CompactSpot>(levelNumber, row, spot));
+                spots.setType(rowStart + spot, VehicleType::CAR);
             }
             
             // Remaining spots are large spots
-            for (int spot = 3; spot < spotsPerRow; spot++) {
-                spots.push_back(make_unique<LargeSpot>(levelNumber, row, spot));
+            for (int spot = 3; spot < spotsInRow; spot++) {
+                spots.setType(rowStart + spot, VehicleType::BUS);
             }
         }
+        
+        for (auto& index : freeSpots) {
+            index.resize(spots.size());
+        }
+        largeRuns.resize(rows, spotsInRow);
+        ticketSerials.resize(spots.size());
+        for (size_t i = 0; i < spots.size(); i++) {
+            releaseSpot(i);
+        }
     }
     
     bool parkVehicle(Vehicle* vehicle) {
-        lock_guard<mutex> lock(levelMutex);
+        ParkingTicket ticket;
+        return parkVehicle(vehicle, ticket);
+    }
+    
+    // Parks the vehicle and fills in the ticket describing its spots. When
+    // given a list, also hands over the tickets released since the last park.
+    bool parkVehicle(Vehicle* vehicle, ParkingTicket& ticket, vector<ReleasedTicket>* releasedOut = nullptr) {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        if (releasedOut && !released.empty()) {
+            releasedOut->swap(released);
+        }
         
-        // For buses, we need to find 5 consecutive large spots
-        if (vehicle->getType() == VehicleType::BUS) {
-            return parkBus(vehicle);
+        // Vehicles needing several spots take consecutive large spots
+        int first = -1;
+        if (vehicle->getSpotsNeeded() > 1) {
+            first = findMultiSpot(vehicle);
+        } else {
+            first = findSingleSpot(vehicle);
         }
+        if (first < 0) return false;
         
-        // For other vehicles, find the first available spot
-        for (auto& spot : spots) {
-            if (spot->canFitVehicle(vehicle)) {
-                return spot->park(vehicle);
-            }
+        for (int i = 0; i < vehicle->getSpotsNeeded(); i++) {
+            occupySpot(first + i, vehicle);
         }
         
-        return false;
+        ticket.level = levelNumber;
+        ticket.row = first / spotsInRow;
+        ticket.spotNumber = first % spotsInRow;
+        ticket.spotsUsed = vehicle->getSpotsNeeded();
+        ticket.vehicle = vehicle;
+        ticket.serial = ++nextSerial;
+        ticketSerials[first] = ticket.serial;
+        return true;
     }
     
     bool unparkVehicle(string licensePlate) {
-        lock_guard<mutex> lock(levelMutex);
+        lock_guard<InstrumentedMutex> lock(levelMutex);
         
-        for (auto& spot : spots) {
-            if (!spot->isAvailable() && 
-                spot->getParkedVehicle()->getLicensePlate() == licensePlate) {
-                return spot->unpark();
+        for (size_t i = spots.nextOccupied(0); i < spots.size(); i = spots.nextOccupied(i + 1)) {
+            if (spots.getVehicle(i)->getLicensePlate() == licensePlate) {
+                return releaseVehicle(i);
             }
         }
         
         return false;
     }
     
-    int getAvailableSpots() const {
-        int count = 0;
-        for (const auto& spot : spots) {
-            if (spot->isAvailable()) count++;
-        }
-        return count;
+    bool unparkVehicle(const ParkingTicket& ticket) {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        return releaseTicket(ticket);
     }
     
-    int getTotalSpots() const { return spots.size(); }
+    // Like unparkVehicle, but remembers the ticket for the next park to
+    // clean up, so the caller does not have to look up the plate now
+    bool unparkAndRecord(const ParkingTicket& ticket) {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        if (!releaseTicket(ticket)) return false;
+        
+        released.push_back({ticket.vehicle->getLicensePlate(), ticket});
+        return true;
+    }
     
+    // Returns a snapshot of the ticket's first spot while it still holds
+    // the vehicle the ticket was issued for
+    optional<ParkingSpot> getSpot(const ParkingTicket& ticket) const {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        
+        size_t index = ticketIndex(ticket);
+        if (!isCurrent(index, ticket)) return nullopt;
+        return ParkingSpot(levelNumber, ticket.row, ticket.spotNumber,
+                           spots.getType(index), spots.getVehicle(index));
+    }
+    
+    int getAvailableSpots() const { return availableSpots; }
+    
+    int getAvailableSpots(VehicleType spotType) const {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        return freeSpots[static_cast<int>(spotType)].size();
+    }
+    
+    // Recounts free spots from the occupancy bitmap
+    int countAvailableSpots() const {
+        lock_guard<InstrumentedMutex> lock(levelMutex);
+        return spots.countAvailable();
+    }
+    
+    int getTotalSpots() const { return spots.size(); }
+
 private:
-    bool parkBus(Vehicle* bus) {
-        // Find 5 consecutive large spots
-        for (size_t i = 0; i <= spots.size() - 5; i++) {
-            bool canPark = true;
-            for (size_t j = 0; j < 5; j++) {
-                if (!spots[i + j]->canFitVehicle(bus)) {
-                    canPark = false;
-                    break;
-                }
-            }
-            
-            if (canPark) {
-                // Park the bus in all 5 spots
-                for (size_t j = 0; j < 5; j++) {
-                    spots[i + j]->park(bus);
-                }
-                return true;
-            }
+    void occupySpot(size_t index, Vehicle* vehicle) {
+        spots.occupy(index, vehicle);
+        freeSpots[static_cast<int>(spots.getType(index))].erase(index);
+        if (spots.getType(index) == VehicleType::BUS) {
+            largeRuns.setFree(index, false);
+        }
+        availableSpots--;
+    }
+    
+    void releaseSpot(size_t index) {
+        spots.release(index);
+        freeSpots[static_cast<int>(spots.getType(index))].insert(index);
+        if (spots.getType(index) == VehicleType::BUS) {
+            largeRuns.setFree(index, true);
         }
+        availableSpots++;
+    }
+    
+    bool releaseVehicle(size_t first) {
+        if (first >= spots.size() || spots.isFree(first)) return false;
         
-        return false;
+        Vehicle* vehicle = spots.getVehicle(first);
+        for (size_t i = first; i < spots.size() && spots.getVehicle(i) == vehicle; i++) {
+            releaseSpot(i);
+        }
+        return true;
+    }
+    
+    bool releaseTicket(const ParkingTicket& ticket) {
+        size_t first = ticketIndex(ticket);
+        if (!isCurrent(first, ticket)) return false;
+        
+        for (int i = 0; i < ticket.spotsUsed; i++) {
+            releaseSpot(first + i);
+        }
+        return true;
+    }
+    
+    bool isCurrent(size_t first, const ParkingTicket& ticket) const {
+        return first < spots.size() && spots.getVehicle(first) == ticket.vehicle &&
+               ticketSerials[first] == ticket.serial;
+    }
+    
+    size_t ticketIndex(const ParkingTicket& ticket) const {
+        if (ticket.level != levelNumber || ticket.row < 0 || ticket.spotNumber < 0 ||
+            ticket.spotNumber >= spotsInRow) {
+            return spots.size();
+        }
+        return static_cast<size_t>(ticket.row) * spotsInRow + ticket.spotNumber;
+    }
+    
+    // Takes the lowest free spot of the smallest spot type that fits, so
+    // large spots are kept for buses
+    int findSingleSpot(Vehicle* vehicle) const {
+        for (VehicleType spotType : {VehicleType::MOTORCYCLE, VehicleType::CAR, VehicleType::BUS}) {
+            int index = freeSpots[static_cast<int>(spotType)].lowest();
+            if (index >= 0 && spots.canFitVehicle(index, vehicle)) {
+                return index;
+            }
+        }
+        return -1;
+    }
+    
+    int findMultiSpot(Vehicle* vehicle) const {
+        int first = largeRuns.findRun(vehicle->getSpotsNeeded());
+        if (first < 0 || !spots.canFitVehicle(first, vehicle)) return -1;
+        return first;
+    }
+};
+
+// ShardedMap class implementation
+// Hash map split into independently locked shards, so operations on
+// different keys rarely wait on the same mutex.
+template <typename Value>
+class ShardedMap {
+private:
+    static const int SHARD_COUNT = 16;
+    
+    struct Shard {
+        InstrumentedMutex shardMutex{"parking.location_lock"};
+        unordered_map<string, Value> entries;
+    };
+    
+    Shard shards[SHARD_COUNT];
+    
+    Shard& shardFor(const string& key) {
+        return shards[hash<string>{}(key) % SHARD_COUNT];
+    }
+
+public:
+    void insert(const string& key, const Value& value) {
+        Shard& shard = shardFor(key);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        shard.entries[key] = value;
+    }
+    
+    bool find(const string& key, Value& value) {
+        Shard& shard = shardFor(key);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) return false;
+        value = it->second;
+        return true;
+    }
+    
+    // Removes the entry if the callback accepts its value
+    template <typename Callback>
+    bool eraseIf(const string& key, Callback callback) {
+        Shard& shard = shardFor(key);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end() || !callback(it->second)) return false;
+        shard.entries.erase(it);
+        return true;
     }
 };
 
 // ParkingLot class implementation
+// Levels are locked independently and vehicle locations live in a sharded
+// map, so there is no lot-wide lock. Each gate starts its search on its own
+// level and walks the others round-robin, spreading arrivals from
+// different gates across levels.
 class ParkingLot {
 private:
     vector<unique_ptr<Level>> levels;
-    unordered_map<string, ParkingSpot*> vehicleLocation;
-    mutex parkingLotMutex;
+    ShardedMap<ParkingTicket> vehicleLocation;
 
 public:
     ParkingLot(int numLevels, int rowsPerLevel, int spotsPerRow) {
@@ -233,40 +602,53 @@ public:
         }
     }
     
-    bool parkVehicle(Vehicle* vehicle) {
-        lock_guard<mutex> lock(parkingLotMutex);
+    bool parkVehicle(Vehicle* vehicle, int gate = 0) {
+        ParkingTicket ticket;
+        return parkVehicle(vehicle, ticket, gate);
+    }
+    
+    bool parkVehicle(Vehicle* vehicle, ParkingTicket& ticket, int gate = 0) {
+        static const int parkTime = Metrics::histogram("parking.park_ns");
+        static const int levelsTried = Metrics::counter("parking.levels_tried");
+        static const int lotFull = Metrics::counter("parking.park_failed");
+        ScopedTimer timer(parkTime);
+        if (levels.empty()) return false;
         
-        // Try to park in each level
-        for (auto& level : levels) {
-            if (level->parkVehicle(vehicle)) {
-                // Find the spot where the vehicle was parked
-                for (int i = 0; i < level->getTotalSpots(); i++) {
-                    auto spot = level->getSpot(i);
-                    if (!spot->isAvailable() && 
-                        spot->getParkedVehicle()->getLicensePlate() == vehicle->getLicensePlate()) {
-                        vehicleLocation[vehicle->getLicensePlate()] = spot;
-                        break;
-                    }
-                }
+        // Try to park in each level, starting from the gate's own level.
+        // Entries left behind by ticket unparks on that level are dropped
+        // first, so the plate map stays bounded.
+        vector<ReleasedTicket> released;
+        for (size_t attempt = 0; attempt < levels.size(); attempt++) {
+            auto& level = levels[(gate + attempt) % levels.size()];
+            Metrics::add(levelsTried);
+            bool parked = level->parkVehicle(vehicle, ticket, &released);
+            forgetReleased(released);
+            if (parked) {
+                vehicleLocation.insert(vehicle->getLicensePlate(), ticket);
                 return true;
             }
         }
         
+        Metrics::add(lotFull);
         return false;
     }
     
     bool unparkVehicle(string licensePlate) {
-        lock_guard<mutex> lock(parkingLotMutex);
-        
-        auto it = vehicleLocation.find(licensePlate);
-        if (it == vehicleLocation.end()) return false;
-        
-        ParkingSpot* spot = it->second;
-        bool success = spot->unpark();
-        if (success) {
-            vehicleLocation.erase(it);
+        static const int unparkTime = Metrics::histogram("parking.unpark_ns");
+        ScopedTimer timer(unparkTime);
+        return vehicleLocation.eraseIf(licensePlate, [this](const ParkingTicket& ticket) {
+            return levels[ticket.level]->unparkVehicle(ticket);
+        });
+    }
+    
+    // Frees the ticket's spots under the level lock alone. The plate's
+    // tracking entry goes stale and is dropped by the level's next park;
+    // until then the plate lookups see it no longer matches the spot.
+    bool unparkVehicle(const ParkingTicket& ticket) {
+        if (!ticket.isValid() || ticket.level < 0 || ticket.level >= static_cast<int>(levels.size())) {
+            return false;
         }
-        return success;
+        return levels[ticket.level]->unparkAndRecord(ticket);
     }
     
     int getAvailableSpots() const {
@@ -277,6 +659,14 @@ public:
         return count;
     }
     
+    int countAvailableSpots() const {
+        int count = 0;
+        for (const auto& level : levels) {
+            count += level->countAvailableSpots();
+        }
+        return count;
+    }
+    
     int getTotalSpots() const {
         int count = 0;
         for (const auto& level : levels) {
@@ -285,9 +675,20 @@ public:
         return count;
     }
     
-    ParkingSpot* findVehicle(string licensePlate) {
-        auto it = vehicleLocation.find(licensePlate);
-        return it != vehicleLocation.end() ? it->second : nullptr;
+    optional<ParkingSpot> findVehicle(string licensePlate) {
+        ParkingTicket ticket;
+        if (!vehicleLocation.find(licensePlate, ticket)) return nullopt;
+        return levels[ticket.level]->getSpot(ticket);
+    }
+
+private:
+    void forgetReleased(vector<ReleasedTicket>& released) {
+        for (const ReleasedTicket& entry : released) {
+            vehicleLocation.eraseIf(entry.licensePlate, [&entry](const ParkingTicket& current) {
+                return current == entry.ticket;
+            });
+        }
+        released.clear();
     }
 };
 
@@ -314,6 +715,15 @@ int main() {
     // Unpark a vehicle
     cout << "Unparking car1: " << (parkingLot.unparkVehicle("ABC123") ? "Success" : "Failed") << endl;
     
+    // Park with a ticket and unpark by ticket
+    Car car3("MNO345");
+    ParkingTicket ticket;
+    if (parkingLot.parkVehicle(&car3, ticket)) {
+        cout << "car3 parked at level " << ticket.level << ", row " << ticket.row 
+             << ", spot " << ticket.spotNumber << endl;
+        cout << "Unparking car3: " << (parkingLot.unparkVehicle(ticket) ? "Success" : "Failed") << endl;
+    }
+    
     // Get available spots again
     cout << "Available spots: " << parkingLot.getAvailableSpots() << endl;
     
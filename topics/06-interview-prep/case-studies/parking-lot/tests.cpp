@@ -2,6 +2,8 @@
 #include <cassert>
 #include <thread>
 #include <vector>
+#include <atomic>
+#include <chrono>
 #include "implementation.cpp"
 
 using namespace std;
@@ -69,21 +71,37 @@ void testUnparking() {
 }
 
 void testConcurrentParking() {
-    cout << "Running concurrent parking tests..." << endl;
+    cout << "Running concurrent parking benchmark..." << endl;
     
-    ParkingLot parkingLot(1, 1, 10);
+    const int numGates = 8;
+    const int carsPerGate = 200;
+    const int rounds = 50;
+    ParkingLot parkingLot(numGates, 10, 25);
     vector<thread> threads;
-    vector<Car> cars;
     
-    // Create 10 cars
-    for (int i = 0; i < 10; i++) {
-        cars.emplace_back("CAR" + to_string(i));
+    // Each gate owns its cars so vehicle pointers stay valid for the run
+    vector<vector<Car>> cars(numGates);
+    for (int gate = 0; gate < numGates; gate++) {
+        cars[gate].reserve(carsPerGate);
+        for (int i = 0; i < carsPerGate; i++) {
+            cars[gate].emplace_back("G" + to_string(gate) + "CAR" + to_string(i));
+        }
     }
     
-    // Try to park all cars concurrently
-    for (int i = 0; i < 10; i++) {
-        threads.emplace_back([&parkingLot, &cars, i]() {
-            parkingLot.parkVehicle(&cars[i]);
+    atomic<int> failedParks(0);
+    auto start = chrono::steady_clock::now();
+    
+    // Every gate repeatedly parks and unparks its cars concurrently
+    for (int gate = 0; gate < numGates; gate++) {
+        threads.emplace_back([&parkingLot, &cars, &failedParks, gate, rounds]() {
+            for (int round = 0; round < rounds; round++) {
+                for (auto& car : cars[gate]) {
+                    if (!parkingLot.parkVehicle(&car, gate)) failedParks++;
+                }
+                for (auto& car : cars[gate]) {
+                    parkingLot.unparkVehicle(car.getLicensePlate());
+                }
+            }
         });
     }
     
@@ -92,10 +110,17 @@ void testConcurrentParking() {
         thread.join();
     }
     
+    auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long operations = 2LL * numGates * carsPerGate * rounds;
+    cout << "  " << numGates << " gates, " << operations << " operations in " 
+         << elapsed << "s (" << static_cast<long long>(operations / elapsed) << " ops/s)" << endl;
+    
     // Verify results
-    assertEqual(0, parkingLot.getAvailableSpots(), "All spots should be occupied");
+    assertEqual(0, failedParks, "Every car should find a spot");
+    assertEqual(parkingLot.getTotalSpots(), parkingLot.getAvailableSpots(), "All spots should be free again");
+    assertEqual(parkingLot.getTotalSpots(), parkingLot.countAvailableSpots(), "Occupancy bitmaps should be empty");
     
-    cout << "Concurrent parking tests passed!" << endl;
+    cout << "Concurrent parking benchmark passed!" << endl;
 }
 
 void testBusParking() {
@@ -117,6 +142,37 @@ void testBusParking() {
     cout << "Bus parking tests passed!" << endl;
 }
 
+void testRunAllocation() {
+    cout << "Running run allocation tests..." << endl;
+    
+    // A level too small for a bus must not underflow
+    ParkingLot smallLot(1, 1, 3);
+    Bus smallBus("BUS0");
+    assertFalse(smallLot.parkVehicle(&smallBus), "Should not park a bus without large spots");
+    
+    // Runs never cross a row boundary
+    Level level(0, 2, 10);
+    Bus bus1("BUS1");
+    Bus bus2("BUS2");
+    Bus bus3("BUS3");
+    assertTrue(level.parkVehicle(&bus1), "Should park a bus in the first row");
+    assertTrue(level.parkVehicle(&bus2), "Should park a bus in the second row");
+    assertEqual(4, level.getAvailableSpots(VehicleType::BUS), "Two large spots should be left per row");
+    assertFalse(level.parkVehicle(&bus3), "Should not park a bus across two rows");
+    
+    // Freed runs are found again
+    assertTrue(level.unparkVehicle("BUS1"), "Should be able to unpark a bus");
+    assertTrue(level.parkVehicle(&bus3), "Should reuse the freed run");
+    
+    // Longer vehicles use the same allocator
+    Vehicle trailer("TRAILER1", VehicleType::BUS, 7);
+    Level trailerLevel(0, 1, 10);
+    assertTrue(trailerLevel.parkVehicle(&trailer), "Should park a vehicle needing 7 spots");
+    assertEqual(3, trailerLevel.getAvailableSpots(), "Should have 3 spots available after parking a trailer");
+    
+    cout << "Run allocation tests passed!" << endl;
+}
+
 void testVehicleTracking() {
     cout << "Running vehicle tracking tests..." << endl;
     
@@ -128,17 +184,96 @@ void testVehicleTracking() {
     
     // Test finding the vehicle
     auto spot = parkingLot.findVehicle("ABC123");
-    assertTrue(spot != nullptr, "Should be able to find parked vehicle");
+    assertTrue(spot.has_value(), "Should be able to find parked vehicle");
     assertTrue(spot->getParkedVehicle()->getLicensePlate() == "ABC123", 
               "Found vehicle should have correct license plate");
     
     // Test finding non-existent vehicle
-    assertTrue(parkingLot.findVehicle("XYZ789") == nullptr, 
+    assertFalse(parkingLot.findVehicle("XYZ789").has_value(), 
               "Should not find non-existent vehicle");
     
     cout << "Vehicle tracking tests passed!" << endl;
 }
 
+void testParkingTicket() {
+    cout << "Running parking ticket tests..." << endl;
+    
+    ParkingLot parkingLot(2, 1, 10);
+    
+    // Ticket records the assigned spot
+    Car car("ABC123");
+    ParkingTicket carTicket;
+    assertTrue(parkingLot.parkVehicle(&car, carTicket), "Should be able to park a car");
+    assertTrue(carTicket.isValid(), "Ticket should be issued");
+    assertEqual(0, carTicket.level, "Car should park on the first level");
+    assertEqual(1, carTicket.spotNumber, "Car should take the first compact spot");
+    assertEqual(1, parkingLot.findVehicle("ABC123")->getSpotNumber(), "Lookup should match the ticket");
+    
+    // Bus ticket covers all of its spots
+    Bus bus("BUS1");
+    ParkingTicket busTicket;
+    assertTrue(parkingLot.parkVehicle(&bus, busTicket, 1), "Should be able to park a bus from gate 1");
+    assertEqual(1, busTicket.level, "Gate 1 should start on the second level");
+    assertEqual(3, busTicket.spotNumber, "Bus should start at the first large spot");
+    assertEqual(5, busTicket.spotsUsed, "Bus should use 5 spots");
+    
+    // Unpark by ticket frees the spots and the tracking entry
+    assertTrue(parkingLot.unparkVehicle(busTicket), "Should be able to unpark by ticket");
+    assertEqual(19, parkingLot.getAvailableSpots(), "Bus spots should be free again");
+    assertFalse(parkingLot.findVehicle("BUS1").has_value(), "Bus should no longer be tracked");
+    assertFalse(parkingLot.unparkVehicle(busTicket), "Ticket should not be usable twice");
+    
+    // Unpark by ticket takes no plate map lock
+    uint64_t locationLocks = Metrics::snapshot().counter("parking.location_lock.acquisitions");
+    assertTrue(parkingLot.unparkVehicle(carTicket), "Should be able to unpark the car by ticket");
+    assertEqual(locationLocks, Metrics::snapshot().counter("parking.location_lock.acquisitions"),
+                "Unpark by ticket should not touch the plate map");
+    assertFalse(parkingLot.unparkVehicle("ABC123"), "Car should no longer be tracked");
+    assertEqual(20, parkingLot.getAvailableSpots(), "All spots should be free");
+    
+    // A new park of the same car in the same spot gets a fresh ticket
+    ParkingTicket secondTicket;
+    assertTrue(parkingLot.parkVehicle(&car, secondTicket), "Should be able to park the car again");
+    assertEqual(carTicket.spotNumber, secondTicket.spotNumber, "Car should take the same spot");
+    assertFalse(parkingLot.unparkVehicle(carTicket), "Old ticket should not unpark the new park");
+    assertEqual(1, parkingLot.findVehicle("ABC123")->getSpotNumber(), "Car should be tracked again");
+    assertTrue(parkingLot.unparkVehicle("ABC123"), "Should be able to unpark the car by plate");
+    assertEqual(20, parkingLot.getAvailableSpots(), "All spots should be free again");
+    
+    cout << "Parking ticket tests passed!" << endl;
+}
+
+void testFreeSpotIndex() {
+    cout << "Running free spot index tests..." << endl;
+    
+    Level level(0, 2, 10);
+    assertEqual(2, level.getAvailableSpots(VehicleType::MOTORCYCLE), "Should have one motorcycle spot per row");
+    assertEqual(4, level.getAvailableSpots(VehicleType::CAR), "Should have two compact spots per row");
+    assertEqual(14, level.getAvailableSpots(VehicleType::BUS), "Should have seven large spots per row");
+    
+    // Cars fill compact spots before taking large spots
+    vector<Car> cars;
+    cars.reserve(5);
+    for (int i = 0; i < 5; i++) {
+        cars.emplace_back("CAR" + to_string(i));
+        assertTrue(level.parkVehicle(&cars[i]), "Should be able to park a car");
+    }
+    assertEqual(0, level.getAvailableSpots(VehicleType::CAR), "Compact spots should be used first");
+    assertEqual(13, level.getAvailableSpots(VehicleType::BUS), "Only one large spot should be used");
+    assertEqual(15, level.getAvailableSpots(), "Total count should track parked cars");
+    
+    // Freed spots are reused
+    assertTrue(level.unparkVehicle("CAR1"), "Should be able to unpark a car");
+    assertEqual(1, level.getAvailableSpots(VehicleType::CAR), "Freed compact spot should be indexed again");
+    Car car("CAR5");
+    assertTrue(level.parkVehicle(&car), "Should be able to park a car");
+    assertEqual(0, level.getAvailableSpots(VehicleType::CAR), "Freed compact spot should be reused");
+    assertEqual(15, level.getAvailableSpots(), "Total count should stay in sync");
+    assertEqual(15, level.countAvailableSpots(), "Occupancy bitmap should match the running count");
+    
+    cout << "Free spot index tests passed!" << endl;
+}
+
 void testEdgeCases() {
     cout << "Running edge case tests..." << endl;
     
@@ -146,6 +281,7 @@ void testEdgeCases() {
     
     // Test parking when lot is full
     vector<Car> cars;
+    cars.reserve(10);
     for (int i = 0; i < 10; i++) {
         cars.emplace_back("CAR" + to_string(i));
         parkingLot.parkVehicle(&cars[i]);
@@ -162,14 +298,70 @@ void testEdgeCases() {
     cout << "Edge case tests passed!" << endl;
 }
 
+void testInstrumentation() {
+    cout << "Running instrumentation tests..." << endl;
+    
+    MetricsSnapshot before = Metrics::snapshot();
+    ParkingLot parkingLot(2, 1, 10);
+    
+    // Two gates park and unpark on their own threads, which have exited by
+    // the time the snapshot is taken
+    vector<vector<Car>> cars(2);
+    vector<thread> threads;
+    for (int gate = 0; gate < 2; gate++) {
+        for (int i = 0; i < 5; i++) {
+            cars[gate].emplace_back("M" + to_string(gate) + "CAR" + to_string(i));
+        }
+        threads.emplace_back([&parkingLot, &cars, gate]() {
+            for (auto& car : cars[gate]) parkingLot.parkVehicle(&car, gate);
+            for (auto& car : cars[gate]) parkingLot.unparkVehicle(car.getLicensePlate());
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    Bus bus("MBUS");
+    assertTrue(parkingLot.parkVehicle(&bus), "Bus should park");
+    
+    MetricsSnapshot after = Metrics::snapshot();
+    if (!Metrics::enabled) {
+        assertTrue(after.counters.empty() && after.histograms.empty(), "Disabled builds report nothing");
+        cout << "Instrumentation tests passed!" << endl;
+        return;
+    }
+    
+    auto delta = [&](const string& name) {
+        return static_cast<int>(after.counter(name) - before.counter(name));
+    };
+    assertEqual(11, static_cast<int>(after.histogram("parking.park_ns").count - before.histogram("parking.park_ns").count),
+                "Every park is timed");
+    assertEqual(10, static_cast<int>(after.histogram("parking.unpark_ns").count - before.histogram("parking.unpark_ns").count),
+                "Every unpark is timed");
+    assertEqual(11, delta("parking.levels_tried"), "Each vehicle fits on the first level tried");
+    assertEqual(21, delta("parking.level_lock.acquisitions"), "One level lock per park and unpark");
+    assertEqual(21, delta("parking.location_lock.acquisitions"), "One shard lock per park and unpark");
+    assertTrue(delta("parking.run_nodes_scanned") > 0, "Bus search walks the run tree");
+    
+    HistogramSnapshot parks = after.histogram("parking.park_ns");
+    assertTrue(parks.percentile(0.5) <= parks.percentile(0.99), "Percentiles are ordered");
+    assertTrue(parks.percentile(1.0) <= parks.max, "Percentiles stay within the maximum");
+    assertTrue(after.toString().find("parking.park_ns count=") != string::npos, "Snapshot renders as text");
+    
+    cout << "Instrumentation tests passed!" << endl;
+}
+
 int main() {
     try {
         testBasicParking();
         testUnparking();
         testConcurrentParking();
         testBusParking();
+        testRunAllocation();
         testVehicleTracking();
+        testParkingTicket();
+        testFreeSpotIndex();
         testEdgeCases();
+        testInstrumentation();
         
         cout << "All tests passed!" << endl;
         return 0;
@@ -3,12 +3,32 @@
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <queue>
 #include <chrono>
 #include <stdexcept>
 #include <algorithm>
-#include <random>
+#include <array>
+#include <functional>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+#include <optional>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../common/instrumentation.h"
 
 using namespace std;
 using namespace chrono;
@@ -24,97 +44,326 @@ class Order;
 class Payment;
 class Table;
 
+// Money class implementation
+// Whole cents in a signed 64-bit integer. Dollar amounts are rounded to
+// the cent once, where they enter; all arithmetic after that is exact.
+class Money {
+private:
+    int64_t cents;
+    
+    explicit constexpr Money(int64_t cents, bool) : cents(cents) {}
+
+public:
+    constexpr Money() : cents(0) {}
+    
+    // Explicit, so a stray double never turns into money unnoticed
+    explicit Money(double dollars) : cents(llround(dollars * 100.0)) {}
+    
+    static constexpr Money fromCents(int64_t cents) { return Money(cents, true); }
+    
+    // Rounds half away from zero, as a receipt would
+    static constexpr int64_t percentOf(int64_t cents, int64_t basisPoints) {
+        return (cents * basisPoints + (cents < 0 ? -5000 : 5000)) / 10000;
+    }
+    
+    // Sum of percentOf over non-negative amounts with amount * basisPoints
+    // below 2^52. x86-64 has no packed 64-bit divide, multiply or int64 to
+    // double conversion before AVX-512DQ, so with AVX2 the loop stays in
+    // doubles: integers enter and leave through the 2^52 exponent trick, the
+    // quotient is estimated by a multiply and then corrected by the
+    // remainder. GCC vectorizes it from -mavx2 (-march=x86-64-v3) up. Plain
+    // SSE2 has only two lanes, where the scalar divide-by-constant is faster.
+    static int64_t sumPercentOf(const int64_t* amounts, size_t count, int64_t basisPoints) {
+        int64_t sum = 0;
+#ifdef __AVX2__
+        const double rate = static_cast<double>(basisPoints);
+        for (size_t i = 0; i < count; i++) {
+            double scaled = (bitsToDouble(static_cast<uint64_t>(amounts[i]) | TWO_52_BITS) - TWO_52) * rate + 5000.0;
+            double quotient = (scaled * 1e-4 + TWO_52) - TWO_52;
+            double remainder = scaled - quotient * 10000.0;
+            quotient += (remainder >= 10000.0 ? 1.0 : 0.0) - (remainder < 0.0 ? 1.0 : 0.0);
+            sum += static_cast<int64_t>(doubleToBits(quotient + TWO_52) - TWO_52_BITS);
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+            sum += (amounts[i] * basisPoints + 5000) / 10000;
+        }
+#endif
+        return sum;
+    }
+    
+    constexpr int64_t getCents() const { return cents; }
+    constexpr double toDollars() const { return cents / 100.0; }
+    
+    Money& operator+=(Money other) { cents += other.cents; return *this; }
+    Money& operator-=(Money other) { cents -= other.cents; return *this; }
+    
+    friend Money operator+(Money a, Money b) { return fromCents(a.cents + b.cents); }
+    friend Money operator-(Money a, Money b) { return fromCents(a.cents - b.cents); }
+    friend Money operator*(Money a, int64_t count) { return fromCents(a.cents * count); }
+    friend bool operator==(Money a, Money b) { return a.cents == b.cents; }
+    friend bool operator!=(Money a, Money b) { return a.cents != b.cents; }
+    friend bool operator<(Money a, Money b) { return a.cents < b.cents; }
+    friend bool operator<=(Money a, Money b) { return a.cents <= b.cents; }
+    friend bool operator>(Money a, Money b) { return a.cents > b.cents; }
+    friend bool operator>=(Money a, Money b) { return a.cents >= b.cents; }
+    
+    string toString() const {
+        ostringstream out;
+        int64_t magnitude = cents < 0 ? -cents : cents;
+        out << (cents < 0 ? "-$" : "$") << magnitude / 100 << '.' << setw(2) << setfill('0') << magnitude % 100;
+        return out.str();
+    }
+    
+    friend ostream& operator<<(ostream& out, Money money) { return out << money.toString(); }
+
+private:
+    // 2^52 and its bit pattern: below it, an integer's bits OR'd into the
+    // pattern read back as 2^52 plus that integer
+    static constexpr double TWO_52 = 4503599627370496.0;
+    static constexpr uint64_t TWO_52_BITS = 0x4330000000000000ull;
+    
+    static double bitsToDouble(uint64_t bits) {
+        double value;
+        memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+    
+    static uint64_t doubleToBits(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof bits);
+        return bits;
+    }
+};
+
+// Scaling money by a fraction would truncate the fraction to a whole
+// count, so money * 1.5 does not compile
+template <typename Scale, typename = enable_if_t<is_floating_point<Scale>::value>>
+Money operator*(Money money, Scale scale) = delete;
+
+// Lock acquisitions, and how many of them found the lock already held,
+// summed over every InstrumentedMutex registered under the name
+struct LockStats {
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    
+    static LockStats fromMetrics(const MetricsSnapshot& metrics, const string& name) {
+        LockStats stats;
+        stats.acquisitions = metrics.counter(name + ".acquisitions");
+        stats.contended = metrics.counter(name + ".contended");
+        return stats;
+    }
+};
+
+// IdGenerator class implementation
+// Ids are "<prefix><boot>.<thread slot>-<sequence>". A thread claims its
+// slot once, then numbers its own ids, so generating one touches no shared
+// state. The boot stamp keeps ids unique across restarts, since recovered
+// orders keep theirs.
+class IdGenerator {
+public:
+    static string next(const string& prefix) {
+        struct ThreadIds {
+            uint32_t slot = nextSlot()++;
+            uint64_t sequence = 0;
+        };
+        thread_local ThreadIds ids;
+        return prefix + bootStamp() + "." + to_string(ids.slot) + "-" + to_string(++ids.sequence);
+    }
+
+private:
+    // Process start time in microseconds, base 36
+    static const string& bootStamp() {
+        static const string stamp = []() {
+            uint64_t micros = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+            string digits;
+            do {
+                digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[micros % 36]);
+                micros /= 36;
+            } while (micros > 0);
+            return digits;
+        }();
+        return stamp;
+    }
+    
+    static atomic<uint32_t>& nextSlot() {
+        static atomic<uint32_t> slot(0);
+        return slot;
+    }
+};
+
 // MenuItem class implementation
+// A plain value with no lock of its own. Once an item is in a published
+// MenuSnapshot it is const and never changes; Menu edits a private copy and
+// publishes that, so readers need no synchronization.
 class MenuItem {
 private:
     string id;
     string name;
-    double price;
+    Money price;
     string category;
     bool available;
     map<string, string> translations;
-    mutex itemMutex;
 
 public:
-    MenuItem(const string& name, double price, const string& category)
-        : name(name), price(price), category(category), available(true) {
-        static random_device rd;
-        static mt19937 gen(rd());
-        static uniform_int_distribution<> dis(1000, 9999);
-        id = "ITEM" + to_string(dis(gen));
-    }
+    MenuItem(const string& name, Money price, const string& category)
+        : id(IdGenerator::next("ITEM")), name(name), price(price), category(category), available(true) {}
     
     string getId() const { return id; }
     string getName() const { return name; }
-    double getPrice() const { return price; }
+    string getCategory() const { return category; }
+    Money getPrice() const { return price; }
     bool isAvailable() const { return available; }
     
-    void setPrice(double newPrice) {
-        lock_guard<mutex> lock(itemMutex);
-        price = newPrice;
-    }
-    
-    void setAvailability(bool available) {
-        lock_guard<mutex> lock(itemMutex);
-        this->available = available;
-    }
+    void setPrice(Money newPrice) { price = newPrice; }
+    void setAvailability(bool available) { this->available = available; }
     
     void addTranslation(const string& language, const string& translation) {
-        lock_guard<mutex> lock(itemMutex);
         translations[language] = translation;
     }
     
     string getTranslation(const string& language) const {
-        lock_guard<mutex> lock(itemMutex);
         auto it = translations.find(language);
         return it != translations.end() ? it->second : name;
     }
 };
 
+using MenuItemList = vector<shared_ptr<const MenuItem>>;
+
+// An immutable view of the whole menu. Publishing copies only the maps of
+// pointers and rebuilds the one category that changed; every other item
+// and category list is shared with the previous version.
+struct MenuSnapshot {
+    uint64_t version = 0;
+    unordered_map<string, shared_ptr<const MenuItem>> items;
+    unordered_map<string, shared_ptr<const MenuItemList>> byCategory;
+    
+    shared_ptr<const MenuItem> findItem(const string& id) const {
+        auto it = items.find(id);
+        return it != items.end() ? it->second : nullptr;
+    }
+    
+    shared_ptr<const MenuItemList> findCategory(const string& category) const {
+        static const shared_ptr<const MenuItemList> empty = make_shared<MenuItemList>();
+        auto it = byCategory.find(category);
+        return it != byCategory.end() ? it->second : empty;
+    }
+};
+
 // Menu class implementation
+// Copy-on-write: writers serialize on menuMutex, build the next snapshot
+// and publish it. Readers take no lock; each thread keeps the snapshot it
+// last used and reloads it only when the published version moves on.
 class Menu {
 private:
-    unordered_map<string, MenuItem> items;
-    unordered_multimap<string, string> itemsByCategory;
-    mutex menuMutex;
+    shared_ptr<const MenuSnapshot> current;
+    atomic<uint64_t> version;
+    const uint64_t menuId;
+    InstrumentedMutex menuMutex{"restaurant.menu_lock"};
 
 public:
+    Menu() : current(make_shared<MenuSnapshot>()), version(0), menuId(nextMenuId()++) {}
+    
     void addItem(const MenuItem& item) {
-        lock_guard<mutex> lock(menuMutex);
-        items[item.getId()] = item;
-        itemsByCategory.insert({item.getCategory(), item.getId()});
+        lock_guard<InstrumentedMutex> lock(menuMutex);
+        auto next = make_shared<MenuSnapshot>(*current);
+        auto old = next->findItem(item.getId());
+        if (old) removeFromCategory(*next, *old);
+        auto added = make_shared<const MenuItem>(item);
+        next->items[item.getId()] = added;
+        addToCategory(*next, added);
+        publish(move(next));
     }
     
     void removeItem(const string& id) {
-        lock_guard<mutex> lock(menuMutex);
-        auto it = items.find(id);
-        if (it != items.end()) {
-            itemsByCategory.erase(it->second.getCategory());
-            items.erase(it);
-        }
+        lock_guard<InstrumentedMutex> lock(menuMutex);
+        auto old = current->findItem(id);
+        if (!old) return;
+        auto next = make_shared<MenuSnapshot>(*current);
+        removeFromCategory(*next, *old);
+        next->items.erase(id);
+        publish(move(next));
     }
     
-    MenuItem* getItem(const string& id) {
-        lock_guard<mutex> lock(menuMutex);
-        auto it = items.find(id);
-        return it != items.end() ? &it->second : nullptr;
+    shared_ptr<const MenuItem> getItem(const string& id) const {
+        return getSnapshot()->findItem(id);
     }
     
-    vector<MenuItem> getItemsByCategory(const string& category) {
-        lock_guard<mutex> lock(menuMutex);
-        vector<MenuItem> result;
-        auto range = itemsByCategory.equal_range(category);
-        for (auto it = range.first; it != range.second; ++it) {
-            result.push_back(items[it->second]);
+    shared_ptr<const MenuItemList> getItemsByCategory(const string& category) const {
+        return getSnapshot()->findCategory(category);
+    }
+    
+    void updateItemPrice(const string& id, Money newPrice) {
+        modifyItem(id, [newPrice](MenuItem& item) { item.setPrice(newPrice); });
+    }
+    
+    void setAvailability(const string& id, bool available) {
+        modifyItem(id, [available](MenuItem& item) { item.setAvailability(available); });
+    }
+    
+    shared_ptr<const MenuSnapshot> getSnapshot() const {
+        struct CachedSnapshot {
+            uint64_t menuId = UINT64_MAX;
+            uint64_t version = 0;
+            shared_ptr<const MenuSnapshot> snapshot;
+        };
+        thread_local CachedSnapshot cached;
+        uint64_t published = version.load(memory_order_acquire);
+        if (cached.menuId != menuId || cached.version != published) {
+            cached.snapshot = atomic_load(&current);
+            cached.menuId = menuId;
+            cached.version = cached.snapshot->version;
         }
-        return result;
+        return cached.snapshot;
     }
     
-    void updateItemPrice(const string& id, double newPrice) {
-        lock_guard<mutex> lock(menuMutex);
-        auto it = items.find(id);
-        if (it != items.end()) {
-            it->second.setPrice(newPrice);
+    uint64_t getVersion() const { return version.load(memory_order_acquire); }
+
+private:
+    static atomic<uint64_t>& nextMenuId() {
+        static atomic<uint64_t> id(0);
+        return id;
+    }
+    
+    template<typename Change>
+    void modifyItem(const string& id, Change change) {
+        lock_guard<InstrumentedMutex> lock(menuMutex);
+        auto old = current->findItem(id);
+        if (!old) return;
+        auto updated = make_shared<MenuItem>(*old);
+        change(*updated);
+        auto next = make_shared<MenuSnapshot>(*current);
+        removeFromCategory(*next, *old);
+        next->items[id] = updated;
+        addToCategory(*next, updated);
+        publish(move(next));
+    }
+    
+    // The snapshot is stored before the version, so a reader that sees the
+    // new version always loads the new snapshot
+    void publish(shared_ptr<MenuSnapshot> next) {
+        next->version = current->version + 1;
+        uint64_t nextVersion = next->version;
+        atomic_store(&current, shared_ptr<const MenuSnapshot>(move(next)));
+        version.store(nextVersion, memory_order_release);
+    }
+    
+    static void addToCategory(MenuSnapshot& snapshot, const shared_ptr<const MenuItem>& item) {
+        auto list = make_shared<MenuItemList>(*snapshot.findCategory(item->getCategory()));
+        list->push_back(item);
+        snapshot.byCategory[item->getCategory()] = move(list);
+    }
+    
+    // Drops only this item's entry from its category
+    static void removeFromCategory(MenuSnapshot& snapshot, const MenuItem& item) {
+        auto list = make_shared<MenuItemList>(*snapshot.findCategory(item.getCategory()));
+        list->erase(remove_if(list->begin(), list->end(),
+                              [&](const shared_ptr<const MenuItem>& entry) { return entry->getId() == item.getId(); }),
+                    list->end());
+        if (list->empty()) {
+            snapshot.byCategory.erase(item.getCategory());
+        } else {
+            snapshot.byCategory[item.getCategory()] = move(list);
         }
     }
 };
@@ -125,26 +374,289 @@ private:
     string menuItemId;
     int quantity;
     vector<string> specialInstructions;
-    double price;
+    Money price;
+    string station;     // kitchen station, the menu item's category
+    uint32_t lineId;    // stable within the order, for kitchen tickets
+    ItemStatus status;
 
 public:
-    OrderItem(const string& menuItemId, int quantity, double price)
-        : menuItemId(menuItemId), quantity(quantity), price(price) {}
+    OrderItem(const string& menuItemId, int quantity, Money price,
+              const string& station = "", uint32_t lineId = 0)
+        : menuItemId(menuItemId), quantity(quantity), price(price), station(station),
+          lineId(lineId), status(ItemStatus::PENDING) {}
     
     void addSpecialInstruction(const string& instruction) {
         specialInstructions.push_back(instruction);
     }
     
-    double getSubtotal() const {
+    Money getSubtotal() const {
         return price * quantity;
     }
     
+    void setQuantity(int newQuantity) {
+        quantity = newQuantity;
+    }
+    
+    void setStatus(ItemStatus newStatus) {
+        status = newStatus;
+    }
+    
     string getMenuItemId() const { return menuItemId; }
     int getQuantity() const { return quantity; }
+    Money getPrice() const { return price; }
+    string getStation() const { return station; }
+    uint32_t getLineId() const { return lineId; }
+    ItemStatus getStatus() const { return status; }
     const vector<string>& getSpecialInstructions() const { return specialInstructions; }
 };
 
+enum class OrderEventType : uint8_t {
+    ORDER_CREATED, ITEM_ADDED, ITEM_REMOVED, QUANTITY_CHANGED, STATUS_CHANGED, PAYMENT,
+    TABLE_SEATED, TABLE_RELEASED
+};
+
+// One entry of the order event log; fields a type does not use stay empty
+struct OrderEvent {
+    OrderEventType type = OrderEventType::ORDER_CREATED;
+    int64_t timestamp = 0;  // microseconds since the epoch
+    int32_t value = 0;      // table number, quantity, status or payment method count
+    int64_t cents = 0;      // item price or amount paid
+    string orderId;
+    string menuItemId;
+    string station;
+    
+    OrderEvent() = default;
+    
+    OrderEvent(OrderEventType type, const string& orderId, int32_t value = 0, int64_t cents = 0)
+        : type(type), timestamp(toMicros(system_clock::now())), value(value), cents(cents), orderId(orderId) {}
+    
+    static int64_t toMicros(system_clock::time_point time) {
+        return duration_cast<microseconds>(time.time_since_epoch()).count();
+    }
+    
+    static system_clock::time_point fromMicros(int64_t micros) {
+        return system_clock::time_point(duration_cast<system_clock::duration>(microseconds(micros)));
+    }
+    
+    string encode() const {
+        string bytes;
+        bytes.push_back(static_cast<char>(type));
+        appendRaw(bytes, timestamp);
+        appendRaw(bytes, value);
+        appendRaw(bytes, cents);
+        for (const string* field : {&orderId, &menuItemId, &station}) {
+            appendRaw(bytes, static_cast<uint32_t>(field->size()));
+            bytes += *field;
+        }
+        return bytes;
+    }
+    
+    // False if the payload is cut short
+    bool decode(const char* data, size_t size) {
+        size_t offset = 1;
+        if (size < 1) return false;
+        type = static_cast<OrderEventType>(data[0]);
+        if (!readRaw(data, size, offset, timestamp) || !readRaw(data, size, offset, value) ||
+            !readRaw(data, size, offset, cents)) {
+            return false;
+        }
+        for (string* field : {&orderId, &menuItemId, &station}) {
+            uint32_t length;
+            if (!readRaw(data, size, offset, length) || size - offset < length) return false;
+            field->assign(data + offset, length);
+            offset += length;
+        }
+        return offset == size;
+    }
+
+private:
+    template<typename T>
+    static void appendRaw(string& bytes, T value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    template<typename T>
+    static bool readRaw(const char* data, size_t size, size_t& offset, T& value) {
+        if (size - offset < sizeof(value)) return false;
+        memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    }
+};
+
+// OrderEventLog class implementation
+// Append-only, framed as [u32 length][u32 FNV-1a checksum][payload] after
+// an 8-byte magic. Request threads only encode and queue an event; one
+// background writer takes everything queued so far and commits it with a
+// single write and a single fdatasync, so the sync cost is shared by every
+// event in the batch. Callers that need durability wait on the sequence
+// number append returns.
+class OrderEventLog {
+private:
+    static constexpr char MAGIC[8] = {'O', 'R', 'D', 'L', 'O', 'G', '0', '1'};
+    
+    int fd;
+    bool syncOnCommit;
+    string pending;       // framed events not yet handed to the writer
+    uint64_t appended;    // sequence of the last queued event
+    uint64_t durable;     // sequence of the last committed event
+    size_t batchCount;
+    bool stopping;
+    bool failed;
+    mutex logMutex;
+    condition_variable wakeWriter;
+    condition_variable committed;
+    thread writer;
+
+public:
+    explicit OrderEventLog(bool syncOnCommit = true)
+        : fd(-1), syncOnCommit(syncOnCommit), appended(0), durable(0), batchCount(0),
+          stopping(false), failed(false) {}
+    
+    ~OrderEventLog() {
+        close();
+    }
+    
+    OrderEventLog(const OrderEventLog&) = delete;
+    OrderEventLog& operator=(const OrderEventLog&) = delete;
+    
+    // Feeds every intact event at path to apply, drops a torn tail, then
+    // starts appending after the last good event
+    void open(const string& path, const function<void(const OrderEvent&)>& apply) {
+        size_t validLength = replay(path, apply);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw runtime_error("Cannot open order log: " + path);
+        if (ftruncate(fd, validLength) != 0) throw runtime_error("Cannot truncate order log: " + path);
+        if (validLength == 0) {
+            writeAll(MAGIC, sizeof(MAGIC));
+            fdatasync(fd);
+        }
+        writer = thread([this]() { writerLoop(); });
+    }
+    
+    // Reads without opening for append, as an audit would; returns the
+    // length of the intact prefix
+    static size_t replay(const string& path, const function<void(const OrderEvent&)>& apply) {
+        size_t validLength = 0;
+        ifstream in(path, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (data.size() >= sizeof(MAGIC) && memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0) {
+            validLength = sizeof(MAGIC);
+            uint32_t frame[2];  // length, checksum
+            while (data.size() - validLength >= sizeof(frame)) {
+                memcpy(frame, data.data() + validLength, sizeof(frame));
+                const char* payload = data.data() + validLength + sizeof(frame);
+                OrderEvent event;
+                if (frame[0] > data.size() - validLength - sizeof(frame) ||
+                    checksum(payload, frame[0]) != frame[1] || !event.decode(payload, frame[0])) {
+                    break;
+                }
+                apply(event);
+                validLength += sizeof(frame) + frame[0];
+            }
+        }
+        return validLength;
+    }
+    
+    // Queues the event and returns at once with its sequence number
+    uint64_t append(const OrderEvent& event) {
+        string bytes = event.encode();
+        uint32_t frame[2] = {static_cast<uint32_t>(bytes.size()), checksum(bytes.data(), bytes.size())};
+        lock_guard<mutex> lock(logMutex);
+        pending.append(reinterpret_cast<const char*>(frame), sizeof(frame));
+        pending += bytes;
+        wakeWriter.notify_one();
+        return ++appended;
+    }
+    
+    void waitDurable(uint64_t sequence) {
+        unique_lock<mutex> lock(logMutex);
+        committed.wait(lock, [&]() { return durable >= sequence || failed; });
+        if (failed) throw runtime_error("Order log write failed");
+    }
+    
+    // Waits for everything appended so far
+    void flush() {
+        uint64_t sequence;
+        {
+            lock_guard<mutex> lock(logMutex);
+            sequence = appended;
+        }
+        waitDurable(sequence);
+    }
+    
+    // Commits what is queued, then stops the writer
+    void close() {
+        {
+            lock_guard<mutex> lock(logMutex);
+            stopping = true;
+            wakeWriter.notify_one();
+        }
+        if (writer.joinable()) writer.join();
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+    
+    uint64_t getDurableCount() {
+        lock_guard<mutex> lock(logMutex);
+        return durable;
+    }
+    
+    size_t getBatchCount() {
+        lock_guard<mutex> lock(logMutex);
+        return batchCount;
+    }
+
+private:
+    void writerLoop() {
+        static const int commitTime = Metrics::histogram("restaurant.log_commit_ns");
+        static const int batchBytes = Metrics::histogram("restaurant.log_batch_bytes");
+        unique_lock<mutex> lock(logMutex);
+        while (true) {
+            wakeWriter.wait(lock, [&]() { return !pending.empty() || stopping; });
+            if (pending.empty()) return;
+            
+            string batch;
+            batch.swap(pending);
+            uint64_t last = appended;
+            lock.unlock();
+            Metrics::record(batchBytes, batch.size());
+            bool ok;
+            {
+                ScopedTimer timer(commitTime);
+                ok = writeAll(batch.data(), batch.size()) && (!syncOnCommit || fdatasync(fd) == 0);
+            }
+            lock.lock();
+            
+            if (!ok) failed = true;
+            else durable = last;
+            batchCount++;
+            committed.notify_all();
+        }
+    }
+    
+    bool writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) return false;
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+    
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+};
+
 // Order class implementation
+// Changes are logged under the order lock, so an order's events are in
+// the order they were applied.
 class Order {
 private:
     string id;
@@ -152,39 +664,86 @@ private:
     vector<OrderItem> items;
     OrderStatus status;
     chrono::system_clock::time_point orderTime;
-    mutex orderMutex;
+    uint32_t nextLineId;
+    Money total;  // kept in step with items so getTotal is O(1)
+    Money paid;
+    OrderEventLog* journal;
+    mutable mutex orderMutex;
 
 public:
-    Order(int tableNumber) : tableNumber(tableNumber), status(OrderStatus::PENDING) {
-        static random_device rd;
-        static mt19937 gen(rd());
-        static uniform_int_distribution<> dis(1000, 9999);
-        id = "ORDER" + to_string(dis(gen));
-        orderTime = system_clock::now();
+    Order(int tableNumber, OrderEventLog* journal = nullptr)
+        : id(IdGenerator::next("ORDER")), tableNumber(tableNumber), status(OrderStatus::PENDING),
+          orderTime(system_clock::now()), nextLineId(0), journal(journal) {
+        if (journal) {
+            OrderEvent event(OrderEventType::ORDER_CREATED, id, tableNumber);
+            event.timestamp = OrderEvent::toMicros(orderTime);
+            journal->append(event);
+        }
+    }
+    
+    // Recovery: an order as first logged, before its later events replay
+    Order(const string& id, int tableNumber, system_clock::time_point orderTime)
+        : id(id), tableNumber(tableNumber), status(OrderStatus::PENDING), orderTime(orderTime),
+          nextLineId(0), journal(nullptr) {}
+    
+    void setJournal(OrderEventLog* log) {
+        lock_guard<mutex> lock(orderMutex);
+        journal = log;
     }
     
-    void addItem(const MenuItem& item, int quantity) {
+    // Returns the new line. Once the order is confirmed, sendToKitchen is
+    // set and the caller dispatches the line, decided under the order lock
+    // so a line is never sent twice or missed by a concurrent confirm. A
+    // READY order goes back to PREPARING for the new line; delivered and
+    // cancelled orders are closed.
+    OrderItem addItem(const MenuItem& item, int quantity, bool* sendToKitchen = nullptr) {
         lock_guard<mutex> lock(orderMutex);
+        if (status == OrderStatus::DELIVERED || status == OrderStatus::CANCELLED) {
+            throw runtime_error("Order is closed");
+        }
         if (items.size() >= 20) {
             throw runtime_error("Order size limit exceeded");
         }
-        items.emplace_back(item.getId(), quantity, item.getPrice());
+        addLineLocked(item.getId(), quantity, item.getPrice(), item.getCategory());
+        if (status == OrderStatus::READY) setStatusLocked(OrderStatus::PREPARING);
+        if (sendToKitchen) *sendToKitchen = status != OrderStatus::PENDING;
+        return items.back();
+    }
+    
+    // Recovery: replays a logged line without a menu lookup
+    void restoreItem(const string& menuItemId, int quantity, Money price, const string& station) {
+        lock_guard<mutex> lock(orderMutex);
+        addLineLocked(menuItemId, quantity, price, station);
     }
     
     void removeItem(const string& menuItemId) {
         lock_guard<mutex> lock(orderMutex);
-        items.erase(
-            remove_if(items.begin(), items.end(),
-                [&](const OrderItem& item) { return item.getMenuItemId() == menuItemId; }),
-            items.end()
-        );
+        auto removed = remove_if(items.begin(), items.end(),
+            [&](const OrderItem& item) { return item.getMenuItemId() == menuItemId; });
+        if (removed == items.end()) return;
+        for (auto it = removed; it != items.end(); ++it) {
+            total -= it->getSubtotal();
+        }
+        items.erase(removed, items.end());
+        if (journal) {
+            OrderEvent event(OrderEventType::ITEM_REMOVED, id);
+            event.menuItemId = menuItemId;
+            journal->append(event);
+        }
     }
     
     void updateItemQuantity(const string& menuItemId, int quantity) {
         lock_guard<mutex> lock(orderMutex);
         for (auto& item : items) {
             if (item.getMenuItemId() == menuItemId) {
-                item = OrderItem(menuItemId, quantity, item.getPrice());
+                total -= item.getSubtotal();
+                item.setQuantity(quantity);
+                total += item.getSubtotal();
+                if (journal) {
+                    OrderEvent event(OrderEventType::QUANTITY_CHANGED, id, quantity);
+                    event.menuItemId = menuItemId;
+                    journal->append(event);
+                }
                 break;
             }
         }
@@ -192,18 +751,78 @@ public:
     
     void updateStatus(OrderStatus newStatus) {
         lock_guard<mutex> lock(orderMutex);
-        status = newStatus;
+        setStatusLocked(newStatus);
     }
     
-    double getTotal() const {
+    // Returns the event sequence, or 0 without a journal, so the caller can
+    // wait for the payment to be durable
+    uint64_t recordPayment(Money amount, int methodCount) {
         lock_guard<mutex> lock(orderMutex);
-        double total = 0.0;
-        for (const auto& item : items) {
-            total += item.getSubtotal();
+        return recordPaymentLocked(amount, methodCount);
+    }
+    
+    // Collects the balance in one step under the order lock, so two
+    // terminals can never both charge it. charge is handed the amount owed
+    // and reports whether it was covered. False if the order is cancelled,
+    // owes nothing or the charge fails; sequence is set as by recordPayment.
+    bool payBalance(const function<bool(Money)>& charge, int methodCount, uint64_t& sequence) {
+        lock_guard<mutex> lock(orderMutex);
+        Money owed = total - paid;
+        if (status == OrderStatus::CANCELLED || owed <= Money()) return false;
+        if (!charge(owed)) return false;
+        sequence = recordPaymentLocked(owed, methodCount);
+        return true;
+    }
+    
+    // Moves a pending order to CONFIRMED and returns its lines for the
+    // kitchen; empty if it was already confirmed
+    vector<OrderItem> confirm() {
+        lock_guard<mutex> lock(orderMutex);
+        if (status != OrderStatus::PENDING) return {};
+        setStatusLocked(OrderStatus::CONFIRMED);
+        return items;
+    }
+    
+    // Kitchen progress for one line. The order follows its lines: PREPARING
+    // once any line starts, READY once every line is ready. False if the
+    // line was removed or the order is no longer in the kitchen.
+    bool updateItemStatus(uint32_t lineId, ItemStatus newStatus) {
+        lock_guard<mutex> lock(orderMutex);
+        if (status != OrderStatus::CONFIRMED && status != OrderStatus::PREPARING) return false;
+        auto it = find_if(items.begin(), items.end(),
+                          [&](const OrderItem& item) { return item.getLineId() == lineId; });
+        if (it == items.end()) return false;
+        
+        it->setStatus(newStatus);
+        bool allReady = all_of(items.begin(), items.end(),
+                               [](const OrderItem& item) { return item.getStatus() >= ItemStatus::READY; });
+        setStatusLocked(allReady ? OrderStatus::READY : OrderStatus::PREPARING);
+        return true;
+    }
+    
+    // Recovery: lines a confirmed order still needs cooked; empty once the
+    // order has left the kitchen
+    vector<OrderItem> getUnfinishedLines() const {
+        lock_guard<mutex> lock(orderMutex);
+        if (status != OrderStatus::CONFIRMED && status != OrderStatus::PREPARING) return {};
+        vector<OrderItem> lines;
+        for (const OrderItem& item : items) {
+            if (item.getStatus() < ItemStatus::READY) lines.push_back(item);
         }
+        return lines;
+    }
+    
+    Money getTotal() const {
+        lock_guard<mutex> lock(orderMutex);
         return total;
     }
     
+    // Read together so settlement never bills an order that was just cancelled
+    pair<OrderStatus, Money> getStatusAndTotal() const {
+        lock_guard<mutex> lock(orderMutex);
+        return {status, total};
+    }
+    
     bool canAddMoreItems() const {
         lock_guard<mutex> lock(orderMutex);
         return items.size() < 20;
@@ -211,41 +830,145 @@ public:
     
     string getId() const { return id; }
     int getTableNumber() const { return tableNumber; }
-    OrderStatus getStatus() const { return status; }
-    const vector<OrderItem>& getItems() const { return items; }
+    system_clock::time_point getOrderTime() const { return orderTime; }
+    
+    OrderStatus getStatus() const {
+        lock_guard<mutex> lock(orderMutex);
+        return status;
+    }
+    
+    Money getAmountPaid() const {
+        lock_guard<mutex> lock(orderMutex);
+        return paid;
+    }
+    
+    vector<OrderItem> getItems() const {
+        lock_guard<mutex> lock(orderMutex);
+        return items;
+    }
+
+private:
+    void addLineLocked(const string& menuItemId, int quantity, Money price, const string& station) {
+        items.emplace_back(menuItemId, quantity, price, station, nextLineId++);
+        total += items.back().getSubtotal();
+        if (journal) {
+            OrderEvent event(OrderEventType::ITEM_ADDED, id, quantity, price.getCents());
+            event.menuItemId = menuItemId;
+            event.station = station;
+            journal->append(event);
+        }
+    }
+    
+    uint64_t recordPaymentLocked(Money amount, int methodCount) {
+        paid += amount;
+        return journal ? journal->append(OrderEvent(OrderEventType::PAYMENT, id, methodCount, amount.getCents())) : 0;
+    }
+    
+    void setStatusLocked(OrderStatus newStatus) {
+        if (status == newStatus) return;
+        status = newStatus;
+        if (journal) journal->append(OrderEvent(OrderEventType::STATUS_CHANGED, id, static_cast<int32_t>(newStatus)));
+    }
+};
+
+// OrderHistory class implementation
+// Rebuilds orders and table occupancy from the event log. Kitchen progress
+// is not logged per line, so recovered lines start over as PENDING and
+// orders still in the kitchen are sent back to it.
+class OrderHistory {
+private:
+    unordered_map<string, shared_ptr<Order>> orders;
+    map<int, bool> seated;
+    size_t appliedCount = 0;
+
+public:
+    void apply(const OrderEvent& event) {
+        appliedCount++;
+        if (event.type == OrderEventType::TABLE_SEATED || event.type == OrderEventType::TABLE_RELEASED) {
+            seated[event.value] = event.type == OrderEventType::TABLE_SEATED;
+            return;
+        }
+        if (event.type == OrderEventType::ORDER_CREATED) {
+            orders[event.orderId] = make_shared<Order>(event.orderId, event.value, OrderEvent::fromMicros(event.timestamp));
+            return;
+        }
+        
+        auto it = orders.find(event.orderId);
+        if (it == orders.end()) return;
+        Order& order = *it->second;
+        switch (event.type) {
+            case OrderEventType::ITEM_ADDED:
+                order.restoreItem(event.menuItemId, event.value, Money::fromCents(event.cents), event.station);
+                break;
+            case OrderEventType::ITEM_REMOVED:
+                order.removeItem(event.menuItemId);
+                break;
+            case OrderEventType::QUANTITY_CHANGED:
+                order.updateItemQuantity(event.menuItemId, event.value);
+                break;
+            case OrderEventType::STATUS_CHANGED:
+                order.updateStatus(static_cast<OrderStatus>(event.value));
+                break;
+            case OrderEventType::PAYMENT:
+                order.recordPayment(Money::fromCents(event.cents), event.value);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    const unordered_map<string, shared_ptr<Order>>& getOrders() const { return orders; }
+    const map<int, bool>& getSeatedTables() const { return seated; }
+    size_t getAppliedCount() const { return appliedCount; }
+};
+
+// What a receipt shows, copied out of a Payment so it can be rendered
+// without holding the payment lock
+struct Receipt {
+    string paymentId;
+    string orderId;
+    Money amount;
+    vector<pair<PaymentMethod, Money>> paymentMethods;
+    bool completed = false;
+    
+    string render() const {
+        ostringstream out;
+        out << "Receipt for Payment " << paymentId << endl;
+        if (!orderId.empty()) out << "Order: " << orderId << endl;
+        out << "Total Amount: " << amount << endl;
+        out << "Payment Methods:" << endl;
+        for (const auto& payment : paymentMethods) {
+            out << "- " << static_cast<int>(payment.first) << ": " << payment.second << endl;
+        }
+        out << "Status: " << (completed ? "Completed" : "Pending") << endl;
+        return out.str();
+    }
 };
 
 // Payment class implementation
 class Payment {
 private:
     string id;
-    double amount;
-    vector<pair<PaymentMethod, double>> paymentMethods;
+    Money amount;
+    vector<pair<PaymentMethod, Money>> paymentMethods;
+    Money totalPaid;  // running sum of paymentMethods
     bool isCompleted;
-    mutex paymentMutex;
+    mutable mutex paymentMutex;
 
 public:
-    Payment(double amount) : amount(amount), isCompleted(false) {
-        static random_device rd;
-        static mt19937 gen(rd());
-        static uniform_int_distribution<> dis(1000, 9999);
-        id = "PAY" + to_string(dis(gen));
-    }
+    Payment(Money amount) : id(IdGenerator::next("PAY")), amount(amount), isCompleted(false) {}
     
-    void addPaymentMethod(PaymentMethod method, double amount) {
+    void addPaymentMethod(PaymentMethod method, Money amount) {
         lock_guard<mutex> lock(paymentMutex);
         if (paymentMethods.size() >= 4) {
             throw runtime_error("Maximum split payment ways exceeded");
         }
         paymentMethods.emplace_back(method, amount);
+        totalPaid += amount;
     }
     
     bool processPayment() {
         lock_guard<mutex> lock(paymentMutex);
-        double totalPaid = 0.0;
-        for (const auto& payment : paymentMethods) {
-            totalPaid += payment.second;
-        }
         isCompleted = totalPaid >= amount;
         return isCompleted;
     }
@@ -255,24 +978,99 @@ public:
         return paymentMethods.size() < 4;
     }
     
-    double getRemainingAmount() const {
+    Money getRemainingAmount() const {
         lock_guard<mutex> lock(paymentMutex);
-        double totalPaid = 0.0;
-        for (const auto& payment : paymentMethods) {
-            totalPaid += payment.second;
-        }
-        return max(0.0, amount - totalPaid);
+        return totalPaid >= amount ? Money() : amount - totalPaid;
     }
     
-    void generateReceipt() {
+    Money getAmount() const {
         lock_guard<mutex> lock(paymentMutex);
-        cout << "Receipt for Payment " << id << endl;
-        cout << "Total Amount: $" << amount << endl;
-        cout << "Payment Methods:" << endl;
-        for (const auto& payment : paymentMethods) {
-            cout << "- " << static_cast<int>(payment.first) << ": $" << payment.second << endl;
+        return amount;
+    }
+    
+    Receipt getReceipt(const string& orderId = "") const {
+        lock_guard<mutex> lock(paymentMutex);
+        return Receipt{id, orderId, amount, paymentMethods, isCompleted};
+    }
+    
+    // Renders and prints after the lock is released
+    void generateReceipt() {
+        cout << getReceipt().render();
+    }
+};
+
+// ReceiptPrinter class implementation
+// Renders receipts on its own thread so a payment returns as soon as it is
+// recorded. The worker starts with the first receipt.
+class ReceiptPrinter {
+private:
+    deque<Receipt> queue;
+    function<void(const string&)> sink;
+    size_t printedCount;
+    bool busy;
+    bool stopping;
+    mutex printerMutex;
+    condition_variable wakeWorker;
+    condition_variable idle;
+    thread worker;
+
+public:
+    ReceiptPrinter()
+        : sink([](const string& text) { cout << text; }), printedCount(0), busy(false), stopping(false) {}
+    
+    ~ReceiptPrinter() {
+        {
+            lock_guard<mutex> lock(printerMutex);
+            stopping = true;
+            wakeWorker.notify_one();
+        }
+        if (worker.joinable()) worker.join();
+    }
+    
+    ReceiptPrinter(const ReceiptPrinter&) = delete;
+    ReceiptPrinter& operator=(const ReceiptPrinter&) = delete;
+    
+    void setSink(function<void(const string&)> output) {
+        lock_guard<mutex> lock(printerMutex);
+        sink = move(output);
+    }
+    
+    void submit(Receipt receipt) {
+        lock_guard<mutex> lock(printerMutex);
+        queue.push_back(move(receipt));
+        if (!worker.joinable()) worker = thread([this]() { workerLoop(); });
+        wakeWorker.notify_one();
+    }
+    
+    // Waits until every submitted receipt has been printed
+    void flush() {
+        unique_lock<mutex> lock(printerMutex);
+        idle.wait(lock, [&]() { return queue.empty() && !busy; });
+    }
+    
+    size_t getPrintedCount() {
+        lock_guard<mutex> lock(printerMutex);
+        return printedCount;
+    }
+
+private:
+    void workerLoop() {
+        unique_lock<mutex> lock(printerMutex);
+        while (true) {
+            wakeWorker.wait(lock, [&]() { return !queue.empty() || stopping; });
+            if (queue.empty()) return;
+            
+            Receipt receipt = move(queue.front());
+            queue.pop_front();
+            busy = true;
+            function<void(const string&)> output = sink;
+            lock.unlock();
+            output(receipt.render());
+            lock.lock();
+            busy = false;
+            printedCount++;
+            if (queue.empty()) idle.notify_all();
         }
-        cout << "Status: " << (isCompleted ? "Completed" : "Pending") << endl;
     }
 };
 
@@ -283,7 +1081,7 @@ private:
     int capacity;
     bool isOccupied;
     chrono::system_clock::time_point reservationTime;
-    mutex tableMutex;
+    mutable mutex tableMutex;
 
 public:
     Table(int number, int capacity)
@@ -317,19 +1115,335 @@ public:
     int getCapacity() const { return capacity; }
 };
 
+// One order line on its way through a kitchen station
+struct KitchenTicket {
+    shared_ptr<Order> order;
+    uint32_t lineId = 0;
+    string menuItemId;
+    int quantity = 0;
+    system_clock::time_point orderTime;
+    uint64_t sequence = 0;  // ties on order time go first come, first served
+};
+
+// KitchenStation class implementation
+// Tickets arrive on a lock-free multi-producer, single-consumer queue, so
+// POS threads never wait on the kitchen. The station's own thread drains
+// it into a local heap ordered by order time and works from the top.
+// Ticks update only the ticket's order, under that order's lock.
+class KitchenStation {
+private:
+    struct Node {
+        KitchenTicket ticket;
+        atomic<Node*> next{nullptr};
+    };
+    
+    struct LaterOrder {
+        bool operator()(const KitchenTicket& a, const KitchenTicket& b) const {
+            return a.orderTime != b.orderTime ? a.orderTime > b.orderTime : a.sequence > b.sequence;
+        }
+    };
+    
+    string name;
+    atomic<Node*> head;  // producers push here
+    Node* tail;          // consumer pops here
+    Node stub;
+    atomic<size_t> waiting;
+    priority_queue<KitchenTicket, vector<KitchenTicket>, LaterOrder> queue;  // consumer only
+
+public:
+    explicit KitchenStation(const string& name) : name(name), head(&stub), tail(&stub), waiting(0) {}
+    
+    ~KitchenStation() {
+        while (Node* node = pop()) {
+            delete node;
+        }
+    }
+    
+    KitchenStation(const KitchenStation&) = delete;
+    KitchenStation& operator=(const KitchenStation&) = delete;
+    
+    // Any thread
+    void submit(KitchenTicket ticket) {
+        Node* node = new Node;
+        node->ticket = move(ticket);
+        waiting++;
+        push(node);
+    }
+    
+    // Station thread only: starts the earliest-ordered live ticket. Tickets
+    // for removed lines or orders that left the kitchen are dropped.
+    bool startNext(KitchenTicket& ticket) {
+        while (Node* node = pop()) {
+            queue.push(move(node->ticket));
+            delete node;
+        }
+        while (!queue.empty()) {
+            ticket = queue.top();
+            queue.pop();
+            waiting--;
+            if (ticket.order->updateItemStatus(ticket.lineId, ItemStatus::PREPARING)) return true;
+        }
+        return false;
+    }
+    
+    // Any thread
+    bool markReady(const KitchenTicket& ticket) {
+        return ticket.order->updateItemStatus(ticket.lineId, ItemStatus::READY);
+    }
+    
+    const string& getName() const { return name; }
+    size_t getWaitingCount() const { return waiting.load(); }
+
+private:
+    // Vyukov's intrusive MPSC queue: one exchange per push, no CAS loop
+    void push(Node* node) {
+        node->next.store(nullptr, memory_order_relaxed);
+        Node* previous = head.exchange(node, memory_order_acq_rel);
+        previous->next.store(node, memory_order_release);
+    }
+    
+    // Null when empty or when a producer is between its two steps
+    Node* pop() {
+        Node* first = tail;
+        Node* next = first->next.load(memory_order_acquire);
+        if (first == &stub) {
+            if (!next) return nullptr;
+            tail = next;
+            first = next;
+            next = next->next.load(memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            return first;
+        }
+        if (first != head.load(memory_order_acquire)) return nullptr;
+        push(&stub);
+        next = first->next.load(memory_order_acquire);
+        if (next) {
+            tail = next;
+            return first;
+        }
+        return nullptr;
+    }
+};
+
+// KitchenPipeline class implementation
+// Routes each confirmed order line to the station for its menu category.
+// Stations are created on first use and never removed, so the lock only
+// guards the lookup.
+class KitchenPipeline {
+private:
+    unordered_map<string, unique_ptr<KitchenStation>> stations;
+    atomic<uint64_t> nextSequence;
+    mutable shared_mutex pipelineMutex;
+
+public:
+    KitchenPipeline() : nextSequence(0) {}
+    
+    void dispatch(const shared_ptr<Order>& order, const vector<OrderItem>& lines) {
+        for (const OrderItem& line : lines) {
+            KitchenTicket ticket;
+            ticket.order = order;
+            ticket.lineId = line.getLineId();
+            ticket.menuItemId = line.getMenuItemId();
+            ticket.quantity = line.getQuantity();
+            ticket.orderTime = order->getOrderTime();
+            ticket.sequence = nextSequence++;
+            getStation(line.getStation()).submit(move(ticket));
+        }
+    }
+    
+    KitchenStation& getStation(const string& name) {
+        {
+            shared_lock<shared_mutex> lock(pipelineMutex);
+            auto it = stations.find(name);
+            if (it != stations.end()) return *it->second;
+        }
+        unique_lock<shared_mutex> lock(pipelineMutex);
+        auto& station = stations[name];
+        if (!station) station = make_unique<KitchenStation>(name);
+        return *station;
+    }
+};
+
+// A booked time slot at one table
+struct Reservation {
+    int tableNumber = 0;
+    int partySize = 0;
+    system_clock::time_point start;
+    system_clock::time_point end;
+};
+
+// ReservationEngine class implementation
+// Each table keeps its bookings as non-overlapping half-open intervals
+// keyed by start, so checking a slot is one ordered lookup plus a look at
+// the booking before it. Tables are bucketed by capacity in an ordered
+// map; a party starts at the smallest bucket that seats it and only moves
+// up to larger tables when the snug ones are taken.
+class ReservationEngine {
+public:
+    static constexpr minutes DEFAULT_DURATION{90};
+
+private:
+    struct TableSchedule {
+        int number;
+        int capacity;
+        map<system_clock::time_point, system_clock::time_point> bookings;  // start -> end
+        mutable mutex scheduleMutex;
+        
+        TableSchedule(int number, int capacity) : number(number), capacity(capacity) {}
+        
+        // Earliest start at or after from with room for duration, or some
+        // time past latest if there is none by then; the caller holds
+        // scheduleMutex. Walks only the bookings that start before latest.
+        system_clock::time_point nextFree(system_clock::time_point from, system_clock::time_point latest,
+                                          minutes duration) const {
+            auto it = bookings.upper_bound(from);
+            system_clock::time_point candidate = from;
+            if (it != bookings.begin() && prev(it)->second > candidate) {
+                candidate = prev(it)->second;
+            }
+            while (candidate <= latest && it != bookings.end() && it->first < candidate + duration) {
+                candidate = max(candidate, it->second);
+                ++it;
+            }
+            return candidate;
+        }
+    };
+    
+    unordered_map<int, unique_ptr<TableSchedule>> tables;
+    map<int, vector<TableSchedule*>> byCapacity;
+    mutable shared_mutex engineMutex;  // guards the indexes; bookings lock per table
+
+public:
+    void addTable(int number, int capacity) {
+        unique_lock<shared_mutex> lock(engineMutex);
+        if (tables.count(number)) return;
+        auto schedule = make_unique<TableSchedule>(number, capacity);
+        byCapacity[capacity].push_back(schedule.get());
+        tables.emplace(number, move(schedule));
+    }
+    
+    // The best-fitting table free for the whole slot starting at start
+    optional<Reservation> book(int partySize, system_clock::time_point start,
+                               minutes duration = DEFAULT_DURATION) {
+        return bookEarliest(partySize, start, start, duration);
+    }
+    
+    // The earliest start in [from, latest] at which some table seats the
+    // party, preferring the smallest such table. The first table free at
+    // from ends the search, since nothing can start earlier or fit tighter.
+    // Another booking can take the chosen slot between the search and the
+    // insert; then it searches again.
+    optional<Reservation> bookEarliest(int partySize, system_clock::time_point from,
+                                       system_clock::time_point latest,
+                                       minutes duration = DEFAULT_DURATION) {
+        shared_lock<shared_mutex> lock(engineMutex);
+        while (true) {
+            TableSchedule* best = nullptr;
+            system_clock::time_point bestStart = latest;
+            for (auto bucket = byCapacity.lower_bound(partySize); bucket != byCapacity.end(); ++bucket) {
+                for (TableSchedule* table : bucket->second) {
+                    lock_guard<mutex> tableLock(table->scheduleMutex);
+                    system_clock::time_point start = table->nextFree(from, bestStart, duration);
+                    if (start < bestStart || (!best && start == bestStart)) {
+                        best = table;
+                        bestStart = start;
+                        if (start == from) break;
+                    }
+                }
+                if (best && bestStart == from) break;
+            }
+            if (!best) return nullopt;
+            
+            lock_guard<mutex> tableLock(best->scheduleMutex);
+            if (best->nextFree(bestStart, bestStart, duration) == bestStart) {
+                best->bookings.emplace(bestStart, bestStart + duration);
+                return Reservation{best->number, partySize, bestStart, bestStart + duration};
+            }
+        }
+    }
+    
+    bool cancel(const Reservation& reservation) {
+        TableSchedule* table = findTable(reservation.tableNumber);
+        if (!table) return false;
+        lock_guard<mutex> lock(table->scheduleMutex);
+        auto it = table->bookings.find(reservation.start);
+        if (it == table->bookings.end() || it->second != reservation.end) return false;
+        table->bookings.erase(it);
+        return true;
+    }
+    
+    bool isFree(int tableNumber, system_clock::time_point start, minutes duration = DEFAULT_DURATION) const {
+        TableSchedule* table = findTable(tableNumber);
+        if (!table) return false;
+        lock_guard<mutex> lock(table->scheduleMutex);
+        return table->nextFree(start, start, duration) == start;
+    }
+    
+    size_t getBookingCount(int tableNumber) const {
+        TableSchedule* table = findTable(tableNumber);
+        if (!table) return 0;
+        lock_guard<mutex> lock(table->scheduleMutex);
+        return table->bookings.size();
+    }
+
+private:
+    TableSchedule* findTable(int tableNumber) const {
+        shared_lock<shared_mutex> lock(engineMutex);
+        auto it = tables.find(tableNumber);
+        return it != tables.end() ? it->second.get() : nullptr;
+    }
+};
+
+// End-of-day totals over every order that was not cancelled
+struct Settlement {
+    size_t orderCount = 0;
+    Money subtotal;
+    Money tax;
+    Money total;
+};
+
 // RestaurantSystem class implementation (Singleton)
 class RestaurantSystem {
 private:
     static RestaurantSystem* instance;
     static mutex instanceMutex;
     
+    // Orders are sharded by id and tables by number, so handhelds working
+    // on different orders or tables never share a lock
+    static const size_t ORDER_SHARDS = 64;
+    static const size_t TABLE_SHARDS = 16;
+    
+    struct alignas(64) OrderShard {
+        unordered_map<string, shared_ptr<Order>> orders;
+        InstrumentedMutex shardMutex{"restaurant.order_shard_lock"};
+    };
+    
+    struct alignas(64) TableShard {
+        unordered_map<int, Table> tables;
+        InstrumentedMutex shardMutex{"restaurant.table_shard_lock"};
+    };
+    
     Menu menu;
-    unordered_map<string, Order> orders;
-    unordered_map<int, Table> tables;
-    mutex systemMutex;
+    array<OrderShard, ORDER_SHARDS> orderShards;
+    array<TableShard, TABLE_SHARDS> tableShards;
+    ReservationEngine reservations;
+    KitchenPipeline kitchen;
+    ReceiptPrinter receipts;
+    unique_ptr<OrderEventLog> eventLog;
+    atomic<OrderEventLog*> journal{nullptr};
+    mutex persistenceMutex;
     
-    RestaurantSystem() = default;
+    static const int DEFAULT_TABLES = 20;
+    static const int DEFAULT_TABLE_CAPACITY = 4;
     
+    RestaurantSystem() {
+        for (int number = 1; number <= DEFAULT_TABLES; number++) {
+            addTable(number, DEFAULT_TABLE_CAPACITY);
+        }
+    }
+
 public:
     static RestaurantSystem* getInstance() {
         lock_guard<mutex> lock(instanceMutex);
@@ -339,64 +1453,287 @@ public:
         return instance;
     }
     
-    string addMenuItem(const string& name, double price, const string& category) {
+    string addMenuItem(const string& name, Money price, const string& category) {
         MenuItem item(name, price, category);
         menu.addItem(item);
         return item.getId();
     }
     
+    void addTable(int number, int capacity) {
+        TableShard& shard = tableShard(number);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        shard.tables.emplace(piecewise_construct, forward_as_tuple(number), forward_as_tuple(number, capacity));
+        reservations.addTable(number, capacity);
+    }
+    
+    // Replays the event log at path into the live order and table stores,
+    // resends orders that were in the kitchen, then logs every later change
+    // to it. Meant for startup, before traffic.
+    size_t enablePersistence(const string& path, bool syncOnCommit = true) {
+        lock_guard<mutex> persistenceLock(persistenceMutex);
+        if (eventLog) throw runtime_error("Persistence is already enabled");
+        
+        OrderHistory history;
+        auto log = make_unique<OrderEventLog>(syncOnCommit);
+        log->open(path, [&](const OrderEvent& event) { history.apply(event); });
+        
+        for (const auto& entry : history.getOrders()) {
+            entry.second->setJournal(log.get());
+            OrderShard& shard = orderShard(entry.first);
+            lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+            shard.orders[entry.first] = entry.second;
+        }
+        for (const auto& entry : history.getOrders()) {
+            kitchen.dispatch(entry.second, entry.second->getUnfinishedLines());
+        }
+        for (const auto& entry : history.getSeatedTables()) {
+            TableShard& shard = tableShard(entry.first);
+            lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+            auto it = shard.tables.find(entry.first);
+            if (it == shard.tables.end()) continue;
+            it->second.release();
+            if (entry.second) it->second.reserve(system_clock::now());
+        }
+        
+        journal = log.get();
+        eventLog = move(log);
+        return history.getAppliedCount();
+    }
+    
+    // Waits until every change so far is on disk
+    void flushEventLog() {
+        if (OrderEventLog* log = journal.load()) log->flush();
+    }
+    
+    void setReceiptSink(function<void(const string&)> sink) {
+        receipts.setSink(move(sink));
+    }
+    
+    void flushReceipts() {
+        receipts.flush();
+    }
+    
     string createOrder(int tableNumber) {
-        lock_guard<mutex> lock(systemMutex);
-        Order order(tableNumber);
-        string id = order.getId();
-        orders[id] = order;
+        static const int createTime = Metrics::histogram("restaurant.create_order_ns");
+        ScopedTimer timer(createTime);
+        shared_ptr<Order> order = make_shared<Order>(tableNumber, journal.load());
+        string id = order->getId();
+        OrderShard& shard = orderShard(id);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        shard.orders.emplace(id, move(order));
         return id;
     }
     
+    // Only the lookup holds the shard lock; the order and the menu are
+    // locked on their own
     void addItemToOrder(const string& orderId, const string& menuItemId, int quantity) {
-        lock_guard<mutex> lock(systemMutex);
-        auto orderIt = orders.find(orderId);
-        if (orderIt == orders.end()) {
+        static const int addTime = Metrics::histogram("restaurant.add_item_ns");
+        ScopedTimer timer(addTime);
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) {
             throw runtime_error("Order not found");
         }
         
-        MenuItem* item = menu.getItem(menuItemId);
+        shared_ptr<const MenuItem> item = menu.getItem(menuItemId);
         if (!item) {
             throw runtime_error("Menu item not found");
         }
+        if (!item->isAvailable()) {
+            throw runtime_error("Menu item not available");
+        }
         
-        orderIt->second.addItem(*item, quantity);
+        bool sendToKitchen = false;
+        OrderItem line = order->addItem(*item, quantity, &sendToKitchen);
+        if (sendToKitchen) kitchen.dispatch(order, {line});
     }
     
+    // Confirming an order sends its lines to the kitchen stations
     void updateOrderStatus(const string& orderId, OrderStatus status) {
-        lock_guard<mutex> lock(systemMutex);
-        auto it = orders.find(orderId);
-        if (it != orders.end()) {
-            it->second.updateStatus(status);
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) return;
+        if (status == OrderStatus::CONFIRMED) {
+            kitchen.dispatch(order, order->confirm());
+        } else {
+            order->updateStatus(status);
         }
     }
     
+    OrderStatus getOrderStatus(const string& orderId) {
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) {
+            throw runtime_error("Order not found");
+        }
+        return order->getStatus();
+    }
+    
+    KitchenStation& getKitchenStation(const string& category) {
+        return kitchen.getStation(category);
+    }
+    
     bool reserveTable(int tableNumber, const chrono::system_clock::time_point& time) {
-        lock_guard<mutex> lock(systemMutex);
-        auto it = tables.find(tableNumber);
-        if (it != tables.end() && it->second.isAvailable()) {
+        TableShard& shard = tableShard(tableNumber);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        auto it = shard.tables.find(tableNumber);
+        if (it != shard.tables.end() && it->second.isAvailable()) {
             it->second.reserve(time);
+            if (OrderEventLog* log = journal.load()) log->append(OrderEvent(OrderEventType::TABLE_SEATED, "", tableNumber));
             return true;
         }
         return false;
     }
     
+    // Books the best-fitting table that is free for the whole slot
+    optional<Reservation> bookReservation(int partySize, const system_clock::time_point& time,
+                                          minutes duration = ReservationEngine::DEFAULT_DURATION) {
+        return reservations.book(partySize, time, duration);
+    }
+    
+    // Books the first time in [from, latest] that any suitable table is free
+    optional<Reservation> bookEarliestReservation(int partySize, const system_clock::time_point& from,
+                                                  const system_clock::time_point& latest,
+                                                  minutes duration = ReservationEngine::DEFAULT_DURATION) {
+        return reservations.bookEarliest(partySize, from, latest, duration);
+    }
+    
+    bool cancelReservation(const Reservation& reservation) {
+        return reservations.cancel(reservation);
+    }
+    
     void releaseTable(int tableNumber) {
-        lock_guard<mutex> lock(systemMutex);
-        auto it = tables.find(tableNumber);
-        if (it != tables.end()) {
+        TableShard& shard = tableShard(tableNumber);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        auto it = shard.tables.find(tableNumber);
+        if (it != shard.tables.end()) {
             it->second.release();
+            if (OrderEventLog* log = journal.load()) log->append(OrderEvent(OrderEventType::TABLE_RELEASED, "", tableNumber));
+        }
+    }
+    
+    void updateMenuItemPrice(const string& menuItemId, Money newPrice) {
+        menu.updateItemPrice(menuItemId, newPrice);
+    }
+    
+    void setMenuItemAvailability(const string& menuItemId, bool available) {
+        menu.setAvailability(menuItemId, available);
+    }
+    
+    // Tax is rounded per order, as on each receipt. Totals are gathered one
+    // shard at a time into a flat array, then summed and taxed in
+    // branch-free passes; see Money::sumPercentOf for the targets where the
+    // tax pass vectorizes.
+    Settlement settleDay(int64_t taxBasisPoints) {
+        vector<int64_t> cents;
+        for (OrderShard& shard : orderShards) {
+            lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+            for (const auto& entry : shard.orders) {
+                auto statusAndTotal = entry.second->getStatusAndTotal();
+                if (statusAndTotal.first != OrderStatus::CANCELLED) {
+                    cents.push_back(statusAndTotal.second.getCents());
+                }
+            }
+        }
+        
+        const int64_t* totals = cents.data();
+        const size_t count = cents.size();
+        int64_t subtotal = 0;
+        for (size_t i = 0; i < count; i++) {
+            subtotal += totals[i];
+        }
+        int64_t tax = Money::sumPercentOf(totals, count, taxBasisPoints);
+        
+        Settlement settlement;
+        settlement.orderCount = count;
+        settlement.subtotal = Money::fromCents(subtotal);
+        settlement.tax = Money::fromCents(tax);
+        settlement.total = Money::fromCents(subtotal + tax);
+        return settlement;
+    }
+    
+    // Charges what the order still owes across the given methods; false if
+    // they fall short, nothing is owed or the order was cancelled. The
+    // payment is durable when this returns; the receipt prints in the
+    // background.
+    bool payOrder(const string& orderId, const vector<pair<PaymentMethod, Money>>& methods) {
+        static const int payTime = Metrics::histogram("restaurant.pay_order_ns");
+        ScopedTimer timer(payTime);
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) {
+            throw runtime_error("Order not found");
+        }
+        
+        optional<Payment> payment;
+        uint64_t sequence = 0;
+        bool charged = order->payBalance([&](Money owed) {
+            payment.emplace(owed);
+            for (const auto& method : methods) {
+                payment->addPaymentMethod(method.first, method.second);
+            }
+            return payment->processPayment();
+        }, static_cast<int>(methods.size()), sequence);
+        if (!charged) return false;
+        
+        if (sequence) journal.load()->waitDurable(sequence);
+        receipts.submit(payment->getReceipt(orderId));
+        return true;
+    }
+    
+    Money getAmountPaid(const string& orderId) {
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) {
+            throw runtime_error("Order not found");
+        }
+        return order->getAmountPaid();
+    }
+    
+    Money getOrderTotal(const string& orderId) {
+        shared_ptr<Order> order = findOrder(orderId);
+        if (!order) {
+            throw runtime_error("Order not found");
         }
+        return order->getTotal();
     }
     
-    vector<MenuItem> searchMenuItems(const string& query) {
+    // Summed over the shards, for comparing runs against a single lock.
+    // Read from the shared metrics, so all zero without instrumentation.
+    struct ContentionReport {
+        LockStats orderShards;
+        LockStats tableShards;
+        LockStats menu;
+    };
+    
+    ContentionReport getContentionReport() const {
+        MetricsSnapshot metrics = Metrics::snapshot();
+        ContentionReport report;
+        report.orderShards = LockStats::fromMetrics(metrics, "restaurant.order_shard_lock");
+        report.tableShards = LockStats::fromMetrics(metrics, "restaurant.table_shard_lock");
+        report.menu = LockStats::fromMetrics(metrics, "restaurant.menu_lock");
+        return report;
+    }
+    
+    // Shared with the published menu; no lock and no copy
+    shared_ptr<const MenuItemList> searchMenuItems(const string& query) const {
         return menu.getItemsByCategory(query);
     }
+    
+    shared_ptr<const MenuSnapshot> getMenuSnapshot() const {
+        return menu.getSnapshot();
+    }
+
+private:
+    OrderShard& orderShard(const string& orderId) {
+        return orderShards[hash<string>()(orderId) % ORDER_SHARDS];
+    }
+    
+    TableShard& tableShard(int tableNumber) {
+        return tableShards[static_cast<unsigned>(tableNumber) % TABLE_SHARDS];
+    }
+    
+    shared_ptr<Order> findOrder(const string& orderId) {
+        OrderShard& shard = orderShard(orderId);
+        lock_guard<InstrumentedMutex> lock(shard.shardMutex);
+        auto it = shard.orders.find(orderId);
+        return it != shard.orders.end() ? it->second : nullptr;
+    }
 };
 
 // Initialize static members
@@ -408,8 +1745,8 @@ int main() {
     RestaurantSystem* restaurant = RestaurantSystem::getInstance();
     
     // Add menu items
-    string pizzaId = restaurant->addMenuItem("Margherita Pizza", 12.99, "Pizza");
-    string pastaId = restaurant->addMenuItem("Spaghetti Carbonara", 14.99, "Pasta");
+    string pizzaId = restaurant->addMenuItem("Margherita Pizza", Money(12.99), "Pizza");
+    string pastaId = restaurant->addMenuItem("Spaghetti Carbonara", Money(14.99), "Pasta");
     
     // Create an order
     string orderId = restaurant->createOrder(1);
@@ -424,8 +1761,8 @@ int main() {
     restaurant->reserveTable(1, now + hours(2));
     
     // Search menu items
-    vector<MenuItem> pizzaItems = restaurant->searchMenuItems("Pizza");
-    cout << "Found " << pizzaItems.size() << " pizza items" << endl;
+    auto pizzaItems = restaurant->searchMenuItems("Pizza");
+    cout << "Found " << pizzaItems->size() << " pizza items" << endl;
     
     return 0;
 } 
\ No newline at end of file
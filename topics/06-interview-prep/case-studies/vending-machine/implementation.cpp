@@ -8,7 +8,20 @@
 #include <chrono>
 #include <stdexcept>
 #include <algorithm>
-#include <random>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include <optional>
+#include <map>
+#include <set>
+#include <functional>
+#include <cstring>
+#include <atomic>
+#include <shared_mutex>
+
+#include "../common/instrumentation.h"
 
 using namespace std;
 using namespace chrono;
@@ -17,6 +30,7 @@ using namespace chrono;
 enum class Coin { PENNY, NICKEL, DIME, QUARTER };
 enum class Bill { ONE, FIVE, TEN, TWENTY };
 enum class MachineState { IDLE, SELECTING, PAYING, DISPENSING, MAINTENANCE };
+enum class StockDeltaType { SKU_NAMED, STOCKED, SOLD, THRESHOLD_SET };
 
 // Forward declarations
 class Product;
@@ -24,34 +38,130 @@ class Payment;
 class Inventory;
 class Display;
 
+// Money class implementation
+// Whole cents in a signed 64-bit integer. Dollar amounts are rounded to
+// the cent once, where they enter; all arithmetic after that is exact.
+class Money {
+private:
+    int64_t cents;
+    
+    explicit constexpr Money(int64_t cents, bool) : cents(cents) {}
+
+public:
+    constexpr Money() : cents(0) {}
+    
+    // Explicit, so a stray double never turns into money unnoticed
+    explicit Money(double dollars) : cents(llround(dollars * 100.0)) {}
+    
+    static constexpr Money fromCents(int64_t cents) { return Money(cents, true); }
+    
+    constexpr int64_t getCents() const { return cents; }
+    constexpr double toDollars() const { return cents / 100.0; }
+    
+    Money& operator+=(Money other) { cents += other.cents; return *this; }
+    Money& operator-=(Money other) { cents -= other.cents; return *this; }
+    
+    friend Money operator+(Money a, Money b) { return fromCents(a.cents + b.cents); }
+    friend Money operator-(Money a, Money b) { return fromCents(a.cents - b.cents); }
+    friend Money operator*(Money a, int64_t count) { return fromCents(a.cents * count); }
+    friend bool operator==(Money a, Money b) { return a.cents == b.cents; }
+    friend bool operator!=(Money a, Money b) { return a.cents != b.cents; }
+    friend bool operator<(Money a, Money b) { return a.cents < b.cents; }
+    friend bool operator<=(Money a, Money b) { return a.cents <= b.cents; }
+    friend bool operator>(Money a, Money b) { return a.cents > b.cents; }
+    friend bool operator>=(Money a, Money b) { return a.cents >= b.cents; }
+    
+    string toString() const {
+        ostringstream out;
+        int64_t magnitude = cents < 0 ? -cents : cents;
+        out << (cents < 0 ? "-$" : "$") << magnitude / 100 << '.' << setw(2) << setfill('0') << magnitude % 100;
+        return out.str();
+    }
+    
+    friend ostream& operator<<(ostream& out, Money money) { return out << money.toString(); }
+};
+
+// Scaling money by a fraction would truncate the fraction to a whole
+// count, so money * 1.5 does not compile
+template <typename Scale, typename = enable_if_t<is_floating_point<Scale>::value>>
+Money operator*(Money money, Scale scale) = delete;
+
+// Face values in cents, indexed by the enum
+constexpr int64_t COIN_CENTS[] = {1, 5, 10, 25};
+constexpr int64_t BILL_CENTS[] = {100, 500, 1000, 2000};
+
+inline Money valueOf(Coin coin) { return Money::fromCents(COIN_CENTS[static_cast<int>(coin)]); }
+inline Money valueOf(Bill bill) { return Money::fromCents(BILL_CENTS[static_cast<int>(bill)]); }
+
+// Sequential ids, unique for the life of the process
+inline string nextId(const char* prefix) {
+    static atomic<uint64_t> sequence{0};
+    return prefix + to_string(++sequence);
+}
+
 // Product class implementation
+// The id is the SKU the fleet joins on, so the same product stocked in
+// different machines should be built with the same caller-supplied SKU.
 class Product {
 private:
     string id;
     string name;
-    double price;
+    Money price;
     string category;
     int quantity;
     chrono::system_clock::time_point expirationDate;
-    mutex productMutex;
+    mutable mutex productMutex;
 
 public:
-    Product(const string& name, double price, const string& category)
-        : name(name), price(price), category(category), quantity(0) {
-        static random_device rd;
-        static mt19937 gen(rd());
-        static uniform_int_distribution<> dis(1000, 9999);
-        id = "PROD" + to_string(dis(gen));
-        expirationDate = system_clock::now() + days(30);
+    Product(const string& sku, const string& name, Money price, const string& category)
+        : id(sku), name(name), price(price), category(category), quantity(0),
+          expirationDate(system_clock::now() + hours(24 * 30)) {}
+    
+    // A one-off product with a generated id that no other product shares
+    Product(const string& name, Money price, const string& category)
+        : Product(nextId("PROD"), name, price, category) {}
+    
+    // Copies the data, not the lock
+    Product(const Product& other) {
+        lock_guard<mutex> lock(other.productMutex);
+        id = other.id;
+        name = other.name;
+        price = other.price;
+        category = other.category;
+        quantity = other.quantity;
+        expirationDate = other.expirationDate;
+    }
+    
+    Product& operator=(const Product& other) {
+        if (this != &other) {
+            lock(productMutex, other.productMutex);
+            lock_guard<mutex> ownLock(productMutex, adopt_lock);
+            lock_guard<mutex> otherLock(other.productMutex, adopt_lock);
+            id = other.id;
+            name = other.name;
+            price = other.price;
+            category = other.category;
+            quantity = other.quantity;
+            expirationDate = other.expirationDate;
+        }
+        return *this;
     }
     
     string getId() const { return id; }
     string getName() const { return name; }
-    double getPrice() const { return price; }
     string getCategory() const { return category; }
-    int getQuantity() const { return quantity; }
     
-    void setPrice(double newPrice) {
+    Money getPrice() const {
+        lock_guard<mutex> lock(productMutex);
+        return price;
+    }
+    
+    int getQuantity() const {
+        lock_guard<mutex> lock(productMutex);
+        return quantity;
+    }
+    
+    void setPrice(Money newPrice) {
         lock_guard<mutex> lock(productMutex);
         price = newPrice;
     }
@@ -61,6 +171,16 @@ public:
         quantity += delta;
     }
     
+    system_clock::time_point getExpirationDate() const {
+        lock_guard<mutex> lock(productMutex);
+        return expirationDate;
+    }
+    
+    void setExpirationDate(system_clock::time_point date) {
+        lock_guard<mutex> lock(productMutex);
+        expirationDate = date;
+    }
+    
     bool isExpired() const {
         lock_guard<mutex> lock(productMutex);
         return system_clock::now() > expirationDate;
@@ -75,9 +195,20 @@ private:
     mutex catalogMutex;
 
 public:
+    // Adding a product again under its id restocks it: the entry keeps
+    // its price and category and gains the new units. An id already held
+    // by a differently named product is refused rather than overwritten.
     void addProduct(const Product& product) {
         lock_guard<mutex> lock(catalogMutex);
-        products[product.getId()] = product;
+        auto it = products.find(product.getId());
+        if (it != products.end()) {
+            if (it->second.getName() != product.getName()) {
+                throw invalid_argument("SKU " + product.getId() + " already belongs to " + it->second.getName());
+            }
+            it->second.updateQuantity(product.getQuantity());
+            return;
+        }
+        products.emplace(product.getId(), product);
         productsByCategory.insert({product.getCategory(), product.getId()});
     }
     
@@ -85,7 +216,7 @@ public:
         lock_guard<mutex> lock(catalogMutex);
         auto it = products.find(id);
         if (it != products.end()) {
-            productsByCategory.erase(it->second.getCategory());
+            removeFromCategory(it->second);
             products.erase(it);
         }
     }
@@ -101,119 +232,266 @@ public:
         vector<Product> result;
         auto range = productsByCategory.equal_range(category);
         for (auto it = range.first; it != range.second; ++it) {
-            result.push_back(products[it->second]);
+            result.push_back(products.at(it->second));
         }
         return result;
     }
     
-    void updateProductPrice(const string& id, double newPrice) {
+    void updateProductPrice(const string& id, Money newPrice) {
         lock_guard<mutex> lock(catalogMutex);
         auto it = products.find(id);
         if (it != products.end()) {
             it->second.setPrice(newPrice);
         }
     }
+
+private:
+    // Drops only this product's entry from its category
+    void removeFromCategory(const Product& product) {
+        auto range = productsByCategory.equal_range(product.getCategory());
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == product.getId()) {
+                productsByCategory.erase(it);
+                return;
+            }
+        }
+    }
 };
 
 // Payment class implementation
+// Keeps a running total of what was inserted, so reading it is O(1) and
+// never has to take the lock a second time.
 class Payment {
 private:
     string id;
-    double amount;
+    Money amount;
     unordered_map<Coin, int> coins;
     unordered_map<Bill, int> bills;
+    Money inserted;
     bool isCompleted;
-    mutex paymentMutex;
+    mutable mutex paymentMutex;
 
 public:
-    Payment(double amount) : amount(amount), isCompleted(false) {
-        static random_device rd;
-        static mt19937 gen(rd());
-        static uniform_int_distribution<> dis(1000, 9999);
-        id = "PAY" + to_string(dis(gen));
+    Payment(Money amount) : id(nextId("PAY")), amount(amount), isCompleted(false) {}
+    
+    // Copies the data, not the lock
+    Payment(const Payment& other) {
+        lock_guard<mutex> lock(other.paymentMutex);
+        id = other.id;
+        amount = other.amount;
+        coins = other.coins;
+        bills = other.bills;
+        inserted = other.inserted;
+        isCompleted = other.isCompleted;
     }
     
     void addCoin(Coin coin, int count) {
         lock_guard<mutex> lock(paymentMutex);
         coins[coin] += count;
+        inserted += valueOf(coin) * count;
     }
     
     void addBill(Bill bill, int count) {
         lock_guard<mutex> lock(paymentMutex);
         bills[bill] += count;
+        inserted += valueOf(bill) * count;
     }
     
-    double getTotalAmount() const {
+    Money getTotalAmount() const {
         lock_guard<mutex> lock(paymentMutex);
-        double total = 0.0;
-        
-        // Calculate coin values
-        for (const auto& coin : coins) {
-            switch (coin.first) {
-                case Coin::PENNY: total += 0.01 * coin.second; break;
-                case Coin::NICKEL: total += 0.05 * coin.second; break;
-                case Coin::DIME: total += 0.10 * coin.second; break;
-                case Coin::QUARTER: total += 0.25 * coin.second; break;
-            }
-        }
-        
-        // Calculate bill values
-        for (const auto& bill : bills) {
-            switch (bill.first) {
-                case Bill::ONE: total += 1.00 * bill.second; break;
-                case Bill::FIVE: total += 5.00 * bill.second; break;
-                case Bill::TEN: total += 10.00 * bill.second; break;
-                case Bill::TWENTY: total += 20.00 * bill.second; break;
-            }
-        }
-        
-        return total;
+        return inserted;
     }
     
     bool processPayment() {
         lock_guard<mutex> lock(paymentMutex);
-        isCompleted = getTotalAmount() >= amount;
+        isCompleted = inserted >= amount;
         return isCompleted;
     }
     
-    unordered_map<Coin, int> calculateChange(double amount) {
+    unordered_map<Coin, int> getCoins() const {
+        lock_guard<mutex> lock(paymentMutex);
+        return coins;
+    }
+    
+    // Change from an unlimited supply: largest coins first, one division
+    // per denomination. The machine pays out through its ChangeMaker, which
+    // knows how many coins it actually holds.
+    unordered_map<Coin, int> calculateChange(Money price) {
         lock_guard<mutex> lock(paymentMutex);
         unordered_map<Coin, int> change;
-        double remaining = getTotalAmount() - amount;
-        
-        // Calculate change in coins
-        while (remaining >= 0.25) {
-            change[Coin::QUARTER]++;
-            remaining -= 0.25;
+        int64_t remaining = (inserted - price).getCents();
+        for (Coin coin : {Coin::QUARTER, Coin::DIME, Coin::NICKEL, Coin::PENNY}) {
+            int64_t value = COIN_CENTS[static_cast<int>(coin)];
+            if (remaining >= value) {
+                change[coin] = static_cast<int>(remaining / value);
+                remaining %= value;
+            }
         }
-        while (remaining >= 0.10) {
-            change[Coin::DIME]++;
-            remaining -= 0.10;
+        return change;
+    }
+};
+
+// ChangeMaker class implementation
+// The machine's coin float plus a bounded-knapsack table over it: for
+// every amount up to MAX_CHANGE, the fewest coins that pay it out without
+// using more of a coin than the machine holds. The table is rebuilt
+// whenever the float changes, so deciding whether change can be given is a
+// single lookup. Each denomination is folded in with a sliding-window
+// minimum per residue class, O(COIN_TYPES * MAX_CHANGE) per rebuild.
+class ChangeMaker {
+public:
+    static constexpr int MAX_CHANGE = 2000;  // cents; a $20 bill is the largest note
+    static constexpr int COIN_TYPES = 4;
+
+private:
+    static constexpr uint16_t UNREACHABLE = UINT16_MAX;
+    
+    array<int, COIN_TYPES> coinCounts{};
+    vector<uint16_t> fewestCoins;                        // by amount
+    array<vector<uint16_t>, COIN_TYPES> taken;           // coins of each type used, by amount
+    int contiguousLimit;                                 // every amount below it can be paid
+
+public:
+    ChangeMaker() {
+        rebuild();
+    }
+    
+    void addCoins(Coin coin, int count) {
+        coinCounts[static_cast<int>(coin)] += count;
+        rebuild();
+    }
+    
+    void addCoins(const unordered_map<Coin, int>& coins) {
+        for (const auto& entry : coins) {
+            coinCounts[static_cast<int>(entry.first)] += entry.second;
         }
-        while (remaining >= 0.05) {
-            change[Coin::NICKEL]++;
-            remaining -= 0.05;
+        rebuild();
+    }
+    
+    // False, and no change, if the float does not hold them
+    bool removeCoins(const unordered_map<Coin, int>& coins) {
+        for (const auto& entry : coins) {
+            if (coinCounts[static_cast<int>(entry.first)] < entry.second) return false;
         }
-        while (remaining >= 0.01) {
-            change[Coin::PENNY]++;
-            remaining -= 0.01;
+        for (const auto& entry : coins) {
+            coinCounts[static_cast<int>(entry.first)] -= entry.second;
+        }
+        rebuild();
+        return true;
+    }
+    
+    bool canMakeChange(Money amount) const {
+        int64_t cents = amount.getCents();
+        return cents >= 0 && cents <= MAX_CHANGE && fewestCoins[cents] != UNREACHABLE;
+    }
+    
+    // The fewest coins the float can pay the amount with
+    optional<unordered_map<Coin, int>> makeChange(Money amount) const {
+        if (!canMakeChange(amount)) return nullopt;
+        unordered_map<Coin, int> change;
+        int64_t remaining = amount.getCents();
+        for (int type = COIN_TYPES - 1; type >= 0; type--) {
+            int count = taken[type][remaining];
+            if (count > 0) change[static_cast<Coin>(type)] = count;
+            remaining -= count * COIN_CENTS[type];
         }
-        
         return change;
     }
+    
+    int getFewestCoins(Money amount) const {
+        return canMakeChange(amount) ? fewestCoins[amount.getCents()] : -1;
+    }
+    
+    int getCoinCount(Coin coin) const {
+        return coinCounts[static_cast<int>(coin)];
+    }
+    
+    Money getContiguousLimit() const {
+        return Money::fromCents(contiguousLimit);
+    }
+
+private:
+    void rebuild() {
+        static const int rebuildTime = Metrics::histogram("vending.change_table_rebuild_ns");
+        ScopedTimer timer(rebuildTime);
+        vector<int> best(MAX_CHANGE + 1, UNREACHABLE);
+        vector<int> next(MAX_CHANGE + 1);
+        vector<pair<int, int>> window(MAX_CHANGE + 1);  // (multiple, best - multiple)
+        best[0] = 0;
+        
+        for (int type = 0; type < COIN_TYPES; type++) {
+            const int value = static_cast<int>(COIN_CENTS[type]);
+            const int limit = coinCounts[type];
+            taken[type].assign(MAX_CHANGE + 1, 0);
+            fill(next.begin(), next.end(), UNREACHABLE);
+            
+            // Paying a = r + m * value with j of this coin costs
+            // best[a - j * value] + j; over a window of j <= limit that is
+            // the minimum of (best - multiple) plus m
+            for (int residue = 0; residue < value && residue <= MAX_CHANGE; residue++) {
+                size_t head = 0, tail = 0;
+                for (int multiple = 0; residue + multiple * value <= MAX_CHANGE; multiple++) {
+                    int amount = residue + multiple * value;
+                    if (best[amount] != UNREACHABLE) {
+                        int key = best[amount] - multiple;
+                        while (tail > head && window[tail - 1].second >= key) tail--;
+                        window[tail++] = {multiple, key};
+                    }
+                    while (tail > head && window[head].first < multiple - limit) head++;
+                    if (tail > head) {
+                        next[amount] = window[head].second + multiple;
+                        taken[type][amount] = static_cast<uint16_t>(multiple - window[head].first);
+                    }
+                }
+            }
+            best.swap(next);
+        }
+        
+        fewestCoins.assign(best.begin(), best.end());
+        contiguousLimit = 0;
+        while (contiguousLimit <= MAX_CHANGE && fewestCoins[contiguousLimit] != UNREACHABLE) {
+            contiguousLimit++;
+        }
+    }
 };
 
 // Inventory class implementation
+// Units are kept per expiry date, and sales take the soonest-expiring
+// units first, so the earliest expiry still in stock is always known.
 class Inventory {
 private:
     unordered_map<string, int> stockLevels;
+    unordered_map<string, map<system_clock::time_point, int>> batches;  // expiry -> units
     unordered_map<string, int> lowStockThresholds;
-    mutex inventoryMutex;
+    mutable mutex inventoryMutex;
 
 public:
-    void updateStock(const string& productId, int quantity) {
+    void addBatch(const string& productId, int quantity, system_clock::time_point expiresAt) {
         lock_guard<mutex> lock(inventoryMutex);
         stockLevels[productId] += quantity;
+        if (quantity > 0) batches[productId][expiresAt] += quantity;
+    }
+    
+    // Removes sold units, soonest-expiring first
+    void removeStock(const string& productId, int quantity) {
+        lock_guard<mutex> lock(inventoryMutex);
+        stockLevels[productId] -= quantity;
+        auto& productBatches = batches[productId];
+        while (quantity > 0 && !productBatches.empty()) {
+            auto batch = productBatches.begin();
+            int taken = min(quantity, batch->second);
+            batch->second -= taken;
+            quantity -= taken;
+            if (batch->second == 0) productBatches.erase(batch);
+        }
+    }
+    
+    // The epoch when nothing is in stock
+    system_clock::time_point getEarliestExpiry(const string& productId) const {
+        lock_guard<mutex> lock(inventoryMutex);
+        auto it = batches.find(productId);
+        if (it == batches.end() || it->second.empty()) return system_clock::time_point();
+        return it->second.begin()->first;
     }
     
     bool isLowStock(const string& productId) const {
@@ -236,6 +514,18 @@ public:
         lock_guard<mutex> lock(inventoryMutex);
         lowStockThresholds[productId] = threshold;
     }
+    
+    // Leaves a threshold that is already set alone
+    void setDefaultLowStockThreshold(const string& productId, int threshold) {
+        lock_guard<mutex> lock(inventoryMutex);
+        lowStockThresholds.emplace(productId, threshold);
+    }
+    
+    int getLowStockThreshold(const string& productId) const {
+        lock_guard<mutex> lock(inventoryMutex);
+        auto it = lowStockThresholds.find(productId);
+        return it != lowStockThresholds.end() ? it->second : 0;
+    }
 };
 
 // Display class implementation
@@ -249,18 +539,18 @@ public:
         lock_guard<mutex> lock(displayMutex);
         cout << "Available Products:" << endl;
         for (const auto& product : products) {
-            cout << product.getName() << " - $" << product.getPrice() << endl;
+            cout << product.getName() << " - " << product.getPrice() << endl;
         }
     }
     
-    void showPrice(double price) {
+    void showPrice(Money price) {
         lock_guard<mutex> lock(displayMutex);
-        cout << "Price: $" << price << endl;
+        cout << "Price: " << price << endl;
     }
     
     void showPaymentStatus(const Payment& payment) {
         lock_guard<mutex> lock(displayMutex);
-        cout << "Total Amount: $" << payment.getTotalAmount() << endl;
+        cout << "Total Amount: " << payment.getTotalAmount() << endl;
     }
     
     void showChange(const unordered_map<Coin, int>& change) {
@@ -282,7 +572,318 @@ public:
     }
 };
 
+// One sales/stock change as it travels to the fleet server. SKUs are sent
+// as small per-machine ids; a SKU_NAMED record binds an id to the product
+// id the first time the machine reports it.
+struct StockDelta {
+    StockDeltaType type = StockDeltaType::STOCKED;
+    uint32_t sku = 0;
+    int32_t quantity = 0;    // units stocked or sold
+    int32_t stockAfter = 0;  // level once the change is applied
+    int32_t threshold = 0;   // low-stock threshold in force
+    int64_t cents = 0;       // sale price
+    int64_t expiresAt = 0;   // earliest expiry in stock, seconds since the epoch
+    string name;             // SKU_NAMED only
+    
+    static int64_t toSeconds(system_clock::time_point time) {
+        return duration_cast<seconds>(time.time_since_epoch()).count();
+    }
+    
+    void encode(string& bytes) const {
+        bytes.push_back(static_cast<char>(type));
+        appendRaw(bytes, sku);
+        if (type == StockDeltaType::SKU_NAMED) {
+            appendRaw(bytes, static_cast<uint16_t>(name.size()));
+            bytes += name;
+            return;
+        }
+        appendRaw(bytes, quantity);
+        appendRaw(bytes, stockAfter);
+        appendRaw(bytes, threshold);
+        appendRaw(bytes, cents);
+        appendRaw(bytes, expiresAt);
+    }
+    
+    // False if the record is cut short
+    bool decode(const char* data, size_t size, size_t& offset) {
+        if (size - offset < 1) return false;
+        type = static_cast<StockDeltaType>(data[offset++]);
+        if (!readRaw(data, size, offset, sku)) return false;
+        if (type == StockDeltaType::SKU_NAMED) {
+            uint16_t length;
+            if (!readRaw(data, size, offset, length) || size - offset < length) return false;
+            name.assign(data + offset, length);
+            offset += length;
+            return true;
+        }
+        return readRaw(data, size, offset, quantity) && readRaw(data, size, offset, stockAfter) &&
+               readRaw(data, size, offset, threshold) && readRaw(data, size, offset, cents) &&
+               readRaw(data, size, offset, expiresAt);
+    }
+
+private:
+    template<typename T>
+    static void appendRaw(string& bytes, T value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    template<typename T>
+    static bool readRaw(const char* data, size_t size, size_t& offset, T& value) {
+        if (size - offset < sizeof(value)) return false;
+        memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    }
+};
+
+// TelemetryUplink class implementation
+// Shared by the machines of a fleet. Each machine batches its own deltas
+// and hands over a whole batch, framed as [u8 machine id length][machine
+// id][u16 record count][records], so the transport is called once per
+// batch rather than once per sale.
+class TelemetryUplink {
+private:
+    function<void(const string&)> transport;
+    size_t batchSize;
+    atomic<uint64_t> batchesSent{0};
+    atomic<uint64_t> bytesSent{0};
+    mutex uplinkMutex;
+
+public:
+    explicit TelemetryUplink(function<void(const string&)> transport, size_t batchSize = 64)
+        : transport(move(transport)), batchSize(batchSize) {}
+    
+    size_t getBatchSize() const { return batchSize; }
+    
+    void send(const string& batch) {
+        lock_guard<mutex> lock(uplinkMutex);
+        transport(batch);
+        batchesSent.fetch_add(1, memory_order_relaxed);
+        bytesSent.fetch_add(batch.size(), memory_order_relaxed);
+    }
+    
+    uint64_t getBatchesSent() const { return batchesSent.load(memory_order_relaxed); }
+    uint64_t getBytesSent() const { return bytesSent.load(memory_order_relaxed); }
+};
+
+// TelemetryChannel class implementation
+// A machine's side of the uplink. Not locked itself; the owning machine
+// calls it under its own mutex.
+class TelemetryChannel {
+private:
+    string machineId;
+    TelemetryUplink* uplink;
+    unordered_map<string, uint32_t> skuIds;
+    string pending;
+    uint16_t pendingCount;
+
+public:
+    TelemetryChannel(const string& machineId, TelemetryUplink* uplink)
+        : machineId(machineId.substr(0, UINT8_MAX)), uplink(uplink), pendingCount(0) {}
+    
+    ~TelemetryChannel() {
+        flush();
+    }
+    
+    void record(StockDelta delta, const string& productId) {
+        if (!uplink) return;
+        auto it = skuIds.find(productId);
+        if (it == skuIds.end()) {
+            it = skuIds.emplace(productId, static_cast<uint32_t>(skuIds.size())).first;
+            StockDelta named;
+            named.type = StockDeltaType::SKU_NAMED;
+            named.sku = it->second;
+            named.name = productId;
+            append(named);
+        }
+        delta.sku = it->second;
+        append(delta);
+    }
+    
+    void flush() {
+        if (!uplink || pendingCount == 0) return;
+        string batch;
+        batch.reserve(machineId.size() + 3 + pending.size());
+        batch.push_back(static_cast<char>(machineId.size()));
+        batch += machineId;
+        batch.append(reinterpret_cast<const char*>(&pendingCount), sizeof(pendingCount));
+        batch += pending;
+        uplink->send(batch);
+        pending.clear();
+        pendingCount = 0;
+    }
+
+private:
+    void append(const StockDelta& delta) {
+        delta.encode(pending);
+        pendingCount++;
+        if (pendingCount >= uplink->getBatchSize() || pendingCount == UINT16_MAX) {
+            flush();
+        }
+    }
+};
+
+// FleetAggregator class implementation
+// Server side. Folds each machine's deltas into the last known state per
+// (machine, SKU) and keeps two per-SKU indexes up to date as it goes:
+// machines at or under their low-stock threshold, and machines ordered by
+// when their stock of the SKU expires. Restock queries read the indexes
+// instead of polling machines.
+class FleetAggregator {
+public:
+    struct SlotState {
+        int stock = 0;
+        int threshold = 0;
+        int64_t expiresAt = 0;
+    };
+    
+    struct SkuTotals {
+        int unitsSold = 0;
+        Money revenue;
+    };
+    
+    struct RestockStop {
+        string machineId;
+        vector<string> lowStock;
+        vector<string> expired;
+    };
+
+private:
+    unordered_map<string, vector<string>> skuNames;                  // machine -> SKU id -> product id
+    map<pair<string, string>, SlotState> slots;                      // (machine, product)
+    unordered_map<string, set<string>> lowStockBySku;
+    unordered_map<string, set<pair<int64_t, string>>> expiryBySku;   // (expiresAt, machine)
+    unordered_map<string, SkuTotals> totalsBySku;
+    uint64_t deltasApplied = 0;
+    mutable shared_mutex aggregatorMutex;
+
+public:
+    // False, with nothing applied, if the batch is malformed
+    bool ingest(const string& batch) {
+        const char* data = batch.data();
+        size_t size = batch.size(), offset = 0;
+        if (size < 1 || size - 1 < static_cast<uint8_t>(data[0]) + sizeof(uint16_t)) return false;
+        string machineId(data + 1, static_cast<uint8_t>(data[0]));
+        offset = 1 + machineId.size();
+        uint16_t count;
+        memcpy(&count, data + offset, sizeof(count));
+        offset += sizeof(count);
+        
+        vector<StockDelta> deltas(count);
+        for (auto& delta : deltas) {
+            if (!delta.decode(data, size, offset)) return false;
+        }
+        if (offset != size) return false;
+        
+        unique_lock<shared_mutex> lock(aggregatorMutex);
+        vector<string>& names = skuNames[machineId];
+        for (const auto& delta : deltas) {
+            if (delta.type == StockDeltaType::SKU_NAMED) {
+                if (names.size() <= delta.sku) names.resize(delta.sku + 1);
+                names[delta.sku] = delta.name;
+            } else if (delta.sku < names.size()) {
+                applyLocked(machineId, names[delta.sku], delta);
+            }
+        }
+        return true;
+    }
+    
+    vector<string> getLowStockMachines(const string& productId) const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        auto it = lowStockBySku.find(productId);
+        if (it == lowStockBySku.end()) return {};
+        return vector<string>(it->second.begin(), it->second.end());
+    }
+    
+    // Machines whose stock of the product expires by the given time,
+    // soonest first
+    vector<string> getExpiringMachines(const string& productId, system_clock::time_point by) const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        vector<string> machines;
+        auto it = expiryBySku.find(productId);
+        if (it == expiryBySku.end()) return machines;
+        int64_t limit = StockDelta::toSeconds(by);
+        for (const auto& entry : it->second) {
+            if (entry.first > limit) break;
+            machines.push_back(entry.second);
+        }
+        return machines;
+    }
+    
+    // One stop per machine that has anything low or expired, in machine order
+    vector<RestockStop> planRestock(system_clock::time_point now) const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        map<string, RestockStop> stops;
+        for (const auto& entry : lowStockBySku) {
+            for (const string& machineId : entry.second) {
+                stops[machineId].lowStock.push_back(entry.first);
+            }
+        }
+        int64_t limit = StockDelta::toSeconds(now);
+        for (const auto& entry : expiryBySku) {
+            for (const auto& expiry : entry.second) {
+                if (expiry.first > limit) break;
+                stops[expiry.second].expired.push_back(entry.first);
+            }
+        }
+        
+        vector<RestockStop> route;
+        for (auto& entry : stops) {
+            entry.second.machineId = entry.first;
+            sort(entry.second.lowStock.begin(), entry.second.lowStock.end());
+            sort(entry.second.expired.begin(), entry.second.expired.end());
+            route.push_back(move(entry.second));
+        }
+        return route;
+    }
+    
+    optional<SlotState> getSlot(const string& machineId, const string& productId) const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        auto it = slots.find({machineId, productId});
+        if (it == slots.end()) return nullopt;
+        return it->second;
+    }
+    
+    SkuTotals getTotals(const string& productId) const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        auto it = totalsBySku.find(productId);
+        return it != totalsBySku.end() ? it->second : SkuTotals();
+    }
+    
+    uint64_t getDeltasApplied() const {
+        shared_lock<shared_mutex> lock(aggregatorMutex);
+        return deltasApplied;
+    }
+
+private:
+    void applyLocked(const string& machineId, const string& productId, const StockDelta& delta) {
+        SlotState& slot = slots[{machineId, productId}];
+        auto& expiries = expiryBySku[productId];
+        if (slot.stock > 0) expiries.erase({slot.expiresAt, machineId});
+        
+        slot.stock = delta.stockAfter;
+        slot.threshold = delta.threshold;
+        slot.expiresAt = delta.expiresAt;
+        if (delta.type == StockDeltaType::SOLD) {
+            SkuTotals& totals = totalsBySku[productId];
+            totals.unitsSold += delta.quantity;
+            totals.revenue += Money::fromCents(delta.cents) * delta.quantity;
+        }
+        
+        // An empty slot has nothing left to expire
+        if (slot.stock > 0) expiries.insert({slot.expiresAt, machineId});
+        if (slot.stock <= slot.threshold) {
+            lowStockBySku[productId].insert(machineId);
+        } else {
+            lowStockBySku[productId].erase(machineId);
+        }
+        deltasApplied++;
+    }
+};
+
 // VendingMachine class implementation (Singleton)
+// getInstance serves a standalone machine; fleets construct one machine
+// per unit and share a TelemetryUplink between them.
 class VendingMachine {
 private:
     static VendingMachine* instance;
@@ -291,14 +892,24 @@ private:
     ProductCatalog catalog;
     Inventory inventory;
     Display display;
+    ChangeMaker coinFloat;
+    TelemetryChannel telemetry;
     Payment* currentPayment;
     string selectedProductId;
     MachineState state;
-    mutex machineMutex;
+    InstrumentedMutex machineMutex{"vending.machine_lock"};
+
+public:
+    explicit VendingMachine(const string& machineId = "VM-0", TelemetryUplink* uplink = nullptr)
+        : telemetry(machineId, uplink), currentPayment(nullptr), state(MachineState::IDLE) {}
     
-    VendingMachine() : state(MachineState::IDLE), currentPayment(nullptr) {}
+    VendingMachine(const VendingMachine&) = delete;
+    VendingMachine& operator=(const VendingMachine&) = delete;
+    
+    ~VendingMachine() {
+        delete currentPayment;
+    }
     
-public:
     static VendingMachine* getInstance() {
         lock_guard<mutex> lock(instanceMutex);
         if (!instance) {
@@ -307,15 +918,76 @@ public:
         return instance;
     }
     
+    // A known SKU is restocked: its units join the stock as a new batch
+    // and an operator-set threshold stays in force
     void addProduct(const Product& product) {
-        lock_guard<mutex> lock(machineMutex);
+        lock_guard<InstrumentedMutex> lock(machineMutex);
         catalog.addProduct(product);
-        inventory.updateStock(product.getId(), product.getQuantity());
-        inventory.setLowStockThreshold(product.getId(), 5);
+        inventory.addBatch(product.getId(), product.getQuantity(), product.getExpirationDate());
+        inventory.setDefaultLowStockThreshold(product.getId(), 5);
+        syncExpiryLocked(product.getId());
+        
+        StockDelta delta;
+        delta.type = StockDeltaType::STOCKED;
+        delta.quantity = product.getQuantity();
+        recordLocked(delta, product.getId());
+    }
+    
+    // Copy of the catalog entry, if the product is stocked here
+    optional<Product> getProduct(const string& productId) {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        Product* product = catalog.getProduct(productId);
+        if (!product) return nullopt;
+        return *product;
+    }
+    
+    int getStockLevel(const string& productId) const {
+        return inventory.getStockLevel(productId);
+    }
+    
+    void setLowStockThreshold(const string& productId, int threshold) {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        inventory.setLowStockThreshold(productId, threshold);
+        
+        StockDelta delta;
+        delta.type = StockDeltaType::THRESHOLD_SET;
+        recordLocked(delta, productId);
+    }
+    
+    // Sends whatever telemetry is still batched
+    void flushTelemetry() {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        telemetry.flush();
+    }
+    
+    bool isLowStock(const string& productId) const {
+        return inventory.isLowStock(productId);
+    }
+    
+    // Service: coins loaded into the changer
+    void loadCoins(Coin coin, int count) {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        coinFloat.addCoins(coin, count);
+    }
+    
+    int getCoinCount(Coin coin) {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        return coinFloat.getCoinCount(coin);
+    }
+    
+    // Shown when the float cannot pay every amount under a dollar
+    bool isExactChangeOnly() {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        return coinFloat.getContiguousLimit() < Money::fromCents(100);
+    }
+    
+    MachineState getState() {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        return state;
     }
     
     void selectProduct(const string& productId) {
-        lock_guard<mutex> lock(machineMutex);
+        lock_guard<InstrumentedMutex> lock(machineMutex);
         if (state != MachineState::IDLE) {
             display.showError("Machine is busy");
             return;
@@ -338,7 +1010,10 @@ public:
     }
     
     void processPayment(const Payment& payment) {
-        lock_guard<mutex> lock(machineMutex);
+        static const int paymentTime = Metrics::histogram("vending.payment_ns");
+        static const int exactChangeRefusals = Metrics::counter("vending.exact_change_refusals");
+        ScopedTimer timer(paymentTime);
+        lock_guard<InstrumentedMutex> lock(machineMutex);
         if (state != MachineState::SELECTING) {
             display.showError("Invalid state for payment");
             return;
@@ -355,18 +1030,49 @@ public:
             return;
         }
         
+        // The customer's coins drop into the float first, so they can be
+        // part of their own change
+        unordered_map<Coin, int> insertedCoins = payment.getCoins();
+        coinFloat.addCoins(insertedCoins);
+        if (!coinFloat.canMakeChange(payment.getTotalAmount() - product->getPrice())) {
+            coinFloat.removeCoins(insertedCoins);
+            Metrics::add(exactChangeRefusals);
+            display.showError("Exact change only");
+            return;
+        }
+        
         currentPayment = new Payment(payment);
         state = MachineState::PAYING;
         display.showPaymentStatus(*currentPayment);
         
         if (currentPayment->processPayment()) {
             state = MachineState::DISPENSING;
-            dispenseProduct();
+            dispenseLocked();
         }
     }
     
     void dispenseProduct() {
-        lock_guard<mutex> lock(machineMutex);
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        dispenseLocked();
+    }
+    
+    void cancelTransaction() {
+        lock_guard<InstrumentedMutex> lock(machineMutex);
+        if (currentPayment) {
+            auto change = currentPayment->calculateChange(Money());
+            display.showChange(change);
+            delete currentPayment;
+            currentPayment = nullptr;
+        }
+        
+        state = MachineState::IDLE;
+        selectedProductId.clear();
+        display.clear();
+    }
+
+private:
+    // Caller holds machineMutex
+    void dispenseLocked() {
         if (state != MachineState::DISPENSING) {
             display.showError("Invalid state for dispensing");
             return;
@@ -378,12 +1084,25 @@ public:
             return;
         }
         
-        inventory.updateStock(selectedProductId, -1);
+        static const int sales = Metrics::counter("vending.sales");
+        inventory.removeStock(selectedProductId, 1);
+        product->updateQuantity(-1);
+        syncExpiryLocked(selectedProductId);
+        Metrics::add(sales);
         cout << "Dispensing " << product->getName() << endl;
         
+        StockDelta delta;
+        delta.type = StockDeltaType::SOLD;
+        delta.quantity = 1;
+        delta.cents = product->getPrice().getCents();
+        recordLocked(delta, selectedProductId);
+        
         if (currentPayment) {
-            auto change = currentPayment->calculateChange(product->getPrice());
-            display.showChange(change);
+            auto change = coinFloat.makeChange(currentPayment->getTotalAmount() - product->getPrice());
+            if (change) {
+                coinFloat.removeCoins(*change);
+                display.showChange(*change);
+            }
             delete currentPayment;
             currentPayment = nullptr;
         }
@@ -392,18 +1111,22 @@ public:
         selectedProductId.clear();
     }
     
-    void cancelTransaction() {
-        lock_guard<mutex> lock(machineMutex);
-        if (currentPayment) {
-            auto change = currentPayment->calculateChange(0);
-            display.showChange(change);
-            delete currentPayment;
-            currentPayment = nullptr;
+    // Caller holds machineMutex; fills in the stock level and threshold
+    // Every delta carries the earliest expiry still in stock, so the fleet
+    // sees it move on once the oldest units are sold
+    void recordLocked(StockDelta delta, const string& productId) {
+        delta.stockAfter = inventory.getStockLevel(productId);
+        delta.threshold = inventory.getLowStockThreshold(productId);
+        delta.expiresAt = StockDelta::toSeconds(inventory.getEarliestExpiry(productId));
+        telemetry.record(delta, productId);
+    }
+    
+    // The catalog entry shows the soonest-expiring units on hand
+    void syncExpiryLocked(const string& productId) {
+        Product* product = catalog.getProduct(productId);
+        if (product && inventory.getStockLevel(productId) > 0) {
+            product->setExpirationDate(inventory.getEarliestExpiry(productId));
         }
-        
-        state = MachineState::IDLE;
-        selectedProductId.clear();
-        display.clear();
     }
 };
 
@@ -416,8 +1139,8 @@ int main() {
     VendingMachine* machine = VendingMachine::getInstance();
     
     // Add products
-    Product chips("Lays Chips", 1.50, "Snacks");
-    Product soda("Coca Cola", 1.00, "Beverages");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
+    Product soda("Coca Cola", Money(1.00), "Beverages");
     machine->addProduct(chips);
     machine->addProduct(soda);
     
@@ -425,7 +1148,7 @@ int main() {
     machine->selectProduct(chips.getId());
     
     // Process payment
-    Payment payment(2.00);
+    Payment payment(Money(2.00));
     payment.addCoin(Coin::QUARTER, 6);
     machine->processPayment(payment);
     
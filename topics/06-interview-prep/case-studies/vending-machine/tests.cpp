@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <thread>
 #include "implementation.cpp"
 
 using namespace std;
@@ -24,6 +25,14 @@ void assertEqual(int expected, int actual, const string& message) {
     }
 }
 
+void assertEqual(Money expected, Money actual, const string& message) {
+    if (expected != actual) {
+        throw runtime_error("Test failed: " + message + 
+                          " (Expected: " + expected.toString() + 
+                          ", Got: " + actual.toString() + ")");
+    }
+}
+
 void assertEqual(double expected, double actual, const string& message) {
     if (abs(expected - actual) > 0.001) {
         throw runtime_error("Test failed: " + message + 
@@ -39,8 +48,8 @@ void testProductManagement() {
     VendingMachine* machine = VendingMachine::getInstance();
     
     // Test adding products
-    Product chips("Lays Chips", 1.50, "Snacks");
-    Product soda("Coca Cola", 1.00, "Beverages");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
+    Product soda("Coca Cola", Money(1.00), "Beverages");
     machine->addProduct(chips);
     machine->addProduct(soda);
     
@@ -54,17 +63,17 @@ void testPaymentProcessing() {
     cout << "Running payment processing tests..." << endl;
     
     // Create a payment
-    Payment payment(1.50);
+    Payment payment(Money(1.50));
     
     // Test adding coins
     payment.addCoin(Coin::QUARTER, 6);
-    assertEqual(1.50, payment.getTotalAmount(), "Total amount should be $1.50");
+    assertEqual(Money(1.50), payment.getTotalAmount(), "Total amount should be $1.50");
     
     // Test payment processing
     assertTrue(payment.processPayment(), "Payment should be completed");
     
     // Test change calculation
-    auto change = payment.calculateChange(1.00);
+    auto change = payment.calculateChange(Money(1.00));
     assertEqual(2, change[Coin::QUARTER], "Should return 2 quarters as change");
     
     cout << "Payment processing tests passed!" << endl;
@@ -76,7 +85,7 @@ void testInventoryManagement() {
     VendingMachine* machine = VendingMachine::getInstance();
     
     // Add a product
-    Product chips("Lays Chips", 1.50, "Snacks");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
     machine->addProduct(chips);
     
     // Test stock level
@@ -95,13 +104,13 @@ void testTransactionFlow() {
     VendingMachine* machine = VendingMachine::getInstance();
     
     // Add a product
-    Product chips("Lays Chips", 1.50, "Snacks");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
     machine->addProduct(chips);
     
     // Test complete transaction flow
     machine->selectProduct(chips.getId());
     
-    Payment payment(2.00);
+    Payment payment(Money(2.00));
     payment.addCoin(Coin::QUARTER, 8);
     machine->processPayment(payment);
     
@@ -117,11 +126,11 @@ void testErrorHandling() {
     machine->selectProduct("INVALID_ID");
     
     // Test insufficient payment
-    Product chips("Lays Chips", 1.50, "Snacks");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
     machine->addProduct(chips);
     machine->selectProduct(chips.getId());
     
-    Payment payment(1.00);
+    Payment payment(Money(1.00));
     payment.addCoin(Coin::QUARTER, 3);
     machine->processPayment(payment);
     
@@ -134,8 +143,8 @@ void testConcurrentOperations() {
     VendingMachine* machine = VendingMachine::getInstance();
     
     // Add products
-    Product chips("Lays Chips", 1.50, "Snacks");
-    Product soda("Coca Cola", 1.00, "Beverages");
+    Product chips("Lays Chips", Money(1.50), "Snacks");
+    Product soda("Coca Cola", Money(1.00), "Beverages");
     machine->addProduct(chips);
     machine->addProduct(soda);
     
@@ -144,12 +153,12 @@ void testConcurrentOperations() {
     // For testing, we'll just verify the thread safety of the operations
     
     machine->selectProduct(chips.getId());
-    Payment payment1(2.00);
+    Payment payment1(Money(2.00));
     payment1.addCoin(Coin::QUARTER, 8);
     machine->processPayment(payment1);
     
     machine->selectProduct(soda.getId());
-    Payment payment2(1.00);
+    Payment payment2(Money(1.00));
     payment2.addCoin(Coin::QUARTER, 4);
     machine->processPayment(payment2);
     
@@ -160,18 +169,303 @@ void testChangeCalculation() {
     cout << "Running change calculation tests..." << endl;
     
     // Test various change scenarios
-    Payment payment(2.00);
+    Payment payment(Money(2.00));
     payment.addCoin(Coin::QUARTER, 8);
     
-    auto change = payment.calculateChange(1.50);
+    auto change = payment.calculateChange(Money(1.50));
     assertEqual(2, change[Coin::QUARTER], "Should return 2 quarters as change");
     
-    change = payment.calculateChange(1.75);
+    change = payment.calculateChange(Money(1.75));
     assertEqual(1, change[Coin::QUARTER], "Should return 1 quarter as change");
     
     cout << "Change calculation tests passed!" << endl;
 }
 
+// True when money * T compiles
+template <typename T, typename = void>
+struct CanScaleMoneyBy : false_type {};
+
+template <typename T>
+struct CanScaleMoneyBy<T, void_t<decltype(declval<Money>() * declval<T>())>> : true_type {};
+
+void testMoney() {
+    cout << "Running money tests..." << endl;
+    
+    // Inserted cash is counted in cents, so mixed coins add up exactly
+    Payment payment(Money(1.15));
+    payment.addCoin(Coin::DIME, 7);
+    payment.addCoin(Coin::NICKEL, 3);
+    payment.addCoin(Coin::PENNY, 30);
+    assertEqual(Money(1.15), payment.getTotalAmount(), "Seventy, fifteen and thirty cents");
+    
+    // Doubles never become money implicitly, and money scales only by whole counts
+    static_assert(!is_convertible<double, Money>::value, "A double should not convert to Money implicitly");
+    static_assert(CanScaleMoneyBy<int>::value, "Money should scale by a whole count");
+    static_assert(!CanScaleMoneyBy<double>::value, "Money should not scale by a fraction");
+    assertTrue(payment.processPayment(), "Exact amount should complete the payment");
+    
+    payment.addBill(Bill::FIVE, 1);
+    payment.addBill(Bill::TWENTY, 1);
+    assertEqual(2615, (int)payment.getTotalAmount().getCents(), "Bills count in whole dollars");
+    
+    // $26.15 less $0.49 is 102 quarters, 1 dime, 1 nickel and 1 penny
+    auto change = payment.calculateChange(Money(0.49));
+    assertEqual(102, change[Coin::QUARTER], "Quarters first");
+    assertEqual(1, change[Coin::DIME], "Then a dime");
+    assertEqual(1, change[Coin::NICKEL], "Then a nickel");
+    assertEqual(1, change[Coin::PENNY], "Then a penny");
+    
+    // A payment copied into the machine keeps its total
+    Payment copy(payment);
+    assertEqual(payment.getTotalAmount(), copy.getTotalAmount(), "Copies keep the inserted total");
+    assertTrue(Money(0.1) + Money(0.2) == Money(0.3), "Cents do not drift");
+    assertTrue(Money::fromCents(150).toString() == "$1.50", "Amounts print as dollars");
+    
+    cout << "Money tests passed!" << endl;
+}
+
+void testChangeMaker() {
+    cout << "Running change maker tests..." << endl;
+    
+    // Greedy would take the quarter and be left needing a nickel
+    ChangeMaker coinFloat;
+    coinFloat.addCoins(Coin::QUARTER, 1);
+    coinFloat.addCoins(Coin::DIME, 3);
+    assertTrue(coinFloat.canMakeChange(Money(0.30)), "Three dimes pay thirty cents");
+    auto change = coinFloat.makeChange(Money(0.30));
+    assertTrue(change.has_value(), "Change should be found");
+    assertEqual(3, (*change)[Coin::DIME], "Paid in dimes");
+    assertEqual(0, (*change)[Coin::QUARTER], "Without the quarter");
+    
+    // Never more coins than the float holds, fewest coins otherwise
+    assertFalse(coinFloat.canMakeChange(Money(0.40)), "Only three dimes to go with the quarter");
+    assertEqual(2, coinFloat.getFewestCoins(Money(0.35)), "A quarter and a dime");
+    assertEqual(-1, coinFloat.getFewestCoins(Money(0.05)), "No nickels or pennies");
+    assertEqual(Money(0.01), coinFloat.getContiguousLimit(), "Nothing but zero without pennies");
+    
+    coinFloat.addCoins(Coin::PENNY, 4);
+    coinFloat.addCoins(Coin::NICKEL, 1);
+    assertEqual(Money(0.65), coinFloat.getContiguousLimit(), "Pennies and a nickel fill the gaps");
+    assertFalse(coinFloat.canMakeChange(Money(25.00)), "Beyond the largest note");
+    
+    // Paying out takes the coins from the float
+    assertTrue(coinFloat.removeCoins(*coinFloat.makeChange(Money(0.35))), "Coins are in the float");
+    assertEqual(0, coinFloat.getCoinCount(Coin::QUARTER), "Quarter paid out");
+    assertEqual(2, coinFloat.getCoinCount(Coin::DIME), "One dime paid out");
+    assertFalse(coinFloat.removeCoins({{Coin::QUARTER, 1}}), "Cannot pay out coins it does not hold");
+    
+    cout << "Change maker tests passed!" << endl;
+}
+
+void testExactChange() {
+    cout << "Running exact change tests..." << endl;
+    
+    VendingMachine* machine = VendingMachine::getInstance();
+    assertTrue(machine->isExactChangeOnly(), "An empty changer needs exact change");
+    
+    Product gum("Trident Gum", Money(0.75), "Snacks");
+    gum.updateQuantity(5);
+    machine->addProduct(gum);
+    
+    // The customer's own quarter comes back as change
+    machine->selectProduct(gum.getId());
+    Payment quarters(Money(1.00));
+    quarters.addCoin(Coin::QUARTER, 4);
+    machine->processPayment(quarters);
+    assertTrue(machine->getState() == MachineState::IDLE, "Sale should complete");
+    assertEqual(4, machine->getStockLevel(gum.getId()), "One pack dispensed");
+    assertEqual(3, machine->getCoinCount(Coin::QUARTER), "Three quarters kept");
+    
+    // A five cannot be broken by three quarters
+    machine->selectProduct(gum.getId());
+    Payment bill(Money(5.00));
+    bill.addBill(Bill::FIVE, 1);
+    machine->processPayment(bill);
+    assertTrue(machine->getState() == MachineState::SELECTING, "Sale should be refused");
+    assertEqual(3, machine->getCoinCount(Coin::QUARTER), "Float untouched");
+    
+    // Once the changer is loaded the same bill goes through
+    machine->loadCoins(Coin::DIME, 40);
+    machine->loadCoins(Coin::NICKEL, 20);
+    machine->loadCoins(Coin::PENNY, 20);
+    assertFalse(machine->isExactChangeOnly(), "Loaded changer makes any change");
+    machine->processPayment(bill);
+    assertTrue(machine->getState() == MachineState::IDLE, "Sale should complete");
+    assertEqual(0, machine->getCoinCount(Coin::QUARTER), "Quarters go first");
+    assertEqual(5, machine->getCoinCount(Coin::DIME), "Then dimes, $4.25 in 38 coins");
+    
+    cout << "Exact change tests passed!" << endl;
+}
+
+void testFleetTelemetry() {
+    cout << "Running fleet telemetry tests..." << endl;
+    
+    FleetAggregator aggregator;
+    TelemetryUplink uplink([&aggregator](const string& batch) {
+        assertTrue(aggregator.ingest(batch), "Batches should decode");
+    }, 4);
+    
+    // Generated ids never repeat, so one-off products never merge
+    set<string> generated;
+    for (int i = 0; i < 5000; i++) {
+        generated.insert(Product("Sample", Money(1.00), "Snacks").getId());
+    }
+    assertEqual(5000, (int)generated.size(), "Generated product ids are unique");
+    
+    // Every machine of the fleet is its own instance and builds its own
+    // Dasani; the shared SKU is what the aggregator joins them on
+    const Product water("SKU-DASANI-500", "Dasani", Money(1.00), "Beverages");
+    const Product sandwich("SKU-CLUB-SANDWICH", "Club Sandwich", Money(1.00), "Food");
+    vector<unique_ptr<VendingMachine>> fleet;
+    for (int i = 0; i < 3; i++) {
+        fleet.push_back(make_unique<VendingMachine>("VM-" + to_string(i), &uplink));
+        Product stocked(water.getId(), "Dasani", Money(1.00), "Beverages");
+        stocked.updateQuantity(6);
+        fleet.back()->addProduct(stocked);
+    }
+    Product staleSandwich(sandwich.getId(), "Club Sandwich", Money(1.00), "Food");
+    staleSandwich.updateQuantity(8);
+    staleSandwich.setExpirationDate(system_clock::now() - hours(1));
+    fleet[2]->addProduct(staleSandwich);
+    
+    bool refused = false;
+    try {
+        fleet[2]->addProduct(Product(water.getId(), "Fiji", Money(1.50), "Beverages"));
+    } catch (const invalid_argument&) {
+        refused = true;
+    }
+    assertTrue(refused, "A SKU held by another product is not overwritten");
+    
+    // A sale takes VM-0 and VM-1 down to the threshold of 5
+    for (int i = 0; i < 2; i++) {
+        fleet[i]->selectProduct(water.getId());
+        Payment payment(Money(1.00));
+        payment.addCoin(Coin::QUARTER, 4);
+        fleet[i]->processPayment(payment);
+    }
+    for (auto& machine : fleet) machine->flushTelemetry();
+    
+    auto low = aggregator.getLowStockMachines(water.getId());
+    assertEqual(2, (int)low.size(), "Two machines low on water");
+    assertTrue(low[0] == "VM-0" && low[1] == "VM-1", "The two that sold");
+    assertEqual(5, aggregator.getSlot("VM-0", water.getId())->stock, "Stock tracked from deltas");
+    assertEqual(2, aggregator.getTotals(water.getId()).unitsSold, "Sales summed across the fleet");
+    assertEqual(Money(2.00), aggregator.getTotals(water.getId()).revenue, "Revenue summed across the fleet");
+    
+    auto expired = aggregator.getExpiringMachines(sandwich.getId(), system_clock::now());
+    assertEqual(1, (int)expired.size(), "One stale sandwich slot");
+    assertTrue(expired[0] == "VM-2", "On VM-2");
+    assertEqual(3, (int)aggregator.getExpiringMachines(water.getId(), system_clock::now() + hours(24 * 31)).size(),
+                "All water expires within a month");
+    
+    auto route = aggregator.planRestock(system_clock::now());
+    assertEqual(3, (int)route.size(), "Three stops");
+    assertTrue(route[2].machineId == "VM-2" && route[2].expired.size() == 1, "VM-2 for the sandwich");
+    assertTrue(route[2].lowStock.empty(), "VM-2 still has water");
+    
+    // Restocking clears the low-stock entry
+    Product refill(water.getId(), "Dasani", Money(1.00), "Beverages");
+    refill.updateQuantity(4);
+    fleet[0]->addProduct(refill);
+    fleet[0]->flushTelemetry();
+    assertEqual(1, (int)aggregator.getLowStockMachines(water.getId()).size(), "VM-0 restocked");
+    
+    // A restock keeps the older units' expiry and the operator's threshold
+    fleet[1]->setLowStockThreshold(water.getId(), 2);
+    Product moreWater(water.getId(), "Dasani", Money(1.00), "Beverages");
+    moreWater.updateQuantity(1);
+    fleet[1]->addProduct(moreWater);
+    Product freshSandwich(sandwich.getId(), "Club Sandwich", Money(1.00), "Food");
+    freshSandwich.updateQuantity(4);
+    fleet[2]->addProduct(freshSandwich);
+    fleet[1]->flushTelemetry();
+    fleet[2]->flushTelemetry();
+    assertEqual(2, aggregator.getSlot("VM-1", water.getId())->threshold, "Restock keeps the threshold");
+    assertEqual(1, (int)aggregator.getExpiringMachines(sandwich.getId(), system_clock::now()).size(),
+                "Stale sandwiches still count after a fresh batch");
+    assertEqual(12, fleet[2]->getProduct(sandwich.getId())->getQuantity(), "Catalog counts both batches");
+    
+    // Selling the stale units first moves the expiry on to the fresh batch
+    for (int i = 0; i < 8; i++) {
+        fleet[2]->selectProduct(sandwich.getId());
+        Payment payment(Money(1.00));
+        payment.addCoin(Coin::QUARTER, 4);
+        fleet[2]->processPayment(payment);
+    }
+    fleet[2]->flushTelemetry();
+    assertEqual(4, fleet[2]->getProduct(sandwich.getId())->getQuantity(), "Catalog follows the sales");
+    assertEqual(4, fleet[2]->getStockLevel(sandwich.getId()), "Inventory follows the sales");
+    assertTrue(aggregator.getExpiringMachines(sandwich.getId(), system_clock::now()).empty(),
+               "Only fresh sandwiches are left");
+    
+    // Deltas travel in batches, not one call per sale
+    assertTrue(uplink.getBatchesSent() < aggregator.getDeltasApplied(), "Deltas are batched");
+    assertFalse(aggregator.ingest(string("\x04VM-9\x01\x00\x02", 8)), "Truncated batch is rejected");
+    
+    // Machines sell concurrently through the shared uplink
+    Product candy("Snickers", Money(0.25), "Snacks");
+    candy.updateQuantity(50);
+    for (auto& machine : fleet) machine->addProduct(candy);
+    vector<thread> threads;
+    for (auto& machine : fleet) {
+        VendingMachine* unit = machine.get();
+        threads.emplace_back([unit, &candy]() {
+            for (int i = 0; i < 46; i++) {
+                unit->selectProduct(candy.getId());
+                Payment payment(Money(0.25));
+                payment.addCoin(Coin::QUARTER, 1);
+                unit->processPayment(payment);
+            }
+            unit->flushTelemetry();
+        });
+    }
+    for (auto& t : threads) t.join();
+    assertEqual(138, aggregator.getTotals(candy.getId()).unitsSold, "Every sale reported");
+    assertEqual(3, (int)aggregator.getLowStockMachines(candy.getId()).size(), "Four left everywhere");
+    
+    cout << "Fleet telemetry tests passed!" << endl;
+}
+
+void testInstrumentation() {
+    cout << "Running instrumentation tests..." << endl;
+    
+    VendingMachine machine("VM-METRICS");
+    Product mints("Altoids", Money(0.50), "Snacks");
+    mints.updateQuantity(3);
+    machine.addProduct(mints);
+    MetricsSnapshot before = Metrics::snapshot();
+    
+    // One sale with exact coins, one refused for want of change
+    machine.selectProduct(mints.getId());
+    Payment exact(Money(0.50));
+    exact.addCoin(Coin::QUARTER, 2);
+    machine.processPayment(exact);
+    machine.selectProduct(mints.getId());
+    Payment bill(Money(5.00));
+    bill.addBill(Bill::FIVE, 1);
+    machine.processPayment(bill);
+    
+    MetricsSnapshot after = Metrics::snapshot();
+    if (!Metrics::enabled) {
+        assertTrue(after.counters.empty() && after.histograms.empty(), "Disabled builds report nothing");
+        cout << "Instrumentation tests passed!" << endl;
+        return;
+    }
+    
+    auto delta = [&](const string& name) {
+        return static_cast<int>(after.counter(name) - before.counter(name));
+    };
+    assertEqual(2, static_cast<int>(after.histogram("vending.payment_ns").count - before.histogram("vending.payment_ns").count),
+                "Both payments are timed");
+    assertEqual(1, delta("vending.sales"), "One sale");
+    assertEqual(1, delta("vending.exact_change_refusals"), "One refusal");
+    assertEqual(4, delta("vending.machine_lock.acquisitions"), "Two selections and two payments");
+    assertTrue(after.histogram("vending.change_table_rebuild_ns").count > before.histogram("vending.change_table_rebuild_ns").count,
+               "The change table is rebuilt as coins come in");
+    
+    cout << "Instrumentation tests passed!" << endl;
+}
+
 int main() {
     try {
         testProductManagement();
@@ -181,6 +475,11 @@ int main() {
         testErrorHandling();
         testConcurrentOperations();
         testChangeCalculation();
+        testMoney();
+        testChangeMaker();
+        testExactChange();
+        testFleetTelemetry();
+        testInstrumentation();
         
         cout << "All tests passed!" << endl;
         return 0;